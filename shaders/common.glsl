@@ -1,6 +1,7 @@
 #ifndef COMMON_H_GLSL
 #define COMMON_H_GLSL
 
+// the path state of a hit, the rt pipeline carries it as a PackedHitPayload
 struct HitPayload
 {
 	uint seed;
@@ -8,8 +9,12 @@ struct HitPayload
 	float ray_t;
 	vec3 scatter_color;
 	bool scatters;
-	vec3 emissive_color;
+	vec3 emissive_color; // light found at the hit, emitted or sampled from the light list
 	bool emits;
+	float nee_pdf; // solid angle pdf of ray_dir at diffuse hits, where the lights can be sampled, 0 otherwise.
+	               // set to a negative value before tracing when the raygen shader samples the lights of the hit itself
+	float light_pdf; // pdf of picking the hit emitter from the light list at the ray origin
+	vec3 hit_normal;
 };
 
 struct ShadowPayload
@@ -26,22 +31,155 @@ struct SceneUniforms
 	mat4 iproj;
 	vec4 light_pos;
 	uint samples_accum;
-	uint pad0;
-	uint pad1;
-	uint pad2;
+	uint samples_per_launch;
+	float exposure; // in stops, applied by the resolve pass
+	float target_error;
+	uint adaptive_sampling;
+	uint adaptive_min_samples;
+	uint russian_roulette;
+	uint next_event_estimation;
+	uint restir;
+	uint radiance_cache; // 0 off, 1 on, 2 shows the occupied cells
+	uint sampler; // SAMPLER_* in random.glsl
+	uint reproject_history; // the camera or the render size changed
+	mat4 prev_view_proj;
+	vec4 prev_camera_pos;
+	uint accumulation_layer;
+	uint denoise_iterations; // 0 shows the accumulation as it is
+	uvec2 render_size; // traced part of the rt images
+	uvec2 prev_render_size;
+	uvec2 image_size; // extent of the rt images
+	vec2 primary_jitter; // subpixel position of the rasterized primary visibility
+	uint raster_primary; // the first sample of a launch starts at the rasterized surfaces
+	uint shadow_mask; // instance mask of the shadow rays, the instances that cast shadows
+	uint frame; // counts the frames, it wraps
+	uint sphere_stats; // count the sphere intersection tests in the frame stats
 };
 
-struct SpherePrimitive
+const float PI = 3.14159265358979;
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2125, 0.7154, 0.0721));
+}
+
+// multiple importance sampling weight of a sample from strategy a
+float power_heuristic(float pdf_a, float pdf_b)
+{
+	const float a2 = pdf_a * pdf_a;
+	const float b2 = pdf_b * pdf_b;
+	return a2 / (a2 + b2);
+}
+
+// primary_jitter is the r2 point of the first launch of the frame, the following
+// dispatches of the frame go on along the sequence
+vec2 dispatch_jitter(vec2 primary_jitter, uint dispatch_index)
+{
+	return fract(primary_jitter + float(dispatch_index) * vec2(0.7548776662466927, 0.5698402909980532));
+}
+
+// unit vector to [-1, 1]^2 and back, the octahedron is unfolded onto the square
+vec2 octahedral_encode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+	}
+	return n.xy;
+}
+
+vec3 octahedral_decode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	const float t = max(-n.z, 0.0);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
+
+// HitPayload in 11 words for the trace calls, the scatter colour in half precision, directions in
+// octahedral form and the flags in the spare half of the scatter colour. the emitted and the
+// sampled light stay float, a small bright light is above the half range. on the way in
+// the hit and miss shaders only read the seed and the sign of nee_pdf, the incoming
+// direction is gl_WorldRayDirectionEXT
+struct PackedHitPayload
+{
+	uint seed;
+	uint ray_dir; // octahedral snorm 2x16, set when the hit scatters
+	float ray_t;
+	uvec2 scatter_color; // half rgb, PAYLOAD_* flags in the high half of y
+	vec3 emissive_color;
+	float nee_pdf;
+	float light_pdf;
+	uint hit_normal; // octahedral snorm 2x16, set for hits
+};
+
+const uint PAYLOAD_SCATTERS = 1u;
+const uint PAYLOAD_EMITS = 2u;
+const uint PAYLOAD_HIT = 4u; // the miss shader leaves hit_normal at zero
+
+uvec2 pack_half3(vec3 c, uint high)
+{
+	// above the half range the colour would turn into infinity. the scatter colours are reflectances
+	c = min(c, vec3(65504.0));
+	return uvec2(packHalf2x16(c.rg), packHalf2x16(vec2(c.b, 0.0)) | (high << 16));
+}
+
+vec3 unpack_half3(uvec2 p)
+{
+	return vec3(unpackHalf2x16(p.x), unpackHalf2x16(p.y & 0xFFFFu).x);
+}
+
+PackedHitPayload pack_payload(HitPayload p)
+{
+	const bool hit = p.hit_normal != vec3(0.0);
+	const uint flags = (p.scatters ? PAYLOAD_SCATTERS : 0u) | (p.emits ? PAYLOAD_EMITS : 0u) | (hit ? PAYLOAD_HIT : 0u);
+	PackedHitPayload packed;
+	packed.seed = p.seed;
+	packed.ray_dir = p.scatters ? packSnorm2x16(octahedral_encode(p.ray_dir)) : 0u;
+	packed.ray_t = p.ray_t;
+	packed.scatter_color = pack_half3(p.scatter_color, flags);
+	packed.emissive_color = p.emissive_color;
+	packed.nee_pdf = p.nee_pdf;
+	packed.light_pdf = p.light_pdf;
+	packed.hit_normal = hit ? packSnorm2x16(octahedral_encode(p.hit_normal)) : 0u;
+	return packed;
+}
+
+// directions come back unit length, the ray t of the next hit is measured along the decoded one
+HitPayload unpack_payload(PackedHitPayload packed)
+{
+	const uint flags = packed.scatter_color.y >> 16;
+	HitPayload p;
+	p.seed = packed.seed;
+	p.scatters = (flags & PAYLOAD_SCATTERS) != 0u;
+	p.ray_dir = p.scatters ? octahedral_decode(unpackSnorm2x16(packed.ray_dir)) : vec3(0.0);
+	p.ray_t = packed.ray_t;
+	p.scatter_color = unpack_half3(packed.scatter_color);
+	p.emits = (flags & PAYLOAD_EMITS) != 0u;
+	p.emissive_color = packed.emissive_color;
+	p.nee_pdf = packed.nee_pdf;
+	p.light_pdf = packed.light_pdf;
+	p.hit_normal = (flags & PAYLOAD_HIT) != 0u ? octahedral_decode(unpackSnorm2x16(packed.hit_normal)) : vec3(0.0);
+	return p;
+}
+
+// the fields of an incoming payload that the hit and miss shaders read, they write all the others
+HitPayload payload_in(PackedHitPayload packed)
+{
+	HitPayload p;
+	p.seed = packed.seed;
+	p.nee_pdf = packed.nee_pdf;
+	return p;
+}
+
+// shading fields of a sphere, its center and radius are a separate vec4 stream
+struct SphereShading
 {
 	vec4 albedo;
-	float aabb_minx;
-	float aabb_miny;
-	float aabb_minz;
-	float aabb_maxx;
-	float aabb_maxy;
-	float aabb_maxz;
 	int material;
 	float fuzz;
+	uint pad0;
+	uint pad1;
 };
 
 struct TriVertex
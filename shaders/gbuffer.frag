@@ -0,0 +1,34 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+
+#include "common.glsl"
+
+// geometry table entry of the drawn model part
+layout(push_constant) uniform PushConstantsBlock
+{
+	uint geometry;
+} pc;
+
+layout(set = 0, binding = 0, std140) uniform SceneUniformsBlock
+{
+	SceneUniforms ubo;
+};
+
+layout(location = 0)
+in VertexOut
+{
+	vec3 wnormal;
+	vec3 wpos;
+} fs_in;
+
+// decoded by gbuffer_load() in gbuffer.glsl
+layout(location = 0) out uvec4 out_surface;
+
+void main()
+{
+	const vec3 camera_pos = (ubo.iview * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+	const vec3 normal = normalize(fs_in.wnormal);
+	// the pipeline faces follow the hit kinds of the rt pipeline
+	const uint flags = 1u | (gl_FrontFacing ? 2u : 0u);
+	out_surface = uvec4(floatBitsToUint(length(fs_in.wpos - camera_pos)), packSnorm2x16(octahedral_encode(normal)), pc.geometry, flags);
+}
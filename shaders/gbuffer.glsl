@@ -0,0 +1,58 @@
+#ifndef GBUFFER_H_GLSL
+#define GBUFFER_H_GLSL
+
+// primary visibility of the triangle meshes, rasterized by gbuffer.vert and gbuffer.frag before the trace.
+// the first sample of a launch starts its path at the rasterized surface of the pixel, only the spheres
+// and the ground, which are not rasterized, are traced in front of it.
+// include after geometry.glsl, scatter.glsl and lights.glsl
+
+// x camera distance, y octahedral normal, z geometry table entry, w 1 | front face << 1, 0 where nothing was drawn
+layout(set = 0, binding = 17, rgba32ui) uniform readonly uimage2D gbuffer;
+
+// instance masks of the tlas, see create_top_acceleration_structure()
+const uint INSTANCE_MASK_MODEL = 0x01u;
+const uint INSTANCE_MASK_SPHERES = 0x02u;
+const uint INSTANCE_MASK_MODEL_NO_SHADOWS = 0x04u;
+const uint INSTANCE_MASK_GROUND = 0x08u;
+
+struct GBufferSurface
+{
+	bool hit;
+	float dist;
+	vec3 normal;
+	uint geometry;
+	bool front_face;
+};
+
+GBufferSurface gbuffer_load(ivec2 pixel)
+{
+	const uvec4 g = imageLoad(gbuffer, pixel);
+	GBufferSurface s;
+	s.hit = (g.w & 1u) != 0u;
+	s.dist = uintBitsToFloat(g.x);
+	s.normal = octahedral_decode(unpackSnorm2x16(g.y));
+	s.geometry = g.z;
+	s.front_face = (g.w & 2u) != 0u;
+	return s;
+}
+
+// simple.rchit at the rasterized surface, t is its distance along the camera ray dir
+void shade_gbuffer(inout HitPayload payload, GBufferSurface s, vec3 origin, vec3 dir, float t)
+{
+	// a negative pdf on the way in means the raygen shader samples the lights of this hit
+	const bool sample_lights = ubo.next_event_estimation != 0 && payload.nee_pdf >= 0.0;
+	const PBRMaterial material = materials[geometries[s.geometry].material_index];
+	const bool lambertian = scatter_material(payload, dir, s.normal, material, s.front_face);
+
+	vec3 direct_light = vec3(0.0);
+	if (lambertian && sample_lights) {
+		direct_light = direct_light_lambert(payload.seed, origin + t * dir, s.normal, material.albedo.rgb);
+	}
+	payload.ray_t = t;
+	payload.emissive_color = direct_light;
+	payload.emits = any(greaterThan(direct_light, vec3(0.0)));
+	payload.light_pdf = 0.0;
+	payload.hit_normal = s.normal;
+}
+
+#endif //GBUFFER_H_GLSL
@@ -0,0 +1,43 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+
+#include "common.glsl"
+
+layout(set = 0, binding = 0, std140) uniform SceneUniformsBlock
+{
+	SceneUniforms ubo;
+};
+
+// each dispatch of the frame rasterizes the surfaces through its own jitter
+layout(push_constant) uniform PushConstantsBlock
+{
+	layout(offset = 4) uint dispatch_index;
+} pc;
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+
+layout(location = 0)
+out VertexOut
+{
+	vec3 wnormal;
+	vec3 wpos;
+} vs_out;
+
+void main() {
+	const vec4 wpos = ubo.model * vec4(in_position, 1.0);
+	vec4 clip = ubo.proj * ubo.view * wpos;
+
+	// the raygen maps the render size to [-1, 1] and traces pixel p through p + jitter. the rt images
+	// are larger, the surfaces are drawn into their render size corner with the jitter moved onto the
+	// pixel centers. the mapping is linear in clip space, so the clipping stays correct
+	const vec2 image = vec2(ubo.image_size);
+	const vec2 scale = vec2(ubo.render_size) / image;
+	const vec2 jitter = dispatch_jitter(ubo.primary_jitter, pc.dispatch_index);
+	const vec2 offset = scale - 1.0 + (1.0 - 2.0 * jitter) / image;
+	clip.xy = clip.xy * scale + clip.w * offset;
+
+	gl_Position = clip;
+	vs_out.wnormal = (ubo.model * vec4(in_normal, 0.0)).xyz;
+	vs_out.wpos = wpos.xyz;
+}
@@ -0,0 +1,58 @@
+#ifndef GEOMETRY_H_GLSL
+#define GEOMETRY_H_GLSL
+
+// geometry and material tables of the triangle meshes, built by create_geometry_buffers().
+// include after the scene uniforms, needs GL_EXT_buffer_reference and GL_EXT_scalar_block_layout
+
+layout(buffer_reference, scalar, buffer_reference_align = 8) buffer VertexBuffer
+{
+	TriVertex vertices[];
+};
+
+layout(buffer_reference, scalar, buffer_reference_align = 4) buffer IndexBuffer
+{
+	uvec3 indices[];
+};
+
+struct GeometryInfo
+{
+	VertexBuffer vertex_buffer;
+	IndexBuffer index_buffer;
+	uint material_index;
+	uint flags;
+};
+
+// the geometry belongs to an instance without transform, its normals are in world space
+const uint GEOMETRY_WORLD_SPACE = 1u;
+
+layout(set = 0, binding = 3, scalar) readonly buffer GeometryTable
+{
+	GeometryInfo geometries[];
+};
+
+layout(set = 0, binding = 4, scalar) readonly buffer MaterialTable
+{
+	PBRMaterial materials[];
+};
+
+vec3 fetch_normal(GeometryInfo geom, uint primitive_id, vec2 bary)
+{
+	vec3 barys = vec3(1.0f - bary.x - bary.y, bary.x, bary.y);
+	VertexBuffer vbuf = geom.vertex_buffer;
+	IndexBuffer ibuf = geom.index_buffer;
+
+	uvec3 vidx = ibuf.indices[primitive_id];
+	TriVertex v0 = vbuf.vertices[vidx.x];
+	TriVertex v1 = vbuf.vertices[vidx.y];
+	TriVertex v2 = vbuf.vertices[vidx.z];
+
+	vec3 norm = v0.normal.xyz * barys.x +
+				v1.normal.xyz * barys.y +
+				v2.normal.xyz * barys.z;
+	if ((geom.flags & GEOMETRY_WORLD_SPACE) == 0u) {
+		norm = vec3(ubo.model * vec4(norm, 0.0));
+	}
+	return normalize(norm);
+}
+
+#endif //GEOMETRY_H_GLSL
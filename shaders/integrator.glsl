@@ -0,0 +1,167 @@
+#ifndef INTEGRATOR_H_GLSL
+#define INTEGRATOR_H_GLSL
+
+// what the integrators share, the megakernels of simple.rgen and pathtrace.comp and the wavefront passes:
+// the camera rays and the accumulation of the samples of a launch into the history.
+// include after random.glsl and reprojection.glsl
+
+// linear mean radiance and sample count, tonemapped by the resolve pass.
+// the launches alternate between the two layers, one is read and the other written
+layout(set = 0, binding = 1, rgba32f) uniform image2DArray result;
+
+// mean of the squared luminance
+layout(set = 0, binding = 5, r32f) uniform image2DArray moments;
+
+// albedo of the primary hit, the denoiser filters the radiance divided by it
+layout(set = 0, binding = 12, rgba16f) uniform writeonly image2D albedo;
+
+// glass needs many bounces, russian roulette keeps the average path short.
+// the wavefront integrator records at most RT_WAVEFRONT_MAX_DEPTH bounces, keep them equal
+const uint max_depth = 32u;
+const uint roulette_min_depth = 3u;
+
+vec2 subpixel_jitter(inout uint seed, uint samples)
+{
+	// jitter sample, the first two dimensions of the path are the pixel position
+	float r0 = random_float(seed);
+	float r1 = random_float(seed);
+	vec2 jitter = samples == 0 ? vec2(0.5) : vec2(r0, r1);
+	return jitter;
+}
+
+// the raygen of a batch looks through the cameras of its views
+#ifndef CAMERA_IVIEW
+#define CAMERA_IVIEW ubo.iview
+#define CAMERA_IPROJ ubo.iproj
+#endif
+
+// direction through the point jitter of the pixel, not normalized
+vec3 camera_direction(uvec2 index, uvec2 dims, vec2 jitter)
+{
+	vec2 d = (vec2(index) + jitter) / vec2(dims);
+	// go to [-1, +1]
+	d = 2.0 * d - 1.0;
+
+	vec4 target = CAMERA_IPROJ * vec4(d.x, d.y, 1.0, 1.0);
+	return (CAMERA_IVIEW * vec4(target.xyz, 0.0)).xyz;
+}
+
+void camera_ray(inout uint seed, uvec2 index, uvec2 dims, uint sample_index, out vec3 origin, out vec3 dir)
+{
+	vec2 jitter = subpixel_jitter(seed, sample_index);
+	origin = (CAMERA_IVIEW * vec4(0, 0, 0, 1.0)).xyz;
+	dir = camera_direction(index, dims, jitter);
+}
+
+// continue with a probability that follows the throughput and
+// divide by it, so the estimate stays unbiased
+bool russian_roulette(inout uint seed, uint depth, inout vec3 throughput)
+{
+	if (ubo.russian_roulette == 0 || depth + 1u < roulette_min_depth) {
+		return true;
+	}
+	const float p = clamp(max(throughput.r, max(throughput.g, throughput.b)), 0.05, 0.95);
+	if (random_float(seed) > p) {
+		return false;
+	}
+	throughput /= p;
+	return true;
+}
+
+// samples already in the image, including the previous dispatches of this frame.
+// 0 means the accumulation was reset and the image content is stale
+uint launch_samples_before(uint dispatch_index)
+{
+	return ubo.samples_accum + dispatch_index * ubo.samples_per_launch;
+}
+
+uint launch_write_layer(uint samples_before)
+{
+	return (samples_before / ubo.samples_per_launch) & 1u;
+}
+
+// after a camera move or a render size change the history of the pixel is somewhere else,
+// it is found once the primary hit is known. the later dispatches of the frame share the camera
+bool launch_reprojects(uint samples_before, uint dispatch_index)
+{
+	return samples_before > 0 && ubo.reproject_history != 0 && dispatch_index == 0;
+}
+
+struct History
+{
+	vec4 accum; // mean radiance and sample count
+	float lum_moment;
+	vec4 surface;
+};
+
+History history_load(ivec2 pixel, uint layer)
+{
+	History h;
+	h.accum = imageLoad(result, ivec3(pixel, layer));
+	h.lum_moment = imageLoad(moments, ivec3(pixel, layer)).r;
+	h.surface = imageLoad(surfaces, ivec3(pixel, layer));
+	return h;
+}
+
+// history of the pixel itself, empty after a reset and while it is reprojected
+History history_before_launch(ivec2 index, uint samples_before, bool reprojecting)
+{
+	if (samples_before > 0 && !reprojecting) { // uniform branching
+		return history_load(index, launch_write_layer(samples_before) ^ 1u);
+	}
+	History h;
+	h.accum = vec4(0.0);
+	h.lum_moment = 0.0;
+	h.surface = surface_encode(false, vec3(0.0), 0.0);
+	return h;
+}
+
+// relative standard error of the mean luminance, the small offset 
+// keeps noisy pixels that are almost black from never converging
+bool history_converged(History h)
+{
+	const float n = h.accum.a;
+	if (n < float(ubo.adaptive_min_samples)) {
+		return false;
+	}
+	const float mean = luminance(h.accum.rgb);
+	const float variance = max(h.lum_moment - mean * mean, 0.0);
+	const float rel_error = sqrt(variance / n) / (mean + 0.01);
+	return rel_error < ubo.target_error;
+}
+
+// a pixel that traces nothing this launch, the next launch reads the other layer
+void history_keep(ivec2 index, uint write_layer, History h)
+{
+	imageStore(result, ivec3(index, write_layer), h.accum);
+	imageStore(moments, ivec3(index, write_layer), vec4(h.lum_moment));
+	imageStore(surfaces, ivec3(index, write_layer), h.surface);
+}
+
+// adds the samples of the launch to the history, the primary hit finds the history of a reprojected pixel
+void history_accumulate(ivec2 index, uint write_layer, bool reprojecting, History h, vec3 color, float lum_sq, uint samples,
+	bool hit, bool diffuse, vec3 pos, vec3 normal)
+{
+	// the read layer is not written by this launch, so any pixel of it can be the history.
+	// the history length is capped by how much the shading of the surface depends on the view
+	const uint read_layer = write_layer ^ 1u;
+	float n = h.accum.a;
+	ivec2 prev_pixel;
+	if (reprojecting && hit && reproject(pos, normal, read_layer, prev_pixel)) {
+		h = history_load(prev_pixel, read_layer);
+		float history = diffuse ? reprojection_diffuse_history : reprojection_specular_history;
+		if (ubo.prev_render_size != ubo.render_size) {
+			history = min(history, reprojection_resized_history);
+		}
+		n = min(h.accum.a, history);
+	}
+
+	// running means weighted by the per pixel sample count, which differs between pixels with adaptive sampling
+	const float n_new = n + float(samples);
+	color = (h.accum.rgb * n + color) / n_new;
+	const float lum_moment = (h.lum_moment * n + lum_sq) / n_new;
+	imageStore(result, ivec3(index, write_layer), vec4(color, n_new));
+	imageStore(moments, ivec3(index, write_layer), vec4(lum_moment));
+}
+
+#endif //INTEGRATOR_H_GLSL
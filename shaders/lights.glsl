@@ -0,0 +1,149 @@
+#ifndef LIGHTS_H_GLSL
+#define LIGHTS_H_GLSL
+
+// light list of the emissive spheres, built by create_light_buffer().
+// include after common.glsl, random.glsl and the scene uniforms, the shadow rays also need
+// scene and a ShadowPayload shadow_payload at location 1 declared before the include.
+// shaders that trace their shadow rays with ray queries define LIGHTS_SAMPLING_ONLY
+
+struct LightSphere
+{
+	vec3 center;
+	float radius;
+	vec3 emission;
+	float cdf; // normalized power of this light and the ones before it
+};
+
+layout(set = 0, binding = 7, scalar) readonly buffer LightTable
+{
+	uint light_count;
+	float total_power;
+	uint light_pad0;
+	uint light_pad1;
+	LightSphere lights[];
+};
+
+// lights are picked proportional to this, must match light_power() in main.cpp
+float light_power(vec3 emission, float radius)
+{
+	return luminance(emission) * radius * radius;
+}
+
+// 1 - cos of the half angle of the cone covered by the sphere, 0 when pos is inside it
+float sphere_cone_extent(vec3 pos, vec3 center, float radius)
+{
+	const vec3 to_center = center - pos;
+	const float d2 = dot(to_center, to_center);
+	const float r2 = radius * radius;
+	if (d2 <= r2) return 0.0;
+	const float sin2 = r2 / d2;
+	// same as 1 - cos, without the cancellation for small and far away lights
+	return sin2 / (1.0 + sqrt(1.0 - sin2));
+}
+
+// solid angle pdf of sample_light() picking a direction towards this sphere
+float light_pdf(vec3 pos, vec3 center, float radius, vec3 emission)
+{
+	const float extent = sphere_cone_extent(pos, center, radius);
+	if (extent <= 0.0 || total_power <= 0.0) return 0.0;
+	const float select_pdf = light_power(emission, radius) / total_power;
+	return select_pdf / (2.0 * PI * extent);
+}
+
+// first light whose cdf is above u
+uint pick_light(float u)
+{
+	uint lo = 0u;
+	uint hi = light_count - 1u;
+	while (lo < hi) {
+		const uint mid = (lo + hi) / 2u;
+		if (lights[mid].cdf > u) {
+			hi = mid;
+		} else {
+			lo = mid + 1u;
+		}
+	}
+	return lo;
+}
+
+// picks a light by power and a direction uniformly in the cone it covers,
+// dist is the distance to the near side of the sphere along dir
+bool sample_light(inout uint seed, vec3 pos, out uint light_index, out vec3 dir, out float dist, out vec3 emission, out float pdf)
+{
+	if (light_count == 0u) return false;
+	light_index = pick_light(random_float(seed));
+	const LightSphere light = lights[light_index];
+
+	const vec3 to_center = light.center - pos;
+	const float d = length(to_center);
+	const float extent = sphere_cone_extent(pos, light.center, light.radius);
+	if (extent <= 0.0) return false;
+
+	const float cos_theta = 1.0 - random_float(seed) * extent;
+	const float sin_theta = sqrt(max(1.0 - cos_theta * cos_theta, 0.0));
+	const float phi = 2.0 * PI * random_float(seed);
+	const vec3 w = to_center / d;
+	vec3 u, v;
+	orthonormal_basis(w, u, v);
+	dir = normalize(u * (cos(phi) * sin_theta) + v * (sin(phi) * sin_theta) + w * cos_theta);
+
+	dist = d * cos_theta - sqrt(max(light.radius * light.radius - d * d * sin_theta * sin_theta, 0.0));
+	emission = light.emission;
+	pdf = light_pdf(pos, light.center, light.radius, light.emission);
+	return pdf > 0.0;
+}
+
+// light sample for a lambertian surface, weighted against the cosine sampled bounce that
+// can find the same light. it only counts when the shadow ray along dir is not occluded
+bool sample_light_lambert(inout uint seed, vec3 pos, vec3 normal, vec3 albedo, out vec3 dir, out float dist, out vec3 contribution)
+{
+	contribution = vec3(0.0);
+	uint light_index;
+	vec3 emission;
+	float pdf;
+	if (!sample_light(seed, pos, light_index, dir, dist, emission, pdf)) return false;
+
+	const float cos_theta = dot(dir, normal);
+	if (cos_theta <= 0.0 || dist <= 0.02) return false;
+
+	const float bsdf_pdf = cos_theta / PI;
+	contribution = emission * (albedo / PI) * cos_theta * power_heuristic(pdf, bsdf_pdf) / pdf;
+	return true;
+}
+
+#ifndef LIGHTS_SAMPLING_ONLY
+// occlusion query, any hit ends the traversal and no hit shader runs. the payload
+// starts out occluded and only the miss shader clears it.
+// the cull mask leaves out the instances that do not cast shadows
+bool light_visible(vec3 pos, vec3 dir, float dist)
+{
+	if (dist <= 0.02) return false;
+	// shadow hit and miss records follow the shading ones
+	shadow_payload.in_shadow = 1.0;
+	const uint flags = gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsSkipClosestHitShaderEXT;
+	traceRayEXT(scene, flags, ubo.shadow_mask, 1, 0, 1, pos, 0.01, dir, dist - 0.01, 1);
+	return shadow_payload.in_shadow < 0.0;
+}
+
+// the same query finding the closest occluder and running shadow.rchit on it,
+// the shadow benchmark compares the two
+bool light_visible_closest_hit(vec3 pos, vec3 dir, float dist)
+{
+	if (dist <= 0.02) return false;
+	shadow_payload.in_shadow = 1.0;
+	traceRayEXT(scene, gl_RayFlagsOpaqueEXT, ubo.shadow_mask, 1, 0, 1, pos, 0.01, dir, dist - 0.01, 1);
+	return shadow_payload.in_shadow < 0.0;
+}
+
+// light arriving at a lambertian surface through one shadow ray
+vec3 direct_light_lambert(inout uint seed, vec3 pos, vec3 normal, vec3 albedo)
+{
+	vec3 dir;
+	float dist;
+	vec3 contribution;
+	if (!sample_light_lambert(seed, pos, normal, albedo, dir, dist, contribution) || !light_visible(pos, dir, dist)) return vec3(0.0);
+	return contribution;
+}
+#endif
+
+#endif //LIGHTS_H_GLSL
@@ -0,0 +1,133 @@
+#ifndef RADIANCE_CACHE_H_GLSL
+#define RADIANCE_CACHE_H_GLSL
+
+// world space hash grid of the light leaving diffuse surfaces, in the spirit of 
+// Binder et al. "Massively parallel path space filtering". cells are keyed on position, 
+// normal and a level of detail that grows with the distance to the camera, and are 
+// found with linear probing. the cells no path used for a while are freed by radiance_cache_age.comp, so the
+// cells of camera distances and places out of view make room. the host clears the grid when the scene changes.
+// src/radiance_cache.cpp mirrors the key, the probing and the sums for the tests, keep them in sync.
+// include after random.glsl
+
+struct RadianceCacheCell
+{
+	uint checksum; // 0 for a free cell
+	uint sample_count;
+	uint radiance_r; // fixed point sums
+	uint radiance_g;
+	uint radiance_b;
+	uint last_used; // frame of the last insert or lookup
+};
+
+// the cell count is a power of two
+layout(set = 0, binding = 9) coherent buffer RadianceCache
+{
+	RadianceCacheCell cells[];
+};
+
+const float radiance_cache_cell_size = 0.02; // at the finest level
+const float radiance_cache_lod_distance = 2.0; // camera distance covered by the finest level
+const uint radiance_cache_probes = 8u;
+const uint radiance_cache_min_samples = 16u; // before a cell is used
+const uint radiance_cache_max_samples = 4096u; // the cell stops learning after this
+const float radiance_cache_fixed_point = 256.0;
+const float radiance_cache_max_radiance = 64.0; // keeps the sums from overflowing
+const uint radiance_cache_max_age = 256u; // frames a cell is kept without being used
+const uint radiance_cache_age_slices = 16u; // the aging visits a slice of the cells per frame
+
+// the cells double in size each time the camera distance doubles past the finest level
+uint radiance_cache_level(float dist)
+{
+	return uint(clamp(floor(log2(max(dist / radiance_cache_lod_distance, 1.0))), 0.0, 15.0));
+}
+
+// the slot hash picks where probing starts and the checksum, from an independent 
+// hash chain, tells the keys that land in the same slots apart
+void radiance_cache_key(vec3 pos, vec3 normal, vec3 camera_pos, out uint slot_hash, out uint checksum)
+{
+	const uint level = radiance_cache_level(length(pos - camera_pos));
+	const float cell_size = radiance_cache_cell_size * float(1u << level);
+	const uvec3 p = uvec3(ivec3(floor(pos / cell_size)));
+	// 2 bits per normal component
+	const uvec3 n = uvec3(clamp((normal * 0.5 + 0.5) * 4.0, vec3(0.0), vec3(3.0)));
+	const uint rest = level | (n.x << 4u) | (n.y << 6u) | (n.z << 8u);
+
+	slot_hash = pcg_hash(pcg_hash(pcg_hash(pcg_hash(p.x) + p.y) + p.z) + rest);
+	const uint c = pcg_hash(pcg_hash(pcg_hash(pcg_hash(p.z ^ 0x68e31da4u) ^ p.y) ^ p.x) ^ rest);
+	checksum = max(c, 1u);
+}
+
+// cell of the key, claimed if free when insert is set. -1 when the key is not there or the probes are full
+int radiance_cache_find(uint slot_hash, uint checksum, bool insert)
+{
+	const uint mask = uint(cells.length()) - 1u;
+	for (uint i = 0u; i < radiance_cache_probes; ++i) {
+		const uint slot = (slot_hash + i) & mask;
+		const uint c = cells[slot].checksum;
+		if (c == checksum) return int(slot);
+		if (c == 0u) {
+			if (!insert) return -1;
+			const uint prev = atomicCompSwap(cells[slot].checksum, 0u, checksum);
+			if (prev == 0u || prev == checksum) return int(slot);
+		}
+	}
+	return -1;
+}
+
+// frame is the one of the scene uniforms, the cell is marked as used in it
+void radiance_cache_insert(vec3 pos, vec3 normal, vec3 camera_pos, vec3 radiance, uint frame)
+{
+	if (any(isnan(radiance)) || any(isinf(radiance))) return;
+	uint slot_hash, checksum;
+	radiance_cache_key(pos, normal, camera_pos, slot_hash, checksum);
+	const int cell = radiance_cache_find(slot_hash, checksum, true);
+	if (cell < 0) return;
+	cells[cell].last_used = frame;
+	if (cells[cell].sample_count >= radiance_cache_max_samples) return;
+
+	const uvec3 fixed_radiance = uvec3(clamp(radiance, vec3(0.0), vec3(radiance_cache_max_radiance)) * radiance_cache_fixed_point + 0.5);
+	atomicAdd(cells[cell].radiance_r, fixed_radiance.r);
+	atomicAdd(cells[cell].radiance_g, fixed_radiance.g);
+	atomicAdd(cells[cell].radiance_b, fixed_radiance.b);
+	atomicAdd(cells[cell].sample_count, 1u);
+}
+
+bool radiance_cache_lookup(vec3 pos, vec3 normal, vec3 camera_pos, uint frame, out vec3 radiance)
+{
+	radiance = vec3(0.0);
+	uint slot_hash, checksum;
+	radiance_cache_key(pos, normal, camera_pos, slot_hash, checksum);
+	const int cell = radiance_cache_find(slot_hash, checksum, false);
+	if (cell < 0) return false;
+	cells[cell].last_used = frame;
+
+	const uint count = cells[cell].sample_count;
+	if (count < radiance_cache_min_samples) return false;
+	const uvec3 sums = uvec3(cells[cell].radiance_r, cells[cell].radiance_g, cells[cell].radiance_b);
+	radiance = vec3(sums) / (float(count) * radiance_cache_fixed_point);
+	return true;
+}
+
+// frees the cell when no path used it for radiance_cache_max_age frames. a key probed past the
+// freed cell is not found anymore, it starts over in the freed cell and its old cell ages out too.
+// the traces do not run at the same time
+void radiance_cache_age(uint slot, uint frame)
+{
+	if (cells[slot].checksum == 0u || frame - cells[slot].last_used <= radiance_cache_max_age) return;
+	cells[slot] = RadianceCacheCell(0u, 0u, 0u, 0u, 0u, 0u);
+}
+
+// a color per cell, dark while the cell is still learning and black where there is none
+vec3 radiance_cache_occupancy(vec3 pos, vec3 normal, vec3 camera_pos)
+{
+	uint slot_hash, checksum;
+	radiance_cache_key(pos, normal, camera_pos, slot_hash, checksum);
+	const int cell = radiance_cache_find(slot_hash, checksum, false);
+	if (cell < 0) return vec3(0.0);
+
+	const vec3 color = vec3(uvec3(checksum, checksum >> 8u, checksum >> 16u) & 255u) / 255.0;
+	const float filled = float(min(cells[cell].sample_count, radiance_cache_min_samples)) / float(radiance_cache_min_samples);
+	return color * mix(0.1, 1.0, filled);
+}
+
+#endif //RADIANCE_CACHE_H_GLSL
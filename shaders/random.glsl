@@ -1,6 +1,33 @@
 #ifndef RANDOM_H_GLSL
 #define RANDOM_H_GLSL
 
+// include after common.glsl.
+// the sampler of a path is a single uint state, so it travels in the payload like a seed.
+// the top two bits select the sampler:
+//   SAMPLER_RANDOM      tea seeded lcg in the low 30 bits
+//   SAMPLER_SOBOL       owen scrambled sobol, 20 bit sample index and 10 bit dimension
+//   SAMPLER_BLUE_NOISE  one scrambled sobol sequence for all pixels, rotated per pixel by a blue noise tile
+// the tables are generated by sampler_tables.cpp, src/sampler.cpp mirrors sampler_init() and random_float() for the tests
+
+#define SAMPLER_RANDOM 0u
+#define SAMPLER_SOBOL 1u
+#define SAMPLER_BLUE_NOISE 2u
+
+// the pixel that decorrelates the sequences
+#ifndef SAMPLER_PIXEL
+#define SAMPLER_PIXEL gl_LaunchIDEXT.xy
+#endif
+
+layout(set = 0, binding = 10, std430) readonly buffer SamplerTables
+{
+	uint sobol_matrices[2 * 32]; // two dimensions, one column per index bit
+	uint blue_noise_size;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+	float blue_noise[];
+} sampler_tables;
+
 // random functions taken from: 
 // https://github.com/nvpro-samples/vk_raytracing_tutorial_KHR/tree/master/ray_tracing_jitter_cam
 
@@ -22,38 +49,118 @@ uint random_tea(uint val0, uint val1)
 }
 
 // Generate a random unsigned int in [0, 2^24)
-// using the Numerical Recipes linear congruential generator
+// using the Numerical Recipes linear congruential generator,
+// the state is kept to 30 bits which leaves the low 24 bits as they were
 uint random_lcg(inout uint seed)
 {
     uint LCG_A = 1664525u;
     uint LCG_C = 1013904223u;
-    seed = (LCG_A * seed + LCG_C);
+    seed = (LCG_A * seed + LCG_C) & 0x3FFFFFFFu;
     return seed & 0x00FFFFFFu;
 }
 
+uint pcg_hash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint sobol_sample(uint index, uint dim)
+{
+    uint x = 0u;
+    for (uint bit = 0u; index != 0u; ++bit, index >>= 1u) {
+        if ((index & 1u) != 0u) {
+            x ^= sampler_tables.sobol_matrices[dim * 32u + bit];
+        }
+    }
+    return x;
+}
+
+// Burley, "Practical Hash-based Owen Scrambling"
+uint laine_karras_permutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x = laine_karras_permutation(x, seed);
+    return bitfieldReverse(x);
+}
+
+// sampler state for a sample of a pixel
+uint sampler_init(uint sampler, uvec2 pixel, uint width, uint sample_index)
+{
+    if (sampler == SAMPLER_RANDOM) {
+        return random_tea(pixel.y * width + pixel.x, sample_index) & 0x3FFFFFFFu;
+    }
+    return (sampler << 30u) | ((sample_index & 0xFFFFFu) << 10u);
+}
+
 // Generate a random float in [0, 1)
 float random_float(inout uint seed) 
 {
-    return (float(random_lcg(seed)) / float(0x01000000));
+    const uint sampler = seed >> 30u;
+    if (sampler == SAMPLER_RANDOM) {
+        return (float(random_lcg(seed)) / float(0x01000000));
+    }
+
+    const uint index = (seed >> 10u) & 0xFFFFFu;
+    const uint dim = seed & 0x3FFu;
+    // past 1024 dimensions the count carries into the index, which is still a different sequence
+    seed = (seed & 0xC0000000u) | ((seed + 1u) & 0x3FFFFFFFu);
+
+    // consecutive dimensions are pairs of the 2d sobol sequence, each pair 
+    // gets its own shuffle of the sample index and its own scramble
+    const uvec2 pixel = SAMPLER_PIXEL;
+    const uint pixel_seed = sampler == SAMPLER_SOBOL ? pcg_hash(pixel.x + pcg_hash(pixel.y)) : 0u;
+    const uint pair_seed = pcg_hash(pixel_seed ^ pcg_hash(dim >> 1u));
+    const uint shuffled = nested_uniform_scramble(index, pair_seed);
+    const uint x = nested_uniform_scramble(sobol_sample(shuffled, dim & 1u), pcg_hash(pair_seed + (dim & 1u) + 1u));
+    float u = float(x >> 8u) / float(0x01000000);
+
+    if (sampler == SAMPLER_BLUE_NOISE) {
+        // cranley patterson rotation, the tile is shifted for each dimension
+        const uint size = sampler_tables.blue_noise_size;
+        const uint h = pcg_hash(dim + 0x9E3779B9u);
+        const uvec2 p = (pixel + uvec2(h, h >> 16u)) % size;
+        u = fract(u + sampler_tables.blue_noise[p.y * size + p.x]);
+    }
+    return u;
 }
 
-vec3 random_in_unit_sphere(inout uint seed)
+// orthonormal basis around n, see Duff et al. "Building an Orthonormal Basis, Revisited"
+void orthonormal_basis(vec3 n, out vec3 b1, out vec3 b2)
 {
-	vec3 p;
-    uint loops = 16;
-    while (loops-- > 0u) {
-	    float x = random_float(seed);
-	    float y = random_float(seed);
-	    float z = random_float(seed);
-	    p = 2.0 * vec3(x, y, z) - vec3(1.0);
-        if (length(p) < 1) break;
-    }
-    return p;
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float b = n.x * n.y * a;
+    b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    b2 = vec3(b, s + n.y * n.y * a, -n.y);
 }
 
+// the mappings below are closed form so that every sample uses the same dimensions
+
 vec3 random_unit_vector(inout uint seed)
 {
-    return normalize(random_in_unit_sphere(seed));
+    float z = 1.0 - 2.0 * random_float(seed);
+    float phi = 2.0 * PI * random_float(seed);
+    float r = sqrt(max(1.0 - z * z, 0.0));
+    return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+vec3 random_in_unit_sphere(inout uint seed)
+{
+    vec3 dir = random_unit_vector(seed);
+    // the density of the radius grows with r^2
+    return dir * pow(random_float(seed), 1.0 / 3.0);
 }
 
 vec3 random_in_hemisphere(inout uint seed, vec3 normal)
@@ -64,5 +171,15 @@ vec3 random_in_hemisphere(inout uint seed, vec3 normal)
     return in_sphere;
 }
 
+// cosine distributed around the normal, the pdf is dot(dir, normal) / pi
+vec3 random_cosine_direction(inout uint seed, vec3 normal)
+{
+    float r = sqrt(random_float(seed));
+    float phi = 2.0 * PI * random_float(seed);
+    vec3 t, b;
+    orthonormal_basis(normal, t, b);
+    return normalize(t * (r * cos(phi)) + b * (r * sin(phi)) + normal * sqrt(max(1.0 - r * r, 0.0)));
+}
+
 
-#endif //RANDOM_H_GLSL
\ No newline at end of file
+#endif //RANDOM_H_GLSL
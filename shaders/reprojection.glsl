@@ -0,0 +1,49 @@
+#ifndef REPROJECTION_H_GLSL
+#define REPROJECTION_H_GLSL
+
+// temporal reprojection of the accumulation when the camera moves. the primary hit of the
+// pixel is projected with the previous camera, and the history of the pixel it lands on is
+// kept if that pixel saw the same surface, judged by its camera distance and normal.
+// include after the scene uniforms
+
+// normal and camera distance of the primary hit, the distance is negative for a miss
+layout(set = 0, binding = 11, rgba16f) uniform image2DArray surfaces;
+
+const float reprojection_depth_tolerance = 0.05; // relative to the camera distance
+const float reprojection_normal_tolerance = 0.9; // cosine
+// samples of history a reprojected pixel keeps, the shading of diffuse surfaces does not
+// depend on the view so their history stays valid, glossy and glass reflections move with the camera
+const float reprojection_diffuse_history = 256.0;
+const float reprojection_specular_history = 4.0;
+// history from another render size is blurred or aliased, it is replaced quickly
+const float reprojection_resized_history = 8.0;
+
+vec4 surface_encode(bool hit, vec3 normal, float dist)
+{
+	return hit ? vec4(normal, dist) : vec4(0.0, 0.0, 0.0, -1.0);
+}
+
+// pixel of the previous frame that saw pos, false when it is off screen or disoccluded
+bool reproject(vec3 pos, vec3 normal, uint read_layer, out ivec2 prev_pixel)
+{
+	prev_pixel = ivec2(0);
+	const vec4 clip = ubo.prev_view_proj * vec4(pos, 1.0);
+	if (clip.w <= 0.0) {
+		return false;
+	}
+	// inverse of the pixel to ray mapping of the raygen, at the render size of the previous frame
+	const ivec2 dims = ivec2(ubo.prev_render_size);
+	const vec2 uv = (clip.xy / clip.w) * 0.5 + 0.5;
+	prev_pixel = ivec2(floor(uv * vec2(dims)));
+	if (any(lessThan(prev_pixel, ivec2(0))) || any(greaterThanEqual(prev_pixel, ivec2(dims)))) {
+		return false;
+	}
+
+	const vec4 prev = imageLoad(surfaces, ivec3(prev_pixel, read_layer));
+	const float dist = length(pos - ubo.prev_camera_pos.xyz);
+	return prev.w > 0.0
+		&& abs(prev.w - dist) < reprojection_depth_tolerance * dist
+		&& dot(prev.xyz, normal) > reprojection_normal_tolerance;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#version 460
+
+#include "common.glsl"
+
+// the layer the last launch wrote is the current frame
+layout(set = 0, binding = 0, rgba32f) uniform readonly image2DArray accumulation;
+// output of atrous.comp, the last iteration wrote it
+layout(set = 0, binding = 2, rgba32f) uniform readonly image2DArray denoised;
+
+layout(set = 0, binding = 1, std140) uniform SceneUniformsBlock 
+{
+	SceneUniforms ubo;
+};
+
+layout(location = 0) out vec4 out_color;
+
+// ACES filmic curve fit by Krzysztof Narkowicz
+vec3 tonemap_aces(vec3 x)
+{
+	const float a = 2.51;
+	const float b = 0.03;
+	const float c = 2.43;
+	const float d = 0.59;
+	const float e = 0.14;
+	return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0, 1.0);
+}
+
+vec3 linear_to_srgb(vec3 c)
+{
+	return mix(12.92 * c, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, greaterThan(c, vec3(0.0031308)));
+}
+
+vec3 load_radiance(ivec2 p)
+{
+	if (ubo.denoise_iterations > 0) {
+		return imageLoad(denoised, ivec3(p, (ubo.denoise_iterations - 1) & 1)).rgb;
+	}
+	return imageLoad(accumulation, ivec3(p, ubo.accumulation_layer)).rgb;
+}
+
+// bilinear upscale of the traced part of the image to the swapchain, 1:1 at full render size
+vec3 upscale(vec2 frag_coord)
+{
+	const vec2 scale = vec2(ubo.render_size) / vec2(imageSize(accumulation).xy);
+	const vec2 pos = frag_coord * scale - 0.5;
+	const ivec2 p = ivec2(floor(pos));
+	const vec2 f = pos - vec2(p);
+	const ivec2 last = ivec2(ubo.render_size) - 1;
+	const vec3 c00 = load_radiance(clamp(p, ivec2(0), last));
+	const vec3 c10 = load_radiance(clamp(p + ivec2(1, 0), ivec2(0), last));
+	const vec3 c01 = load_radiance(clamp(p + ivec2(0, 1), ivec2(0), last));
+	const vec3 c11 = load_radiance(clamp(p + ivec2(1, 1), ivec2(0), last));
+	return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);
+}
+
+void main()
+{
+	const vec3 radiance = upscale(gl_FragCoord.xy);
+	const vec3 exposed = radiance * exp2(ubo.exposure);
+	// the swapchain is unorm, so we encode to srgb here
+	out_color = vec4(linear_to_srgb(tonemap_aces(exposed)), 1.0);
+}
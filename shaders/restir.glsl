@@ -0,0 +1,166 @@
+#ifndef RESTIR_H_GLSL
+#define RESTIR_H_GLSL
+
+// resampled direct light of the primary hits, see Bitterli et al. 
+// "Spatiotemporal reservoir resampling for real-time ray tracing with dynamic direct lighting".
+// the samples are points on the light spheres, so the target function is 
+// in area measure and a sample can be moved to another surface without a jacobian.
+// include after lights.glsl
+
+struct LightReservoir
+{
+	vec3 light_point;
+	uint light_index;
+	float weight; // W, unbiased contribution weight of the sample
+	float sample_count; // M
+	float depth; // primary hit distance, to reject reservoirs of other surfaces
+	uint normal; // packed primary hit normal
+};
+
+// two reservoirs per pixel, the previous launch is read and the current one written
+layout(set = 0, binding = 8, scalar) buffer LightReservoirs
+{
+	LightReservoir reservoirs[];
+};
+
+// light candidates per sample
+const uint restir_candidates = 8u;
+// neighbours merged per sample
+const uint restir_spatial_samples = 3u;
+const float restir_spatial_radius = 10.0;
+// limits the influence of old samples, in multiples of the candidate count
+const float restir_history_cap = 20.0;
+
+struct RestirSurface
+{
+	vec3 pos;
+	vec3 normal;
+	vec3 albedo;
+	float depth;
+};
+
+LightReservoir empty_reservoir()
+{
+	LightReservoir r;
+	r.light_point = vec3(0.0);
+	r.light_index = 0u;
+	r.weight = 0.0;
+	r.sample_count = 0.0;
+	r.depth = -1.0;
+	r.normal = 0u;
+	return r;
+}
+
+// unshadowed light reaching the eye through the surface, in area measure
+float restir_target(RestirSurface s, uint light_index, vec3 light_point)
+{
+	const LightSphere light = lights[light_index];
+	const vec3 to_light = light_point - s.pos;
+	const float dist2 = dot(to_light, to_light);
+	const vec3 dir = to_light * inversesqrt(dist2);
+	const float cos_x = dot(s.normal, dir);
+	const float cos_y = dot(normalize(light.center - light_point), dir);
+	if (cos_x <= 0.0 || cos_y <= 0.0) return 0.0;
+	return luminance(light.emission * s.albedo / PI) * cos_x * cos_y / dist2;
+}
+
+// streaming resampling, the wsum of the reservoir is kept separately while building it
+bool reservoir_update(inout LightReservoir r, inout float wsum, uint light_index, vec3 light_point, float w, float count, inout uint seed)
+{
+	wsum += w;
+	r.sample_count += count;
+	if (w > 0.0 && random_float(seed) * wsum <= w) {
+		r.light_index = light_index;
+		r.light_point = light_point;
+		return true;
+	}
+	return false;
+}
+
+bool reservoir_matches(RestirSurface s, LightReservoir r)
+{
+	if (r.sample_count <= 0.0 || r.depth <= 0.0) return false;
+	const vec3 n = unpackSnorm4x8(r.normal).xyz;
+	return dot(n, s.normal) > 0.9 && abs(r.depth - s.depth) < 0.1 * s.depth;
+}
+
+// merges a reservoir that was built for another sample or pixel
+void reservoir_merge(inout LightReservoir r, inout float wsum, RestirSurface s, LightReservoir other, inout uint seed)
+{
+	const float count = min(other.sample_count, restir_history_cap * float(restir_candidates));
+	const float p = restir_target(s, other.light_index, other.light_point);
+	reservoir_update(r, wsum, other.light_index, other.light_point, p * other.weight * count, count, seed);
+}
+
+// picks one light sample for the surface from fresh candidates, the history of the pixel and 
+// the neighbours of the previous launch, and returns its light with a single shadow ray.
+// history is replaced by the new reservoir
+vec3 restir_direct_light(inout uint seed, RestirSurface s, inout LightReservoir history, uvec2 pixel, uvec2 dims, int read_base, bool reuse)
+{
+	LightReservoir r = empty_reservoir();
+	float wsum = 0.0;
+
+	for (uint i = 0u; i < restir_candidates; ++i) {
+		uint light_index;
+		vec3 dir;
+		float dist;
+		vec3 emission;
+		float pdf;
+		if (!sample_light(seed, s.pos, light_index, dir, dist, emission, pdf)) {
+			r.sample_count += 1.0;
+			continue;
+		}
+		const vec3 light_point = s.pos + dist * dir;
+		// solid angle to area pdf
+		const float cos_y = abs(dot(normalize(lights[light_index].center - light_point), dir));
+		const float area_pdf = pdf * cos_y / (dist * dist);
+		const float p = restir_target(s, light_index, light_point);
+		reservoir_update(r, wsum, light_index, light_point, area_pdf > 0.0 ? p / area_pdf : 0.0, 1.0, seed);
+	}
+
+	// temporal, the history is the reservoir of the same pixel. it is empty on the launches that
+	// reproject the accumulation, where the pixel may show another surface
+	if (reservoir_matches(s, history)) {
+		reservoir_merge(r, wsum, s, history, seed);
+	}
+
+	// spatial, from the reservoirs the neighbours wrote in the previous launch
+	if (reuse) {
+		for (uint i = 0u; i < restir_spatial_samples; ++i) {
+			const vec2 offset = (vec2(random_float(seed), random_float(seed)) * 2.0 - 1.0) * restir_spatial_radius;
+			const ivec2 q = clamp(ivec2(pixel) + ivec2(offset), ivec2(0), ivec2(dims) - 1);
+			if (q == ivec2(pixel)) continue;
+			const LightReservoir n = reservoirs[read_base + q.y * int(dims.x) + q.x];
+			if (reservoir_matches(s, n)) {
+				reservoir_merge(r, wsum, s, n, seed);
+			}
+		}
+	}
+
+	const float p = r.sample_count > 0.0 ? restir_target(s, r.light_index, r.light_point) : 0.0;
+	r.weight = p > 0.0 ? wsum / (r.sample_count * p) : 0.0;
+
+	// one shadow ray for the chosen sample
+	vec3 radiance = vec3(0.0);
+	if (r.weight > 0.0) {
+		const vec3 to_light = r.light_point - s.pos;
+		const float dist = length(to_light);
+		const vec3 dir = to_light / dist;
+		if (light_visible(s.pos, dir, dist)) {
+			const LightSphere light = lights[r.light_index];
+			const float cos_x = dot(s.normal, dir);
+			const float cos_y = dot(normalize(light.center - r.light_point), -dir);
+			radiance = light.emission * (s.albedo / PI) * cos_x * max(cos_y, 0.0) / (dist * dist) * r.weight;
+		} else {
+			// occluded samples are not worth reusing
+			r.weight = 0.0;
+		}
+	}
+
+	r.depth = s.depth;
+	r.normal = packSnorm4x8(vec4(s.normal, 0.0));
+	history = r;
+	return radiance;
+}
+
+#endif //RESTIR_H_GLSL
@@ -0,0 +1,58 @@
+#ifndef SCATTER_H_GLSL
+#define SCATTER_H_GLSL
+
+// bounce directions of the materials, shared by the closest hit shaders and the wavefront shade pass.
+// include after random.glsl. Code for materials is based on:
+// https://raytracing.github.io/books/RayTracingInOneWeekend.html
+
+float reflectance(float cosine, float ref_idx)
+{
+	// Use Schlick's approximation for reflectance.
+	float r0 = (1.0-ref_idx) / (1.0+ref_idx);
+	r0 = r0*r0;
+	return r0 + (1.0-r0)*pow((1-cosine), 5.0);
+}
+
+// glass, front_face says if the ray enters the surface
+vec3 scatter_dielectric(inout uint seed, vec3 dir, vec3 normal, bool front_face, float ior)
+{
+	const float ratio = front_face ? (1.0 / ior) : ior;
+	const float cos_theta = min(dot(-dir, normal), 1.0);
+	const float sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+	const bool cannot_refract = ratio * sin_theta > 1.0;
+	if (cannot_refract || reflectance(cos_theta, ratio) > random_float(seed)) {
+		return reflect(dir, normal);
+	}
+	return refract(dir, normal, ratio);
+}
+
+// fuzzy mirror, false when the fuzz pushed the direction below the surface
+bool scatter_metal(inout uint seed, vec3 dir, vec3 normal, float fuzz, out vec3 scatter_dir)
+{
+	vec3 reflected = reflect(dir, normal);
+	scatter_dir = reflected + fuzz*random_in_unit_sphere(seed);
+	return dot(scatter_dir, normal) > 0.0;
+}
+
+// bounce at a triangle mesh surface, true for the lambertian materials whose hits can sample the lights.
+// the emission and the light pdf of the payload are left to the caller
+bool scatter_material(inout HitPayload payload, vec3 dir, vec3 normal, PBRMaterial material, bool front_face)
+{
+	payload.scatters = true;
+	payload.scatter_color = material.albedo.rgb;
+	payload.nee_pdf = 0.0;
+	if (material.albedo.a < 1.0) {
+		payload.ray_dir = scatter_dielectric(payload.seed, dir, normal, front_face, material.ior);
+		payload.scatter_color = vec3(1.0);
+		return false;
+	}
+	if (material.metallic > 0.3) {
+		payload.scatters = scatter_metal(payload.seed, dir, normal, material.roughness, payload.ray_dir);
+		return false;
+	}
+	payload.ray_dir = random_cosine_direction(payload.seed, normal);
+	payload.nee_pdf = dot(payload.ray_dir, normal) / PI;
+	return true;
+}
+
+#endif //SCATTER_H_GLSL
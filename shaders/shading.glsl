@@ -0,0 +1,67 @@
+#ifndef SHADING_H_GLSL
+#define SHADING_H_GLSL
+
+// the work of the hit and miss shaders for the compute integrators, which find their hits
+// with ray queries. the light sample of a diffuse hit is left to the caller.
+// include after geometry.glsl, lights.glsl, scatter.glsl and wf_trace.glsl
+
+// simple.rmiss
+void shade_miss(inout HitPayload payload, uvec2 pixel)
+{
+	float t = float(pixel.y) / float(ubo.render_size.y);
+	float darken = 0.9;
+
+	payload.scatters = false;
+	payload.scatter_color = vec3(0.0);
+	payload.emits = true;
+	payload.emissive_color = darken * mix(vec3(1.0, 1.0, 1.0), vec3(0.5, 0.7, 1.0), t);
+	payload.nee_pdf = 0.0;
+	payload.light_pdf = 0.0;
+	payload.hit_normal = vec3(0.0);
+}
+
+// simple.rchit without the light sample
+void shade_triangle(inout HitPayload payload, vec3 dir, uint primitive, uint geometry, vec2 bary, bool front_face)
+{
+	const GeometryInfo geom = geometries[geometry];
+	const vec3 hit_normal = fetch_normal(geom, primitive, bary);
+	const PBRMaterial material = materials[geom.material_index];
+
+	scatter_material(payload, dir, hit_normal, material, front_face);
+	payload.emits = false;
+	payload.emissive_color = vec3(0.0);
+	payload.light_pdf = 0.0;
+	payload.hit_normal = hit_normal;
+}
+
+// sphere.rchit without the light sample
+void shade_sphere(inout HitPayload payload, vec3 origin, vec3 dir, float t, uint primitive)
+{
+	const SphereShading sph = sphere_shading[primitive];
+	const vec3 center = sphere_geometry[primitive].xyz;
+	const float radius = sphere_geometry[primitive].w;
+	const vec3 hit_normal = normalize(origin + t * dir - center);
+
+	payload.scatters = true;
+	payload.scatter_color = sph.albedo.rgb;
+	payload.emits = false;
+	payload.emissive_color = vec3(0.0);
+	payload.nee_pdf = 0.0;
+	payload.light_pdf = 0.0;
+	if (sph.material == 1) {
+		payload.scatters = scatter_metal(payload.seed, dir, hit_normal, sph.fuzz, payload.ray_dir);
+	} else if (sph.material == 2) {
+		payload.ray_dir = vec3(0.0);
+		payload.scatters = false;
+		payload.emits = true;
+		payload.emissive_color = sph.albedo.rgb;
+		// the ray origin is the previous path vertex, which may have sampled this light
+		payload.light_pdf = light_pdf(origin, center, radius, sph.albedo.rgb);
+	} else {
+		payload.ray_dir = random_cosine_direction(payload.seed, hit_normal);
+		payload.nee_pdf = dot(payload.ray_dir, hit_normal) / PI;
+	}
+	payload.hit_normal = hit_normal;
+}
+
+#endif //SHADING_H_GLSL
@@ -0,0 +1,28 @@
+#ifndef SPHERE_INTERSECTION_H_GLSL
+#define SPHERE_INTERSECTION_H_GLSL
+
+// ray sphere intersection of the procedural spheres, used by the intersection shader
+// and by the ray queries of the wavefront passes. the spheres are given as a vec4 of
+// center and radius, see create_sphere_buffer(). include after common.glsl
+
+// this method is documented in raytracing gems book
+vec2 gems_intersections(vec3 orig, vec3 dir, vec3 center, float radius)
+{
+	vec3 f = orig - center;
+	float a = dot(dir, dir);
+	float bi = dot(-f, dir);
+	float c = dot(f, f) - radius * radius;
+	vec3 s = f + (bi/a)*dir;
+	float discr = radius * radius - dot(s, s);
+
+	vec2 t = vec2(-1.0, -1.0);
+	if (discr >= 0) {
+		float q = bi + sign(bi) * sqrt(a*discr);
+		float t1 = c / q;
+		float t2 = q / a;
+		t = vec2(t1, t2);
+	}
+	return t;
+}
+
+#endif //SPHERE_INTERSECTION_H_GLSL
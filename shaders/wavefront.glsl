@@ -0,0 +1,96 @@
+#ifndef WAVEFRONT_H_GLSL
+#define WAVEFRONT_H_GLSL
+
+// state of the wavefront integrator, the passes wf_*.comp trace one path per pixel and launch.
+// a path is identified by its pixel index in the render size. its fields are stored as separate
+// arrays (structure of arrays), so a pass only loads the fields it uses and neighbouring threads
+// load neighbouring words. the queues hold the ids of the live paths, a bounce appends the paths
+// that continue to the other queue, which keeps the dispatches of the later bounces dense.
+// include after the scene uniforms and before random.glsl, it sets the pixel the samplers decorrelate on
+
+// uvec4 fields, floats are stored as their bits
+const uint WF_RAY_ORIGIN = 0u; // xyz, w pdf of the direction when the vertex could sample the lights
+const uint WF_RAY_DIR = 1u; // xyz, w sampler state
+const uint WF_THROUGHPUT = 2u; // rgb
+const uint WF_RADIANCE = 3u; // rgb, a 1 when the pixel traces this launch
+const uint WF_HIT = 4u; // t, half barycentrics, primitive, kind | front face << 2 | geometry << 3
+const uint WF_SHADOW_RAY = 5u; // xyz direction from the ray origin, w distance to the light
+const uint WF_SHADOW_LIGHT = 6u; // rgb added to the radiance when the shadow ray is unoccluded
+const uint WF_PRIMARY = 7u; // xyz primary hit, w 1 when it is diffuse
+const uint WF_FIELDS = 8u;
+
+const uint WF_GROUP_SIZE = 64u;
+
+layout(set = 0, binding = 14, std430) buffer WavefrontState
+{
+	uvec4 wf_state[];
+};
+
+layout(set = 0, binding = 15, std430) buffer WavefrontQueues
+{
+	uint path_count[2]; // the bounces alternate between the two path queues
+	uint shadow_count;
+	uint pad0;
+	uint path_args[3]; // indirect dispatch of the passes of a bounce, written by wf_args.comp
+	uint pad1;
+	uint sort_args[3]; // indirect dispatch of the hit sort, see wf_sort.glsl
+	uint pad2;
+	uint queues[]; // two path queues and the shadow queue
+} wf;
+
+layout(push_constant) uniform PushConstants
+{
+	uint dispatch_index;
+	uint bounce;
+	uint sort_pass;
+	uint depth; // bounces the host recorded
+} pc;
+
+// pixel of the path the invocation works on
+uvec2 wf_pixel;
+#define SAMPLER_PIXEL wf_pixel
+
+// paths the buffers have room for, the pixels of the rt images
+uint wf_capacity()
+{
+	return uint(wf_state.length()) / WF_FIELDS;
+}
+
+uvec4 wf_load(uint field, uint path)
+{
+	return wf_state[field * wf_capacity() + path];
+}
+
+vec4 wf_loadf(uint field, uint path)
+{
+	return uintBitsToFloat(wf_state[field * wf_capacity() + path]);
+}
+
+void wf_store(uint field, uint path, uvec4 v)
+{
+	wf_state[field * wf_capacity() + path] = v;
+}
+
+void wf_storef(uint field, uint path, vec4 v)
+{
+	wf_state[field * wf_capacity() + path] = floatBitsToUint(v);
+}
+
+// queue 0 and 1 are the path queues, 2 the shadow rays of the bounce
+uint wf_queue_load(uint queue, uint i)
+{
+	return wf.queues[queue * wf_capacity() + i];
+}
+
+void wf_queue_push(uint queue, uint path)
+{
+	const uint i = queue == 2u ? atomicAdd(wf.shadow_count, 1u) : atomicAdd(wf.path_count[queue], 1u);
+	wf.queues[queue * wf_capacity() + i] = path;
+}
+
+uvec2 wf_path_pixel(uint path)
+{
+	return uvec2(path % ubo.render_size.x, path / ubo.render_size.x);
+}
+
+#endif //WAVEFRONT_H_GLSL
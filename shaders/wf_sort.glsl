@@ -0,0 +1,87 @@
+#ifndef WF_SORT_H_GLSL
+#define WF_SORT_H_GLSL
+
+// radix sort of the path queue of a bounce by the material of the hits, between wf_extend.comp
+// and wf_shade.comp. the extend pass writes a key per queue entry, every pass sorts one digit
+// of the keys from the lowest up: wf_sort_histogram.comp counts the digits of each block of
+// keys, wf_sort_scan.comp turns the counts into offsets and wf_sort_scatter.comp moves the
+// keys and the paths to them. src/radix_sort.cpp is a cpu reference, tests/test_wf_sort_shaders.cpp
+// compares the buffers of every kernel with it.
+// include after wavefront.glsl
+
+const uint WF_SORT_RADIX_BITS = 4u;
+const uint WF_SORT_RADIX = 1u << WF_SORT_RADIX_BITS;
+const uint WF_SORT_BLOCK_SIZE = 256u; // keys per workgroup of the histogram and the scatter
+// smaller queues are shaded unsorted, their few subgroups do not pay for the sort passes.
+// wf_args.comp gives the passes no workgroups then
+const uint WF_SORT_MIN_PATHS = 64u * WF_SORT_BLOCK_SIZE;
+
+// the shading branch is the high part of a key, the material the low part
+const uint WF_SORT_MATERIAL_BITS = 5u;
+const uint WF_BRANCH_MISS = 0u;
+const uint WF_BRANCH_TRIANGLE_LAMBERT = 1u;
+const uint WF_BRANCH_TRIANGLE_METAL = 2u;
+const uint WF_BRANCH_TRIANGLE_GLASS = 3u;
+const uint WF_BRANCH_SPHERE_LAMBERT = 4u;
+const uint WF_BRANCH_SPHERE_METAL = 5u;
+const uint WF_BRANCH_SPHERE_EMITTER = 6u;
+const uint WF_BRANCH_COUNT = 7u;
+
+// two key arrays, the values of odd passes and the histograms. the values of even passes are the queue
+layout(set = 0, binding = 16, std430) buffer WavefrontSort
+{
+	uint sort_data[];
+};
+
+uint wf_sort_key(uint branch, uint material)
+{
+	return (branch << WF_SORT_MATERIAL_BITS) | (material & ((1u << WF_SORT_MATERIAL_BITS) - 1u));
+}
+
+uint wf_sort_branch(uint key)
+{
+	return key >> WF_SORT_MATERIAL_BITS;
+}
+
+uint wf_sort_digit(uint key, uint pass)
+{
+	return (key >> (pass * WF_SORT_RADIX_BITS)) & (WF_SORT_RADIX - 1u);
+}
+
+uint wf_sort_blocks(uint count)
+{
+	return (count + WF_SORT_BLOCK_SIZE - 1u) / WF_SORT_BLOCK_SIZE;
+}
+
+// buffer 0 holds the keys the extend pass wrote and, after the sort, the sorted keys
+uint wf_sort_load_key(uint buf, uint i)
+{
+	return sort_data[buf * wf_capacity() + i];
+}
+
+void wf_sort_store_key(uint buf, uint i, uint key)
+{
+	sort_data[buf * wf_capacity() + i] = key;
+}
+
+uint wf_sort_load_value(uint buf, uint queue, uint i)
+{
+	return buf == 0u ? wf_queue_load(queue, i) : sort_data[2u * wf_capacity() + i];
+}
+
+void wf_sort_store_value(uint buf, uint queue, uint i, uint path)
+{
+	if (buf == 0u) {
+		wf.queues[queue * wf_capacity() + i] = path;
+	} else {
+		sort_data[2u * wf_capacity() + i] = path;
+	}
+}
+
+// digit major, so the scan of all counts gives the offsets
+uint wf_sort_histogram_index(uint digit, uint block, uint blocks)
+{
+	return 3u * wf_capacity() + digit * blocks + block;
+}
+
+#endif //WF_SORT_H_GLSL
@@ -0,0 +1,75 @@
+#ifndef WF_TRACE_H_GLSL
+#define WF_TRACE_H_GLSL
+
+// ray queries of the compute integrators. they run no intersection shaders, so the
+// candidates of the sphere instance are intersected here like sphere.rint does.
+// include after common.glsl, the scene uniforms and the frame_stats block up to sphere_tests, needs GL_EXT_ray_query
+
+#include "sphere_intersection.glsl"
+
+// kinds of hits
+const uint WF_HIT_MISS = 0u;
+const uint WF_HIT_TRIANGLE = 1u;
+const uint WF_HIT_SPHERE = 2u;
+
+layout(set = 0, binding = 0) uniform accelerationStructureEXT scene;
+
+// xyz center, w radius, the candidates only read these
+layout(set = 0, binding = 13, std430) readonly buffer SphereGeometryTable
+{
+	vec4 sphere_geometry[];
+};
+
+layout(set = 0, binding = 20, std430) readonly buffer SphereShadingTable
+{
+	SphereShading sphere_shading[];
+};
+
+// kind of the closest hit, WF_HIT_*. the other outputs are set for triangle hits, t and primitive for sphere hits too.
+// mask is the instance cull mask, ubo.shadow_mask for the shadow rays
+uint wf_trace(uint flags, uint mask, vec3 origin, vec3 dir, float t_min, float t_max,
+	out float t, out vec2 bary, out uint primitive, out uint geometry, out bool front_face)
+{
+	rayQueryEXT rq;
+	rayQueryInitializeEXT(rq, scene, flags, mask, origin, t_min, dir, t_max);
+	while (rayQueryProceedEXT(rq)) {
+		if (rayQueryGetIntersectionTypeEXT(rq, false) != gl_RayQueryCandidateIntersectionAABBEXT) {
+			continue;
+		}
+		// the opaque triangles are committed during the traversal
+		const bool committed = rayQueryGetIntersectionTypeEXT(rq, true) != gl_RayQueryCommittedIntersectionNoneEXT;
+		const float t_closest = committed ? rayQueryGetIntersectionTEXT(rq, true) : t_max;
+		if (ubo.sphere_stats != 0) {
+			atomicAdd(frame_stats.sphere_tests, 1);
+		}
+		const vec4 sph = sphere_geometry[rayQueryGetIntersectionPrimitiveIndexEXT(rq, false)];
+		// the near root, or the far one when the ray starts inside the sphere
+		const vec2 roots = gems_intersections(origin, dir, sph.xyz, sph.w);
+		const float t_hit = roots.x >= t_min ? roots.x : roots.y;
+		if (t_hit >= t_min && t_hit <= t_closest) {
+			rayQueryGenerateIntersectionEXT(rq, t_hit);
+		}
+	}
+
+	t = t_max;
+	bary = vec2(0.0);
+	primitive = 0u;
+	geometry = 0u;
+	front_face = true;
+	const uint type = rayQueryGetIntersectionTypeEXT(rq, true);
+	if (type == gl_RayQueryCommittedIntersectionNoneEXT) {
+		return WF_HIT_MISS;
+	}
+	t = rayQueryGetIntersectionTEXT(rq, true);
+	primitive = rayQueryGetIntersectionPrimitiveIndexEXT(rq, true);
+	if (type == gl_RayQueryCommittedIntersectionGeneratedEXT) {
+		return WF_HIT_SPHERE;
+	}
+	// the instance custom index is the first entry of the instance in the geometry table
+	geometry = rayQueryGetIntersectionInstanceCustomIndexEXT(rq, true) + rayQueryGetIntersectionGeometryIndexEXT(rq, true);
+	bary = rayQueryGetIntersectionBarycentricsEXT(rq, true);
+	front_face = rayQueryGetIntersectionFrontFaceEXT(rq, true);
+	return WF_HIT_TRIANGLE;
+}
+
+#endif //WF_TRACE_H_GLSL
@@ -0,0 +1,100 @@
+#include "atrous_filter.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+namespace atrous_filter
+{
+
+// the constants of atrous.comp
+static const float SIGMA_NORMAL = 128.0f;
+static const float SIGMA_DEPTH = 0.01f;
+static const float SIGMA_LUMINANCE = 4.0f;
+static const float KERNEL[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+static float luminance(const glm::vec3 &c)
+{
+	return glm::dot(c, glm::vec3(0.2125f, 0.7154f, 0.0721f));
+}
+
+static glm::vec3 demodulation(const Input &in, size_t p)
+{
+	return glm::max(in.albedo[p], glm::vec3(0.01f));
+}
+
+std::vector<glm::vec3> filter(const Input &in, uint32_t iterations)
+{
+	const size_t count = size_t(in.width) * in.height;
+	if (in.accumulation.size() != count || in.moments.size() != count ||
+		in.surfaces.size() != count || in.albedo.size() != count) {
+		throw std::runtime_error("atrous filter inputs do not match the image size");
+	}
+
+	std::vector<glm::vec3> out(count);
+	if (iterations == 0) {
+		for (size_t p = 0; p < count; ++p) out[p] = glm::vec3(in.accumulation[p]);
+		return out;
+	}
+
+	// demodulated radiance and variance of the mean luminance
+	std::vector<glm::vec4> src(count);
+	for (size_t p = 0; p < count; ++p) {
+		const glm::vec4 &accum = in.accumulation[p];
+		const float mean = luminance(glm::vec3(accum));
+		const float variance = std::max(in.moments[p] - mean * mean, 0.0f) / std::max(accum.a, 1.0f);
+		const glm::vec3 a = demodulation(in, p);
+		const float la = luminance(a);
+		src[p] = glm::vec4(glm::vec3(accum) / a, variance / (la * la));
+	}
+
+	std::vector<glm::vec4> dst(count);
+	for (uint32_t it = 0; it < iterations; ++it) {
+		const int step = 1 << it;
+		for (int y = 0; y < int(in.height); ++y) {
+			for (int x = 0; x < int(in.width); ++x) {
+				const size_t p = size_t(y) * in.width + x;
+				const glm::vec4 &center = src[p];
+				const glm::vec4 &surface = in.surfaces[p];
+				dst[p] = center;
+				if (surface.w <= 0.0f) continue;
+
+				const float lum_center = luminance(glm::vec3(center));
+				const float lum_scale = SIGMA_LUMINANCE * std::sqrt(center.a) + 1e-4f;
+				glm::vec3 sum(0.0f);
+				float variance_sum = 0.0f;
+				float weight_sum = 0.0f;
+				for (int dy = -2; dy <= 2; ++dy) {
+					for (int dx = -2; dx <= 2; ++dx) {
+						const int qx = x + dx * step;
+						const int qy = y + dy * step;
+						if (qx < 0 || qy < 0 || qx >= int(in.width) || qy >= int(in.height)) continue;
+						const size_t q = size_t(qy) * in.width + qx;
+						const glm::vec4 &sq = in.surfaces[q];
+						if (sq.w <= 0.0f) continue;
+
+						const glm::vec4 &c = src[q];
+						const float w_normal = std::pow(std::max(glm::dot(glm::vec3(surface), glm::vec3(sq)), 0.0f), SIGMA_NORMAL);
+						const float tap_distance = std::sqrt(float(dx * dx + dy * dy)) * float(step);
+						const float w_depth = std::exp(-std::abs(surface.w - sq.w) / (SIGMA_DEPTH * surface.w * tap_distance + 1e-4f));
+						const float w_lum = std::exp(-std::abs(lum_center - luminance(glm::vec3(c))) / lum_scale);
+						const float w = KERNEL[std::abs(dx)] * KERNEL[std::abs(dy)] * w_normal * w_depth * w_lum;
+						sum += w * glm::vec3(c);
+						variance_sum += w * w * c.a;
+						weight_sum += w;
+					}
+				}
+				dst[p] = glm::vec4(sum / weight_sum, variance_sum / (weight_sum * weight_sum));
+			}
+		}
+		std::swap(src, dst);
+	}
+
+	for (size_t p = 0; p < count; ++p) {
+		out[p] = glm::vec3(src[p]) * demodulation(in, p);
+	}
+	return out;
+}
+
+}
@@ -0,0 +1,28 @@
+#ifndef ATROUS_FILTER_H
+#define ATROUS_FILTER_H
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// cpu reference of shaders/atrous.comp, it makes no vulkan calls so the output of the
+// compute pass, read back from any device, can be compared with it pixel by pixel
+namespace atrous_filter
+{
+	// one layer of the images the raygen writes, row major
+	struct Input
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<glm::vec4> accumulation; // mean radiance, sample count
+		std::vector<float> moments; // mean squared luminance
+		std::vector<glm::vec4> surfaces; // normal, camera distance or negative for a miss
+		std::vector<glm::vec3> albedo;
+	};
+
+	// the filtered radiance after the given number of iterations, 0 returns the accumulation
+	std::vector<glm::vec3> filter(const Input &in, uint32_t iterations);
+}
+
+#endif
@@ -15,6 +15,10 @@
 #include <unordered_map>
 #include <random>
 #include <cassert>
+#include <future>
+#include <thread>
+#include <deque>
+#include <cmath>
 
 #include <volk.h>
 #include <shaderc/shaderc.hpp>
@@ -31,20 +35,86 @@
 
 #include "stb_image.h"
 #include "orbit_camera.h"
+#include "shader_watcher.h"
+#include "sbt_builder.h"
+#include "sampler_tables.h"
+#include "radix_sort.h"
+#include "radiance_cache.h"
+#include "scene_uniforms.h"
 #include "shader_dir.h"
 #include "materials.hpp"
 
 const int MAX_FRAMES_IN_FLIGHT = 3;
+// dispatches recorded per frame in throughput mode, while the camera does not move
+const uint32_t RT_THROUGHPUT_DISPATCHES = 4;
+const uint32_t RT_MAX_SAMPLES_PER_LAUNCH = 64;
+// linear radiance is accumulated in full float, the resolve pass tonemaps it to the swapchain
+// rgb is the mean radiance and a the number of samples of the pixel
+const VkFormat RT_ACCUMULATION_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+// mean of the squared luminance, for the per pixel variance
+const VkFormat RT_MOMENTS_FORMAT = VK_FORMAT_R32_SFLOAT;
+// normal and camera distance of the primary hit, the disocclusion test of the reprojection
+const VkFormat RT_SURFACE_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+// the accumulation images have one layer that the launch reads and one that it writes
+const uint32_t RT_HISTORY_LAYERS = 2;
+// albedo of the primary hit and the a-trous filter output, see atrous.comp
+const VkFormat RT_ALBEDO_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+const VkFormat RT_DENOISE_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+// ground plane of the scene, a square of two triangles just below the model and the spheres
+const float RT_GROUND_EXTENT = 1000.0f;
+const float RT_GROUND_HEIGHT = -0.01f;
+// rasterized primary visibility, see gbuffer.glsl
+const VkFormat RT_GBUFFER_FORMAT = VK_FORMAT_R32G32B32A32_UINT;
+// instance masks of the tlas, the rasterized primary visibility only traces the spheres and the ground in front of it
+// and the shadow rays leave out the model parts of the materials that do not cast shadows
+const uint32_t RT_INSTANCE_MASK_MODEL = 0x01;
+const uint32_t RT_INSTANCE_MASK_SPHERES = 0x02;
+const uint32_t RT_INSTANCE_MASK_MODEL_NO_SHADOWS = 0x04;
+const uint32_t RT_INSTANCE_MASK_GROUND = 0x08;
+const uint32_t RT_INSTANCE_MASK_ALL = 0xFF;
+// filter iterations recorded per frame, the ones above the uniform count return at once
+const uint32_t RT_DENOISE_ITERATIONS = 5;
+// while the camera moves the render resolution follows the frame time, 
+// it goes back to the swapchain extent once the camera stayed still this long
+const float RT_TARGET_FRAME_TIME = 1.0f / 60.0f;
+const float RT_MIN_RENDER_SCALE = 0.25f;
+const float RT_STATIC_DELAY = 0.25f;
+// the accumulation counts as converged when this fraction of the pixels is left
+const float RT_TARGET_ACTIVE_FRACTION = 0.001f;
+const uint32_t RT_ADAPTIVE_MIN_SAMPLES = 16;
+// cells of the radiance cache, a power of two
+const uint32_t RT_RADIANCE_CACHE_CELLS = 1u << 20;
+// side of the blue noise tile of the sampler
+const uint32_t RT_BLUE_NOISE_SIZE = 64;
+// path statistics are printed with this period
+const float RT_PATH_STATS_PERIOD = 1.0f;
+// bounces recorded per launch of the wavefront integrator, at most max_depth of integrator.glsl
+const uint32_t RT_WAVEFRONT_MAX_DEPTH = 32;
+const uint32_t RT_WAVEFRONT_MIN_DEPTH = 4;
+// uvec4 fields per path of the wavefront state and queues per path, see wavefront.glsl
+const uint32_t RT_WAVEFRONT_FIELDS = 8;
+const uint32_t RT_WAVEFRONT_QUEUES = 3;
+// radix sort of the wavefront hits by material, see wf_sort.glsl and src/radix_sort.h
+const uint32_t RT_SORT_RADIX = radix_sort::RADIX;
+const uint32_t RT_SORT_BLOCK_SIZE = radix_sort::BLOCK_SIZE;
+const uint32_t RT_SORT_PASSES = radix_sort::PASSES;
+// statistics periods the benchmark measures each integrator for, the first one is not counted
+const uint32_t RT_BENCHMARK_PERIODS = 4;
+// batch renders, the turntable views of the scene are traced together with the view as launch depth
+const uint32_t RT_BATCH_VIEWS = 8;
+const uint32_t RT_BATCH_WIDTH = 512;
+const uint32_t RT_BATCH_HEIGHT = 512;
+const uint32_t RT_BATCH_SAMPLES_PER_DISPATCH = 4;
+const uint32_t RT_BATCH_DISPATCHES = 64;
+// launches per mode of the shadow benchmark, traced at the batch size into the first batch layer
+const uint32_t RT_SHADOW_BENCHMARK_DISPATCHES = 32;
 #define ENABLE_VALIDATION_LAYERS
 //#define ENABLE_DEBUG_MARKERS
-
-struct ShaderGroupHandle
-{
-	uint64_t i0;
-	uint64_t i1;
-	uint64_t i2;
-	uint64_t i3;
-};
+// spheres per side of the grid, set by the SPHERE_GRID_SIZE cmake option. 1000 measures the sphere traversal
+#ifndef SPHERE_GRID_SIZE
+#define SPHERE_GRID_SIZE 20
+#endif
+static_assert(SPHERE_GRID_SIZE >= 2 && SPHERE_GRID_SIZE % 2 == 0, "the sphere grid is centered, its size is even");
 
 struct VmaBufferAllocation
 {
@@ -75,6 +145,70 @@ struct ASBuffers
 	}
 };
 
+// resources that may still be referenced by frames in flight, 
+// each deleter runs once the frame it was queued for has completed on the gpu
+struct DeletionQueue
+{
+	std::deque<std::pair<uint64_t, std::function<void()>>> deleters;
+
+	void push(uint64_t frame, std::function<void()> &&deleter)
+	{
+		deleters.emplace_back(frame, std::move(deleter));
+	}
+
+	void flush(uint64_t completed_frame)
+	{
+		while (!deleters.empty() && deleters.front().first <= completed_frame) {
+			deleters.front().second();
+			deleters.pop_front();
+		}
+	}
+
+	void flush_all()
+	{
+		flush(std::numeric_limits<uint64_t>::max());
+	}
+};
+
+// must cover PackedHitPayload/ShadowPayload in common.glsl and the sphere hit attribute
+const uint32_t RT_MAX_RAY_PAYLOAD_SIZE = 44;
+const uint32_t RT_MAX_HIT_ATTRIBUTE_SIZE = sizeof(glm::vec3);
+// the hit shaders trace shadow rays towards the lights
+const uint32_t RT_MAX_RECURSION_DEPTH = 2;
+
+struct RTShaderGroupDesc
+{
+	std::string name;
+	VkRayTracingShaderGroupTypeKHR type;
+	// indices to the stages of the library
+	uint32_t general;
+	uint32_t closest_hit;
+	uint32_t any_hit;
+	uint32_t intersection;
+};
+
+struct RTLibraryDesc
+{
+	std::string name;
+	std::vector<std::pair<std::string, shaderc_shader_kind>> stages;
+	std::vector<RTShaderGroupDesc> groups;
+};
+
+struct RTPipelineLibrary
+{
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	// stage sources and all their transitive includes
+	std::set<std::string> sources;
+};
+
+struct RTPipelineBuild
+{
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	std::vector<RTPipelineLibrary> libraries;
+	std::unordered_map<std::string, uint32_t> group_indices;
+	uint32_t group_count{ 0 };
+	uint32_t stack_size{ 0 }; // set with vkCmdSetRayTracingPipelineStackSizeKHR after binding the pipeline
+};
 
 struct QueueFamilyIndices
 {
@@ -171,65 +305,220 @@ struct SpherePrimitive
 	float fuzz;
 };
 
-static_assert(sizeof(SpherePrimitive) % 8 == 0 && "We have chosen SpherePrimitives to have an alignment of 8");
+// shading fields of a sphere, matches SphereShading in common.glsl. the intersection
+// reads only the center and radius, which are stored in their own vec4 stream
+struct SphereShading
+{
+	glm::vec4 albedo;
+	materials::MaterialType material; //int
+	float fuzz;
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+static_assert(sizeof(SphereShading) % 16 == 0 && "SphereShading is an std430 array element");
+
+// emissive sphere in the light list, matches LightSphere in lights.glsl
+struct LightSphere
+{
+	glm::vec3 center;
+	float radius;
+	glm::vec3 emission;
+	float cdf; // normalized power of this light and the ones before it
+};
+
+// start of the light table buffer, the lights follow
+struct LightTableHeader
+{
+	uint32_t light_count;
+	float total_power;
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+// direct light sample of a pixel kept between launches, matches LightReservoir in restir.glsl
+struct LightReservoir
+{
+	glm::vec3 light_point;
+	uint32_t light_index;
+	float weight;
+	float sample_count;
+	float depth;
+	uint32_t normal;
+};
+
+// lights are picked proportional to this, must match light_power() in lights.glsl
+static float light_power(const glm::vec3 &emission, float radius)
+{
+	const float luminance = glm::dot(emission, glm::vec3(0.2125f, 0.7154f, 0.0721f));
+	return luminance * radius * radius;
+}
+
+// samplers of random.glsl
+enum RTSampler : uint32_t
+{
+	RT_SAMPLER_RANDOM = 0,
+	RT_SAMPLER_SOBOL = 1,
+	RT_SAMPLER_BLUE_NOISE = 2,
+	RT_SAMPLER_COUNT
+};
+
+// start of the sampler tables buffer, the blue noise tile follows
+struct SamplerTablesHeader
+{
+	std::array<uint32_t, sampler_tables::SOBOL_DIMENSIONS * sampler_tables::SOBOL_BITS> sobol_matrices;
+	uint32_t blue_noise_size;
+	uint32_t pad0;
+	uint32_t pad1;
+	uint32_t pad2;
+};
+
+// written by the raygen shader, read back after the frame
+struct RTFrameStats
+{
+	uint32_t active_pixels; // pixels above the target error at the start of the frame
+	uint32_t paths; // samples traced in the frame
+	uint32_t path_segments; // rays traced by those samples
+	// invocations of the wavefront shade pass, and the lanes their subgroups spent
+	// counting one pass over the subgroup per shading branch it contains
+	uint32_t shade_lanes;
+	uint32_t shade_lane_slots;
+	// sphere intersection tests, the invocations of sphere.rint and the sphere candidates of the ray queries
+	uint32_t sphere_tests;
+	// bounces of the wavefront integrator that had live paths, and the paths
+	// still live after its last recorded bounce
+	uint32_t wavefront_bounces;
+	uint32_t wavefront_cut;
+	uint32_t shadow_rays; // rays traced by the shadow benchmark, see on_shadow_benchmark_started()
+	uint32_t pad0[3];
+};
+
+// push constants of the rt pipeline, set per vkCmdTraceRaysKHR
+struct RTPushConstants
+{
+	uint32_t dispatch_index; // index of the dispatch in the frame, offsets the sample index
+	uint32_t batch_samples; // samples per pixel of a batch dispatch, 0 when the dispatch traces the frame
+	uint32_t batch_samples_before; // samples already in the batch images
+	uint32_t shadow_benchmark; // RTShadowBenchmark, 0 when the dispatch renders
+};
+
+// push constants of the gbuffer pipeline, gbuffer.frag reads the geometry and gbuffer.vert the dispatch
+struct GBufferPushConstants
+{
+	uint32_t geometry; // geometry table entry of the drawn model part
+	uint32_t dispatch_index; // dispatch of the frame that traces from the surfaces
+};
+
+// launches of the shadow benchmark, see simple.rgen
+enum RTShadowBenchmark : uint32_t
+{
+	RT_SHADOW_BENCHMARK_OFF = 0,
+	RT_SHADOW_BENCHMARK_PRIMARY = 1, // only the primary rays, subtracted from the other two
+	RT_SHADOW_BENCHMARK_OCCLUSION = 2, // terminate on the first hit and skip the closest hit shader
+	RT_SHADOW_BENCHMARK_CLOSEST_HIT = 3,
+	RT_SHADOW_BENCHMARK_COUNT
+};
 
-struct SceneUniforms
+// camera of a batch view, the raygen of a batch reads the one of gl_LaunchIDEXT.z
+struct BatchView
 {
-	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 proj;
 	glm::mat4 iview;
 	glm::mat4 iproj;
-	glm::vec4 light_pos;
-	uint32_t samples_accum;
+};
+
+// launch sizes of the rt command buffers, written every frame so that
+// the render resolution changes without recording them again
+struct RTIndirectCommands
+{
+	VkTraceRaysIndirectCommandKHR trace;
+	VkDispatchIndirectCommand tiles; // 8x8 workgroups over the render size
+};
+
+// the rt pipeline traces every bounce of a path in one raygen invocation, the wavefront
+// integrator runs each bounce of all paths as separate compute passes, see wavefront.glsl.
+// the ray query integrator is the raygen as a compute kernel, see pathtrace.comp
+enum RTIntegrator : uint32_t
+{
+	RT_INTEGRATOR_MEGAKERNEL = 0,
+	RT_INTEGRATOR_WAVEFRONT = 1,
+	RT_INTEGRATOR_RAY_QUERY = 2,
+	RT_INTEGRATOR_COUNT
+};
+
+static const char *RT_INTEGRATOR_NAMES[RT_INTEGRATOR_COUNT] = { "megakernel", "wavefront", "ray query" };
+static const char *RT_SHADOW_BENCHMARK_NAMES[RT_SHADOW_BENCHMARK_COUNT] = { "", "primary", "occlusion query", "closest hit" };
+
+enum WavefrontPass : uint32_t
+{
+	WAVEFRONT_GENERATE = 0,
+	WAVEFRONT_ARGS,
+	WAVEFRONT_EXTEND,
+	WAVEFRONT_SHADE,
+	WAVEFRONT_SHADOW,
+	WAVEFRONT_ACCUMULATE,
+	WAVEFRONT_SORT_HISTOGRAM,
+	WAVEFRONT_SORT_SCAN,
+	WAVEFRONT_SORT_SCATTER,
+	WAVEFRONT_PASS_COUNT
+};
+
+// push constants of the compute integrators, pathtrace.comp only reads the dispatch index
+struct WavefrontPushConstants
+{
+	uint32_t dispatch_index;
+	uint32_t bounce;
+	uint32_t sort_pass; // digit of the radix sort passes
+	uint32_t depth; // bounces recorded, wf_args.comp counts the paths that would continue past them
+};
+
+// start of the wavefront queue buffer, the path ids of the queues follow
+struct WavefrontQueuesHeader
+{
+	uint32_t path_count[2];
+	uint32_t shadow_count;
 	uint32_t pad0;
+	VkDispatchIndirectCommand path_args; // written by wf_args.comp
 	uint32_t pad1;
+	VkDispatchIndirectCommand sort_args; // a workgroup per block of the hit sort
 	uint32_t pad2;
 };
 
+// push constants of the a-trous filter, set per dispatch
+struct DenoisePushConstants
+{
+	uint32_t iteration; // the taps are 2^iteration pixels apart
+};
+
 struct ModelPart
 {
     uint32_t vertex_offset;
     uint32_t vertex_count;
     uint32_t index_offset;
     uint32_t index_count;
-	materials::PBRMaterial pbr_material;
+	uint32_t material_index;
 };
 
-struct SBTRecordHitMesh
+// one entry per BLAS geometry, the closest hit shader finds its entry at 
+// gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT
+struct GeometryInfo
 {
-	ShaderGroupHandle shader;
 	VkDeviceAddress vertices_ref;
 	VkDeviceAddress indices_ref;
-	materials::PBRMaterial pbr_material;
+	uint32_t material_index;
+	uint32_t flags; // GeometryFlags
 };
 
-struct SBTRecordHitSphere
+enum GeometryFlags : uint32_t
 {
-	ShaderGroupHandle shader;
-	VkDeviceAddress spheres_ref;
+	GEOMETRY_WORLD_SPACE = 1, // the instance has no transform, the normals are not moved by the model matrix
 };
 
-constexpr size_t get_sbt_hit_record_size()
-{
-	const size_t sz = std::max({sizeof(SBTRecordHitMesh), sizeof(SBTRecordHitSphere), sizeof(ShaderGroupHandle)});
-	// round up to 64
-	return ((sz + 63) / 64) * 64;
-}
-
-constexpr size_t get_sbt_miss_record_size()
-{
-	const size_t sz = sizeof(ShaderGroupHandle);
-	// round up to 64
-	return ((sz + 63) / 64) * 64;
-}
-
-constexpr size_t get_sbt_raygen_record_size()
+// inline data of the sphere hit records, stored after the group handle
+struct SBTRecordHitSphere
 {
-	const size_t sz = sizeof(ShaderGroupHandle);
-	// round up to 64
-	return ((sz + 63) / 64) * 64;
-}
+	VkDeviceAddress geometry_ref; // center and radius
+	VkDeviceAddress shading_ref;
+};
 
 class BaseApplication
 {
@@ -239,7 +528,33 @@ public:
 	void run();
 	void on_window_resized() { m_window_resized = true; }
 	void on_accumulated_samples_reset() { m_samples_accumulated = 0; };
+	// the view changed since the last frame and there is history to reproject
+	bool camera_moved() const { return m_samples_accumulated > 0 && m_camera.get_view_matrix() != m_prev_view; }
+	bool render_resized() const { return m_samples_accumulated > 0 && (m_render_extent.width != m_prev_render_extent.width || m_render_extent.height != m_prev_render_extent.height); }
 	void on_toggle_raytracing() { m_raytraced = !m_raytraced; }
+	void on_toggle_clay_materials();
+	void on_toggle_throughput_mode();
+	void on_samples_per_launch_changed(bool increase);
+	void on_exposure_changed(float stops) { m_exposure += stops; }
+	void on_toggle_adaptive_sampling();
+	void on_toggle_russian_roulette();
+	void on_toggle_next_event_estimation();
+	void on_toggle_restir();
+	void on_radiance_cache_mode_changed();
+	void on_sampler_changed();
+	void on_toggle_denoiser();
+	void on_integrator_changed();
+	void on_benchmark_started();
+	void on_toggle_hit_sorting();
+	void on_toggle_raster_primary();
+	void on_batch_render_requested();
+	void on_toggle_transparent_shadows();
+	void on_toggle_sphere_stats();
+	void on_shadow_benchmark_started();
+	// the rt pipeline is compiled in the background, until then we fall back to raster
+	bool raytracing_active() const { return m_raytraced && rt_commands_ready(); }
+	// devices without the rt pipeline trace with the compute integrators from the start
+	bool rt_commands_ready() const { return m_rt_pipeline != VK_NULL_HANDLE || !m_rt_pipeline_supported; }
 	
 	OrbitCamera &camera() { return m_camera; }
 
@@ -257,8 +572,9 @@ private:
 	void destroy_debug_callback();
 
 	void pick_gpu();
-	bool check_device_extension_support(VkPhysicalDevice gpu) const;
+	bool check_device_extension_support(VkPhysicalDevice gpu, const std::vector<const char*> &extensions) const;
 	bool is_gpu_suitable(VkPhysicalDevice gpu) const;
+	bool is_rt_pipeline_supported(VkPhysicalDevice gpu) const;
 	QueueFamilyIndices find_queue_families(VkPhysicalDevice gpu) const;
 
 	void create_logical_device();
@@ -276,8 +592,14 @@ private:
 
 	void create_descriptor_set_layout();
 	void create_graphics_pipeline();
+	void create_gbuffer_pipeline();
+	void create_resolve_pipeline();
+	void create_denoise_pipeline();
+	VkPipeline create_rt_compute_pipeline(const char *name);
+	void create_wavefront_pipelines();
 
-	VkShaderModule create_shader_module(const std::string& file_name, shaderc_shader_kind shader_kind, const std::vector<char>& code) const;
+	VkShaderModule create_shader_module(const std::string& file_name, shaderc_shader_kind shader_kind, const std::vector<char>& code,
+		std::set<std::string> *includes = nullptr) const;
 
 	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags props) const;
 	
@@ -287,7 +609,7 @@ private:
 	
 	void create_image(uint32_t width, uint32_t height, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props,
-		VmaImageAllocation& img);
+		VmaImageAllocation& img, uint32_t layers = 1);
 	
 	VkCommandBuffer begin_single_time_commands(VkQueue queue, VkCommandPool cmd_pool);
 	void end_single_time_commands(VkQueue queue, VkCommandPool cmd_pool, VkCommandBuffer cmd_buffer);
@@ -297,23 +619,45 @@ private:
 
 	void load_model();
 	void create_spheres();
+	void create_ground();
 
 	void create_vertex_buffer();
 	void create_index_buffer();
 	void create_uniform_buffers();
+	void create_rt_stats_buffers();
+	void create_rt_indirect_buffers();
+	void update_render_extent(bool raytraced, bool moved);
+	void read_rt_stats(uint32_t img_idx);
 
 	void create_sphere_buffer();
-
-	void create_bottom_acceleration_structure();
+	void create_light_buffer();
+	void create_radiance_cache();
+	void create_batch_resources();
+	void create_sampler_tables();
+	void clear_radiance_cache();
+	bool pending_writes() const;
+	void record_pending_writes(VkCommandBuffer cmd_buf);
+	void create_geometry_buffers();
+	void update_material_buffer();
+
+	void create_bottom_acceleration_structure(const ModelPart *parts, uint32_t part_count, ASBuffers &as);
 	void create_bottom_acceleration_structure_spheres();
 	void create_top_acceleration_structure();
 	void create_raytracing_pipeline_layout();
-	void create_raytracing_pipeline();
+	RTPipelineLibrary create_raytracing_library(const RTLibraryDesc &desc);
+	// libraries without a pipeline handle are (re)compiled, the rest are only linked
+	RTPipelineBuild create_raytracing_pipeline(std::vector<RTPipelineLibrary> libraries);
+	void poll_raytracing_pipeline();
+	void swap_raytracing_pipeline(RTPipelineBuild &&build);
+	uint32_t get_rt_group_index(const std::string &name) const;
+	void bind_rt_pipeline(VkCommandBuffer cmd_buf, VkDescriptorSet desc_set);
 
 	void create_rt_image();
 	void create_descriptor_pool();
 	void create_descriptor_sets();
 	void create_rt_descriptor_sets();
+	void create_resolve_descriptor_sets();
+	void create_denoise_descriptor_sets();
 	void create_shader_binding_table();
 
 	VkFormat find_supported_format(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const;
@@ -322,10 +666,20 @@ private:
 	void create_command_pools();
 	void create_command_buffers();
 	void create_rt_command_buffers();
+	void record_rt_commands(VkCommandBuffer cmd_buf, uint32_t img_idx, uint32_t dispatch_count);
+	void record_wavefront_commands(VkCommandBuffer cmd_buf, uint32_t img_idx, uint32_t dispatch_count);
+	void record_gbuffer_commands(VkCommandBuffer cmd_buf, uint32_t img_idx, uint32_t dispatch_index);
+	void rerecord_rt_command_buffers();
+	void set_integrator(uint32_t integrator);
+	// samples per pixel of a launch, the wavefront integrator traces one path per pixel
+	uint32_t launch_samples() const { return m_integrator == RT_INTEGRATOR_WAVEFRONT ? 1 : m_samples_per_launch; }
+	// only the raygen of the megakernel reads the rasterized primary visibility
+	bool raster_primary_active() const { return m_raster_primary && m_integrator == RT_INTEGRATOR_MEGAKERNEL; }
+	uint32_t shadow_mask() const { return m_transparent_shadows ? RT_INSTANCE_MASK_ALL : RT_INSTANCE_MASK_ALL & ~RT_INSTANCE_MASK_MODEL_NO_SHADOWS; }
 	
 	void create_sync_objects();
 
-	void update_uniform_buffer(uint32_t idx);
+	void update_uniform_buffer(uint32_t idx, uint32_t samples_this_frame);
 	void draw_frame();
 
 	void cleanup_swapchain();
@@ -342,6 +696,8 @@ private:
 	bool m_enable_validation_layers;
 
 	std::vector<const char*> m_device_extensions;
+	std::vector<const char*> m_rt_pipeline_extensions;
+	bool m_rt_pipeline_supported{ false };
 	size_t m_current_frame_idx{ 0 };
 	bool m_window_resized{ false };
 
@@ -373,46 +729,157 @@ private:
 	VkDescriptorSetLayout m_descriptor_set_layout{ VK_NULL_HANDLE };
 	VkPipelineLayout m_pipeline_layout{ VK_NULL_HANDLE };
 	VkPipeline m_graphics_pipeline{ VK_NULL_HANDLE };
+
+	// draws the primary visibility of the model for the rt command buffers, uses the descriptor sets of the raster pipeline
+	VkPipelineLayout m_gbuffer_pipeline_layout{ VK_NULL_HANDLE };
+	VkPipeline m_gbuffer_pipeline{ VK_NULL_HANDLE };
+
+	VkDescriptorSetLayout m_resolve_descriptor_set_layout{ VK_NULL_HANDLE };
+	VkPipelineLayout m_resolve_pipeline_layout{ VK_NULL_HANDLE };
+	VkPipeline m_resolve_pipeline{ VK_NULL_HANDLE };
+
+	VkDescriptorSetLayout m_denoise_descriptor_set_layout{ VK_NULL_HANDLE };
+	VkPipelineLayout m_denoise_pipeline_layout{ VK_NULL_HANDLE };
+	VkPipeline m_denoise_pipeline{ VK_NULL_HANDLE };
+
+	// the compute integrators use the rt descriptor set, their pipelines are created the first time they are selected
+	VkPipelineLayout m_rt_compute_pipeline_layout{ VK_NULL_HANDLE };
+	std::array<VkPipeline, WAVEFRONT_PASS_COUNT> m_wavefront_pipelines{};
+	VkPipeline m_ray_query_pipeline{ VK_NULL_HANDLE };
+	VkPipeline m_radiance_cache_age_pipeline{ VK_NULL_HANDLE }; // with the rt pipeline, the only one that uses the cache
 	
 	VkDescriptorSetLayout m_rt_descriptor_set_layout{ VK_NULL_HANDLE };
 	VkPipelineLayout m_rt_pipeline_layout {VK_NULL_HANDLE};
 	VkPipeline m_rt_pipeline{ VK_NULL_HANDLE };
+	std::vector<RTPipelineLibrary> m_rt_libraries;
+	std::unordered_map<std::string, uint32_t> m_rt_group_indices;
+	uint32_t m_rt_group_count{ 0 };
+	uint32_t m_rt_stack_size{ 0 };
+	std::future<RTPipelineBuild> m_rt_pipeline_future;
+	ShaderWatcher m_shader_watcher;
 	
 	glm::mat4 m_model_tranformation;
 	std::vector<Vertex> m_model_vertices;
 	std::vector<uint32_t> m_model_indices;
     std::vector<ModelPart> m_model_parts;
+	uint32_t m_shadow_part_count{ 0 }; // the parts that cast shadows come first, the others follow
+	ModelPart m_ground_part; // in the model buffers after the model, its geometry table entry follows the parts
+	std::vector<materials::PBRMaterial> m_materials;
+	std::vector<bool> m_material_casts_shadows; // per material, the model parts go into the instance of their flag
+	bool m_clay_materials{ false };
 	
 	std::vector<SpherePrimitive> m_sphere_primitives;
 
 	VmaBufferAllocation m_vertex_buffer;
 	VmaBufferAllocation m_index_buffer;
-	VmaBufferAllocation m_sphere_buffer;
+	VmaBufferAllocation m_sphere_aabbs; // only read by the blas build
+	VmaBufferAllocation m_sphere_geometry; // vec4 center and radius, read by the intersection
+	VmaBufferAllocation m_sphere_shading;
+	VmaBufferAllocation m_light_buffer;
+	VmaBufferAllocation m_radiance_cache;
+	bool m_radiance_cache_clear_pending{ false }; // cleared in front of the next frame
+	VmaBufferAllocation m_sampler_tables;
+	VmaBufferAllocation m_geometry_buffer;
+	VmaBufferAllocation m_material_buffer;
+	std::vector<materials::PBRMaterial> m_pending_materials; // written in front of the next frame when not empty
 	
 	ASBuffers m_bottom_as_spheres;
 	ASBuffers m_bottom_as;
+	ASBuffers m_bottom_as_no_shadows; // the model parts whose material does not cast shadows, empty when there are none
+	ASBuffers m_bottom_as_ground;
 	ASBuffers m_top_as;
 	VmaImageAllocation m_rt_img;
 	VkImageView m_rt_img_view{ VK_NULL_HANDLE };
+	VmaImageAllocation m_rt_moments_img;
+	VkImageView m_rt_moments_img_view{ VK_NULL_HANDLE };
+	VmaImageAllocation m_rt_surface_img;
+	VkImageView m_rt_surface_img_view{ VK_NULL_HANDLE };
+	VmaImageAllocation m_rt_albedo_img;
+	VkImageView m_rt_albedo_img_view{ VK_NULL_HANDLE };
+	VmaImageAllocation m_rt_denoise_img;
+	VkImageView m_rt_denoise_img_view{ VK_NULL_HANDLE };
+	VmaImageAllocation m_rt_gbuffer_img;
+	VkImageView m_rt_gbuffer_img_view{ VK_NULL_HANDLE };
+	VmaImageAllocation m_batch_img; // mean radiance and sample count of every batch view, one layer each
+	VkImageView m_batch_img_view{ VK_NULL_HANDLE };
+	VmaBufferAllocation m_batch_views;
+	VmaBufferAllocation m_restir_reservoirs; // two reservoirs per pixel, read and written on alternate launches
+	VmaBufferAllocation m_wavefront_state; // path and hit state of the wavefront integrator
+	VmaBufferAllocation m_wavefront_queues;
+	VmaBufferAllocation m_wavefront_sort;
 	VmaBufferAllocation m_rt_sbt;
 	VkDeviceAddress m_rt_sbt_address;
+	std::optional<ShaderBindingTableBuilder> m_rt_sbt_layout;
 	
 	std::vector<VmaBufferAllocation> m_uni_buffers;
+	std::vector<VmaBufferAllocation> m_rt_stats_buffers;
+	std::vector<VmaBufferAllocation> m_rt_indirect_buffers;
+	std::vector<uint64_t> m_rt_stats_epoch; // accumulation the stats of each image belong to, 0 if none
+	std::vector<VkExtent2D> m_rt_stats_extent; // render extent of the frame the stats of each image come from
 
 	VkDescriptorPool m_desc_pool{ VK_NULL_HANDLE };
 	std::vector<VkDescriptorSet> m_desc_sets;
 	std::vector<VkDescriptorSet> m_rt_desc_sets;
+	std::vector<VkDescriptorSet> m_resolve_desc_sets;
+	std::vector<VkDescriptorSet> m_denoise_desc_sets;
 
 	VkCommandPool m_graphics_cmd_pool{ VK_NULL_HANDLE };
 	VkCommandPool m_transfer_cmd_pool{ VK_NULL_HANDLE };
 	std::vector<VkCommandBuffer> m_cmd_buffers;
 	std::vector<VkCommandBuffer> m_rt_cmd_buffers;
+	std::vector<VkCommandBuffer> m_rt_throughput_cmd_buffers;
 	
 	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> m_sem_img_available{ VK_NULL_HANDLE };
 	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> m_sem_render_finished{ VK_NULL_HANDLE };
 	std::array<VkFence, MAX_FRAMES_IN_FLIGHT> m_fen_flight{ VK_NULL_HANDLE };
+	// per fence slot, the buffer writes requested since the previous frame. the pool is reset once the fence has signaled
+	std::array<VkCommandPool, MAX_FRAMES_IN_FLIGHT> m_frame_cmd_pools{ VK_NULL_HANDLE };
+	std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> m_frame_cmd_buffers{ VK_NULL_HANDLE };
+	// fence of the last submission that rendered each swapchain image, VK_NULL_HANDLE before the first
+	std::vector<VkFence> m_images_in_flight;
+	uint64_t m_frame_count{ 0 };
+	DeletionQueue m_deletion_queue;
 
 	uint32_t m_samples_accumulated{ 0 };
+	uint32_t m_samples_per_launch{ 1 };
+	glm::mat4 m_prev_view{ 1.0f }; // camera the accumulated history was traced from
+	VkExtent2D m_render_extent{ 0, 0 }; // traced part of the rt images, at most the swapchain extent
+	VkExtent2D m_prev_render_extent{ 0, 0 };
+	float m_render_scale{ 1.0f };
+	std::chrono::high_resolution_clock::time_point m_last_frame_time;
+	std::chrono::high_resolution_clock::time_point m_last_camera_move;
+	bool m_throughput_mode{ true };
+	float m_exposure{ 0.0f };
+	bool m_adaptive_sampling{ true };
+	float m_target_error{ 0.02f };
+	std::chrono::high_resolution_clock::time_point m_accumulation_start;
+	uint64_t m_accumulation_epoch{ 0 };
+	bool m_target_reported{ false };
+	bool m_russian_roulette{ true };
+	bool m_next_event_estimation{ true };
+	bool m_restir{ true };
+	uint32_t m_radiance_cache_mode{ 0 }; // off by default, the cached radiance is biased
+	uint32_t m_sampler{ RT_SAMPLER_SOBOL };
+	bool m_denoiser{ true };
+	uint32_t m_integrator{ RT_INTEGRATOR_MEGAKERNEL };
+	bool m_hit_sorting{ false }; // sort the wavefront hits by material before shading
+	uint32_t m_wavefront_depth{ RT_WAVEFRONT_MAX_DEPTH }; // bounces recorded per launch, see read_rt_stats()
+	uint32_t m_wavefront_bounces{ 0 }; // most bounces with live paths in the statistics period
+	bool m_wavefront_depth_fixed{ false }; // a path was cut, all bounces stay recorded until the integrator changes
+	bool m_raster_primary{ false }; // the megakernel starts the first sample of a launch at the rasterized surfaces
+	bool m_transparent_shadows{ true }; // the model parts that do not cast shadows are in the shadow ray mask anyway
+	bool m_sphere_stats{ false }; // count the sphere intersection tests, an atomic per test
+	int32_t m_benchmark_period{ -1 }; // statistics periods since the benchmark started, -1 when it is not running
+	std::array<double, RT_INTEGRATOR_COUNT> m_benchmark_rates{};
+	std::chrono::high_resolution_clock::time_point m_path_stats_start;
+	uint64_t m_path_count{ 0 };
+	uint64_t m_path_segment_count{ 0 };
+	uint64_t m_shade_lanes{ 0 };
+	uint64_t m_shade_lane_slots{ 0 };
+	uint64_t m_sphere_tests{ 0 };
+
+	std::chrono::high_resolution_clock::time_point m_init_time;
+	bool m_first_frame_presented{ false };
 };
 
 static std::vector<char> read_file(const std::string &filename)
@@ -437,6 +904,79 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
 		app->on_toggle_raytracing();
 		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_throughput_mode();
+	} else if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS) && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_samples_per_launch_changed(key == GLFW_KEY_EQUAL);
+		app->on_accumulated_samples_reset();
+	} else if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS) {
+		// exposure only changes the resolve, the accumulated samples stay valid
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_exposure_changed(key == GLFW_KEY_RIGHT_BRACKET ? 0.5f : -0.5f);
+	} else if (key == GLFW_KEY_A && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_adaptive_sampling();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_russian_roulette();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_next_event_estimation();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_restir();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_radiance_cache_mode_changed();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_sampler_changed();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_clay_materials();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+		// the filter runs after the accumulation, it does not change it
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_denoiser();
+	} else if (key == GLFW_KEY_W && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_integrator_changed();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_benchmark_started();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+		// the sort only reorders the shading, the accumulated samples stay valid
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_hit_sorting();
+	} else if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		// the paths start at the same surfaces either way, the accumulated samples stay valid
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_raster_primary();
+	} else if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_batch_render_requested();
+	} else if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_transparent_shadows();
+		app->on_accumulated_samples_reset();
+	} else if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_shadow_benchmark_started();
+	} else if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+		// only the statistics change
+		auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+		app->on_toggle_sphere_stats();
 	}
 }
 
@@ -447,7 +987,6 @@ static void mouse_button_callback(GLFWwindow *window, int button, int action, in
 		double xpos, ypos;
 		glfwGetCursorPos(window, &xpos, &ypos);
 		app->camera().set_mouse_position(-int(xpos), -int(ypos));
-		app->on_accumulated_samples_reset();
 	}
 }
 
@@ -461,8 +1000,8 @@ static void mouse_move_callback(GLFWwindow *window, double xpos, double ypos)
 	if (!ms.left && !ms.right && !ms.middle) return;
 
 	auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
+	// the accumulation is reprojected to the new camera instead of reset
 	app->camera().mouse_move(-int(xpos), -int(ypos), ms);
-	app->on_accumulated_samples_reset();
 }
 
 static void mouse_scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -470,7 +1009,6 @@ static void mouse_scroll_callback(GLFWwindow* window, double xoffset, double yof
 	(void)xoffset; // unused
 	auto app = reinterpret_cast<BaseApplication*>(glfwGetWindowUserPointer(window));
 	app->camera().mouse_scroll(float(yoffset));
-	app->on_accumulated_samples_reset();
 }
 
 static void framebuffer_resize_callback(GLFWwindow *window, int width, int height)
@@ -505,6 +1043,28 @@ static VkImageView create_image_view_2d(const VkDevice device, const VkImage img
 	return view;
 }
 
+static VkImageView create_image_view_2d_array(const VkDevice device, const VkImage img, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t layers)
+{
+	VkImageViewCreateInfo vi = {};
+	vi.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	vi.image = img;
+	vi.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	vi.format = format;
+	vi.subresourceRange.aspectMask = aspect_flags;
+	vi.subresourceRange.baseMipLevel = 0;
+	vi.subresourceRange.levelCount = 1;
+	vi.subresourceRange.baseArrayLayer = 0;
+	vi.subresourceRange.layerCount = layers;
+
+	VkImageView view = VK_NULL_HANDLE;
+
+	auto res = vkCreateImageView(device, &vi, nullptr, &view);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create array image view");
+	}
+	return view;
+}
+
 bool format_has_stencil_component(VkFormat format)
 {
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
@@ -564,6 +1124,27 @@ void image_barrier(VkCommandBuffer cmd_buffer,
 	vkCmdPipelineBarrier2KHR(cmd_buffer, &dep);
 }
 
+void memory_barrier(VkCommandBuffer cmd_buffer,
+	VkPipelineStageFlags2KHR src_stage_mask,
+	VkAccessFlags2KHR src_access_mask,
+	VkPipelineStageFlags2KHR dst_stage_mask,
+	VkAccessFlags2KHR dst_access_mask)
+{
+	VkMemoryBarrier2KHR b = {};
+	b.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	b.srcStageMask = src_stage_mask;
+	b.srcAccessMask = src_access_mask;
+	b.dstStageMask = dst_stage_mask;
+	b.dstAccessMask = dst_access_mask;
+
+	VkDependencyInfoKHR dep = {};
+	dep.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	dep.memoryBarrierCount = 1;
+	dep.pMemoryBarriers = &b;
+
+	vkCmdPipelineBarrier2KHR(cmd_buffer, &dep);
+}
+
 VkDeviceAddress get_buffer_address(VkDevice device, VkBuffer buffer)
 {
 	VkBufferDeviceAddressInfo bdai = {};
@@ -581,6 +1162,39 @@ VkDeviceAddress get_acceleration_structure_address(VkDevice device, VkAccelerati
 	return vkGetAccelerationStructureDeviceAddressKHR(device, &dai);
 }
 
+// creates the pipeline through a deferred operation, the driver work is split
+// among as many threads as the implementation can make use of
+VkResult create_raytracing_pipeline_deferred(VkDevice device, const VkRayTracingPipelineCreateInfoKHR &ci, VkPipeline &pipeline)
+{
+	VkDeferredOperationKHR op = VK_NULL_HANDLE;
+	auto res = vkCreateDeferredOperationKHR(device, nullptr, &op);
+	if (res != VK_SUCCESS) return res;
+
+	res = vkCreateRayTracingPipelinesKHR(device, op, VK_NULL_HANDLE, 1, &ci, nullptr, &pipeline);
+	if (res == VK_OPERATION_DEFERRED_KHR) {
+		const uint32_t max_concurrency = vkGetDeferredOperationMaxConcurrencyKHR(device, op);
+		const uint32_t num_threads = std::max(1u, std::min(max_concurrency, std::thread::hardware_concurrency()));
+		std::vector<std::future<void>> joins;
+		for (uint32_t i = 0; i < num_threads; ++i) {
+			joins.push_back(std::async(std::launch::async, [device, op]() {
+				VkResult r = vkDeferredOperationJoinKHR(device, op);
+				// idle means that there is no work for this thread right now but the op is not complete
+				while (r == VK_THREAD_IDLE_KHR) {
+					std::this_thread::yield();
+					r = vkDeferredOperationJoinKHR(device, op);
+				}
+			}));
+		}
+		for (auto &j : joins) j.wait();
+		res = vkGetDeferredOperationResultKHR(device, op);
+	} else if (res == VK_OPERATION_NOT_DEFERRED_KHR) {
+		res = VK_SUCCESS;
+	}
+
+	vkDestroyDeferredOperationKHR(device, op, nullptr);
+	return res;
+}
+
 static std::string human_readable_size(VkDeviceSize sz)
 {
 	char out[64];
@@ -644,12 +1258,13 @@ BaseApplication::BaseApplication()
 
 	m_device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 	m_device_extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
-	m_device_extensions.push_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
 	m_device_extensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
 	m_device_extensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
 	m_device_extensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
-	m_device_extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
 	m_device_extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	// enabled when the gpu has them, otherwise the compute integrators trace with ray queries
+	m_rt_pipeline_extensions.push_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+	m_rt_pipeline_extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
 #if defined(ENABLE_DEBUG_MARKERS)
 	m_device_extensions.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
 #endif
@@ -689,6 +1304,9 @@ void BaseApplication::init_window()
 
 void BaseApplication::init_vulkan()
 {
+	m_init_time = std::chrono::high_resolution_clock::now();
+	m_path_stats_start = m_init_time;
+
 	auto res = volkInitialize();
 	if (res != VK_SUCCESS) 
 		throw std::runtime_error("could not initialize volk");
@@ -720,31 +1338,51 @@ void BaseApplication::init_vulkan()
 
 	create_descriptor_set_layout();
 	create_graphics_pipeline();
+	create_gbuffer_pipeline();
+	create_resolve_pipeline();
+	create_denoise_pipeline();
 
 	// rt
+	// the rt pipeline compiles in the background while we load the scene and 
+	// render with the raster pipeline, see poll_raytracing_pipeline()
 	create_raytracing_pipeline_layout();
-	create_raytracing_pipeline();
+	if (m_rt_pipeline_supported) {
+		m_rt_pipeline_future = std::async(std::launch::async, [this]() { return create_raytracing_pipeline({}); });
+	}
 
 	load_model();
+	create_ground();
 
 	create_vertex_buffer();
 	create_index_buffer();
 	create_uniform_buffers();
+	create_rt_stats_buffers();
+	create_rt_indirect_buffers();
 
 	create_spheres();
 	create_sphere_buffer();
-
-	create_bottom_acceleration_structure();
+	create_light_buffer();
+	create_geometry_buffers();
+	create_radiance_cache();
+	create_sampler_tables();
+	create_batch_resources();
+
+	create_bottom_acceleration_structure(m_model_parts.data(), m_shadow_part_count, m_bottom_as);
+	create_bottom_acceleration_structure(m_model_parts.data() + m_shadow_part_count, uint32_t(m_model_parts.size()) - m_shadow_part_count, m_bottom_as_no_shadows);
+	create_bottom_acceleration_structure(&m_ground_part, 1, m_bottom_as_ground);
 	create_bottom_acceleration_structure_spheres();
 	create_top_acceleration_structure();
 
 	create_descriptor_pool();
 	create_descriptor_sets();
 	create_rt_descriptor_sets();
-	create_shader_binding_table();
+	create_resolve_descriptor_sets();
+	create_denoise_descriptor_sets();
 
 	create_command_buffers();
-	create_rt_command_buffers();
+	if (!m_rt_pipeline_supported) {
+		set_integrator(RT_INTEGRATOR_RAY_QUERY);
+	}
 }
 
 void BaseApplication::recreate_swapchain()
@@ -756,6 +1394,7 @@ void BaseApplication::recreate_swapchain()
 		glfwWaitEvents();
 	}
 	vkDeviceWaitIdle(m_device);
+	m_deletion_queue.flush_all();
 
 	cleanup_swapchain();
 
@@ -766,14 +1405,135 @@ void BaseApplication::recreate_swapchain()
 
 	create_descriptor_set_layout();
 	create_graphics_pipeline();
+	create_gbuffer_pipeline();
+	create_resolve_pipeline();
+	create_denoise_pipeline();
 	create_uniform_buffers();
+	create_rt_stats_buffers();
+	create_rt_indirect_buffers();
 
 	create_descriptor_pool();
 	create_descriptor_sets();
 	create_rt_descriptor_sets();
+	create_resolve_descriptor_sets();
+	create_denoise_descriptor_sets();
 
 	create_command_buffers();
+	if (rt_commands_ready()) {
+		create_rt_command_buffers();
+	}
+}
+
+void BaseApplication::poll_raytracing_pipeline()
+{
+	if (!m_rt_pipeline_future.valid()) {
+		// shader hot reload, only one rebuild is in flight at any time
+		if (!m_rt_pipeline) return;
+		auto changed = m_shader_watcher.poll();
+		if (changed.empty()) return;
+
+		// only the libraries that depend on the changed files are recompiled, the rest are relinked
+		std::vector<RTPipelineLibrary> libraries = m_rt_libraries;
+		for (auto &lib : libraries) {
+			for (const auto &f : changed) {
+				if (lib.sources.count(f)) {
+					lib.pipeline = VK_NULL_HANDLE;
+					break;
+				}
+			}
+		}
+		fprintf(stdout, "shader change detected, rebuilding raytracing pipeline\n");
+		m_rt_pipeline_future = std::async(std::launch::async, [this, libraries]() { return create_raytracing_pipeline(libraries); });
+		return;
+	}
+	if (m_rt_pipeline_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+	if (!m_rt_pipeline) {
+		// first build, rethrows any error that happened on the compile thread
+		RTPipelineBuild build = m_rt_pipeline_future.get();
+		for (const auto &lib : build.libraries) {
+			m_shader_watcher.watch(lib.sources);
+		}
+		m_rt_pipeline = build.pipeline;
+		m_rt_libraries = std::move(build.libraries);
+		m_rt_group_indices = std::move(build.group_indices);
+		m_rt_group_count = build.group_count;
+		m_rt_stack_size = build.stack_size;
+		create_shader_binding_table();
+		create_rt_command_buffers();
+		on_accumulated_samples_reset();
+
+#if defined(ENABLE_DEBUG_MARKERS)
+		auto elapsed = std::chrono::high_resolution_clock::now() - m_init_time;
+		fprintf(stdout, "raytracing pipeline ready after %.1f ms\n",
+			std::chrono::duration<float, std::chrono::milliseconds::period>(elapsed).count());
+#endif
+		return;
+	}
+
+	// rebuild, on failure we keep rendering with the old pipeline
+	try {
+		RTPipelineBuild build = m_rt_pipeline_future.get();
+		for (const auto &lib : build.libraries) {
+			m_shader_watcher.watch(lib.sources);
+		}
+		swap_raytracing_pipeline(std::move(build));
+		fprintf(stdout, "raytracing pipeline reloaded\n");
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s, keeping the previous raytracing pipeline\n", e.what());
+	}
+}
+
+void BaseApplication::swap_raytracing_pipeline(RTPipelineBuild &&build)
+{
+	// frames in flight still reference the old pipeline, sbt and command buffers
+	// so they are retired through the deletion queue instead of waiting for the device
+	std::vector<VkPipeline> old_pipelines = { m_rt_pipeline };
+	for (size_t i = 0; i < m_rt_libraries.size(); ++i) {
+		if (m_rt_libraries[i].pipeline != build.libraries[i].pipeline) {
+			old_pipelines.push_back(m_rt_libraries[i].pipeline);
+		}
+	}
+	VmaBufferAllocation old_sbt = m_rt_sbt;
+	std::vector<VkCommandBuffer> old_cmd_buffers = std::move(m_rt_cmd_buffers);
+	old_cmd_buffers.insert(old_cmd_buffers.end(), m_rt_throughput_cmd_buffers.begin(), m_rt_throughput_cmd_buffers.end());
+	m_deletion_queue.push(m_frame_count + MAX_FRAMES_IN_FLIGHT, [this, old_pipelines, old_sbt, old_cmd_buffers]() {
+		vkFreeCommandBuffers(m_device, m_graphics_cmd_pool, uint32_t(old_cmd_buffers.size()), old_cmd_buffers.data());
+		vmaDestroyBuffer(m_allocator, old_sbt.buffer, old_sbt.alloc);
+		for (auto p : old_pipelines) {
+			vkDestroyPipeline(m_device, p, nullptr);
+		}
+	});
+
+	m_rt_pipeline = build.pipeline;
+	m_rt_libraries = std::move(build.libraries);
+	m_rt_group_indices = std::move(build.group_indices);
+	m_rt_group_count = build.group_count;
+	m_rt_stack_size = build.stack_size;
+	m_rt_cmd_buffers.clear();
+	m_rt_throughput_cmd_buffers.clear();
+	create_shader_binding_table();
 	create_rt_command_buffers();
+	// edited shaders may shade differently
+	clear_radiance_cache();
+	on_accumulated_samples_reset();
+}
+
+void BaseApplication::bind_rt_pipeline(VkCommandBuffer cmd_buf, VkDescriptorSet desc_set)
+{
+	vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rt_pipeline);
+	vkCmdSetRayTracingPipelineStackSizeKHR(cmd_buf, m_rt_stack_size);
+	vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rt_pipeline_layout,
+		0, 1, &desc_set, 0, nullptr);
+}
+
+uint32_t BaseApplication::get_rt_group_index(const std::string &name) const
+{
+	auto it = m_rt_group_indices.find(name);
+	if (it == m_rt_group_indices.end()) {
+		throw std::runtime_error("raytracing pipeline has no shader group " + name);
+	}
+	return it->second;
 }
 
 void BaseApplication::main_loop()
@@ -792,6 +1552,12 @@ void BaseApplication::cleanup_swapchain()
 	for (auto b : m_uni_buffers) {
 		vmaDestroyBuffer(m_allocator, b.buffer, b.alloc);
 	}
+	for (auto b : m_rt_stats_buffers) {
+		vmaDestroyBuffer(m_allocator, b.buffer, b.alloc);
+	}
+	for (auto b : m_rt_indirect_buffers) {
+		vmaDestroyBuffer(m_allocator, b.buffer, b.alloc);
+	}
 	
 	// no need to free desc sets because we destroy the pool
 	vkDestroyDescriptorPool(m_device, m_desc_pool, nullptr);
@@ -801,6 +1567,10 @@ void BaseApplication::cleanup_swapchain()
 			vkFreeCommandBuffers(m_device, m_graphics_cmd_pool,
 				static_cast<uint32_t>(m_rt_cmd_buffers.size()), m_rt_cmd_buffers.data());
 		}
+		if (m_rt_throughput_cmd_buffers.size()) {
+			vkFreeCommandBuffers(m_device, m_graphics_cmd_pool,
+				static_cast<uint32_t>(m_rt_throughput_cmd_buffers.size()), m_rt_throughput_cmd_buffers.data());
+		}
 		if (m_cmd_buffers.size()) {
 			vkFreeCommandBuffers(m_device, m_graphics_cmd_pool,
 				static_cast<uint32_t>(m_cmd_buffers.size()), m_cmd_buffers.data());
@@ -812,12 +1582,37 @@ void BaseApplication::cleanup_swapchain()
 	vkDestroyDescriptorSetLayout(m_device, m_descriptor_set_layout, nullptr);
 	vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
 
+	vkDestroyPipeline(m_device, m_gbuffer_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_gbuffer_pipeline_layout, nullptr);
+
+	vkDestroyPipeline(m_device, m_resolve_pipeline, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_resolve_descriptor_set_layout, nullptr);
+	vkDestroyPipelineLayout(m_device, m_resolve_pipeline_layout, nullptr);
+
+	vkDestroyPipeline(m_device, m_denoise_pipeline, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_denoise_descriptor_set_layout, nullptr);
+	vkDestroyPipelineLayout(m_device, m_denoise_pipeline_layout, nullptr);
+
 	vkDestroyImageView(m_device, m_depth_img_view, nullptr);
 	vmaDestroyImage(m_allocator, m_depth_img.image, m_depth_img.alloc);
 	
 	// cleanup raytracing stuff
 	vkDestroyImageView(m_device, m_rt_img_view, nullptr);
 	vmaDestroyImage(m_allocator, m_rt_img.image, m_rt_img.alloc);
+	vkDestroyImageView(m_device, m_rt_moments_img_view, nullptr);
+	vmaDestroyImage(m_allocator, m_rt_moments_img.image, m_rt_moments_img.alloc);
+	vkDestroyImageView(m_device, m_rt_surface_img_view, nullptr);
+	vmaDestroyImage(m_allocator, m_rt_surface_img.image, m_rt_surface_img.alloc);
+	vkDestroyImageView(m_device, m_rt_albedo_img_view, nullptr);
+	vmaDestroyImage(m_allocator, m_rt_albedo_img.image, m_rt_albedo_img.alloc);
+	vkDestroyImageView(m_device, m_rt_denoise_img_view, nullptr);
+	vmaDestroyImage(m_allocator, m_rt_denoise_img.image, m_rt_denoise_img.alloc);
+	vkDestroyImageView(m_device, m_rt_gbuffer_img_view, nullptr);
+	vmaDestroyImage(m_allocator, m_rt_gbuffer_img.image, m_rt_gbuffer_img.alloc);
+	vmaDestroyBuffer(m_allocator, m_restir_reservoirs.buffer, m_restir_reservoirs.alloc);
+	vmaDestroyBuffer(m_allocator, m_wavefront_state.buffer, m_wavefront_state.alloc);
+	vmaDestroyBuffer(m_allocator, m_wavefront_queues.buffer, m_wavefront_queues.alloc);
+	vmaDestroyBuffer(m_allocator, m_wavefront_sort.buffer, m_wavefront_sort.alloc);
 	
 	for (auto img_view : m_swapchain_img_views) {
 		vkDestroyImageView(m_device, img_view, nullptr);
@@ -827,6 +1622,21 @@ void BaseApplication::cleanup_swapchain()
 
 void BaseApplication::cleanup()
 {
+	// never destroy the device under the feet of the compile thread
+	if (m_rt_pipeline_future.valid()) {
+		try {
+			RTPipelineBuild build = m_rt_pipeline_future.get();
+			vkDestroyPipeline(m_device, build.pipeline, nullptr);
+			for (size_t i = 0; i < build.libraries.size(); ++i) {
+				bool shared = i < m_rt_libraries.size() && m_rt_libraries[i].pipeline == build.libraries[i].pipeline;
+				if (!shared) vkDestroyPipeline(m_device, build.libraries[i].pipeline, nullptr);
+			}
+		} catch (const std::exception &e) {
+			fprintf(stderr, "%s\n", e.what());
+		}
+	}
+	m_deletion_queue.flush_all();
+
 	cleanup_swapchain();
 
 	if (m_device) {
@@ -834,16 +1644,37 @@ void BaseApplication::cleanup()
 		vkDestroyDescriptorSetLayout(m_device, m_rt_descriptor_set_layout, nullptr);
 		vkDestroyPipelineLayout(m_device, m_rt_pipeline_layout, nullptr);
 		vkDestroyPipeline(m_device, m_rt_pipeline, nullptr);
+		for (auto &lib : m_rt_libraries) {
+			vkDestroyPipeline(m_device, lib.pipeline, nullptr);
+		}
+		for (auto p : m_wavefront_pipelines) {
+			vkDestroyPipeline(m_device, p, nullptr);
+		}
+		vkDestroyPipeline(m_device, m_ray_query_pipeline, nullptr);
+		vkDestroyPipeline(m_device, m_radiance_cache_age_pipeline, nullptr);
+		vkDestroyPipelineLayout(m_device, m_rt_compute_pipeline_layout, nullptr);
 	}
 
 	if (m_device && m_allocator) {
 		// cleanup buffers and acceleration structures
 		vmaDestroyBuffer(m_allocator, m_index_buffer.buffer, m_index_buffer.alloc);
 		vmaDestroyBuffer(m_allocator, m_vertex_buffer.buffer, m_vertex_buffer.alloc);
-		vmaDestroyBuffer(m_allocator, m_sphere_buffer.buffer, m_sphere_buffer.alloc);
+		vmaDestroyBuffer(m_allocator, m_sphere_aabbs.buffer, m_sphere_aabbs.alloc);
+		vmaDestroyBuffer(m_allocator, m_sphere_geometry.buffer, m_sphere_geometry.alloc);
+		vmaDestroyBuffer(m_allocator, m_sphere_shading.buffer, m_sphere_shading.alloc);
+		vmaDestroyBuffer(m_allocator, m_light_buffer.buffer, m_light_buffer.alloc);
+		vmaDestroyBuffer(m_allocator, m_radiance_cache.buffer, m_radiance_cache.alloc);
+		vmaDestroyBuffer(m_allocator, m_sampler_tables.buffer, m_sampler_tables.alloc);
+		vkDestroyImageView(m_device, m_batch_img_view, nullptr);
+		vmaDestroyImage(m_allocator, m_batch_img.image, m_batch_img.alloc);
+		vmaDestroyBuffer(m_allocator, m_batch_views.buffer, m_batch_views.alloc);
+		vmaDestroyBuffer(m_allocator, m_geometry_buffer.buffer, m_geometry_buffer.alloc);
+		vmaDestroyBuffer(m_allocator, m_material_buffer.buffer, m_material_buffer.alloc);
 		vmaDestroyBuffer(m_allocator, m_rt_sbt.buffer, m_rt_sbt.alloc);
 		m_top_as.destroy(m_device, m_allocator);
 		m_bottom_as.destroy(m_device, m_allocator);
+		m_bottom_as_no_shadows.destroy(m_device, m_allocator);
+		m_bottom_as_ground.destroy(m_device, m_allocator);
 		m_bottom_as_spheres.destroy(m_device, m_allocator);
 		vmaDestroyAllocator(m_allocator);
 	}
@@ -853,6 +1684,7 @@ void BaseApplication::cleanup()
 			vkDestroyFence(m_device, m_fen_flight[i], nullptr);
 			vkDestroySemaphore(m_device, m_sem_img_available[i], nullptr);
 			vkDestroySemaphore(m_device, m_sem_render_finished[i], nullptr);
+			vkDestroyCommandPool(m_device, m_frame_cmd_pools[i], nullptr);
 		}
 		vkDestroyCommandPool(m_device, m_transfer_cmd_pool, nullptr);
 		vkDestroyCommandPool(m_device, m_graphics_cmd_pool, nullptr);
@@ -979,24 +1811,32 @@ void BaseApplication::pick_gpu()
 	std::vector<VkPhysicalDevice> gpus(gpu_count);
 	vkEnumeratePhysicalDevices(m_instance, &gpu_count, gpus.data());
 	
+	// a gpu with the rt pipeline is preferred, the others only run the compute integrators
 	for (const auto &gpu : gpus) {
-		if (is_gpu_suitable(gpu)) {
-			m_gpu = gpu; break;
+		if (is_gpu_suitable(gpu) && (m_gpu == VK_NULL_HANDLE || is_rt_pipeline_supported(gpu))) {
+			m_gpu = gpu;
+			if (is_rt_pipeline_supported(gpu)) break;
 		}
 	}
 	if (m_gpu == VK_NULL_HANDLE) {
 		throw std::runtime_error("failed to find at least one suitable GPU");
 	}
+	m_rt_pipeline_supported = is_rt_pipeline_supported(m_gpu);
+	if (m_rt_pipeline_supported) {
+		m_device_extensions.insert(m_device_extensions.end(), m_rt_pipeline_extensions.begin(), m_rt_pipeline_extensions.end());
+	} else {
+		fprintf(stdout, "the gpu has no raytracing pipeline, tracing with ray queries\n");
+	}
 }
 
-bool BaseApplication::check_device_extension_support(VkPhysicalDevice gpu) const
+bool BaseApplication::check_device_extension_support(VkPhysicalDevice gpu, const std::vector<const char*> &extensions) const
 {
 	uint32_t ext_count = 0;
 	vkEnumerateDeviceExtensionProperties(gpu, nullptr, &ext_count, nullptr);
 	std::vector<VkExtensionProperties> available_exts(ext_count);
 	vkEnumerateDeviceExtensionProperties(gpu, nullptr, &ext_count, available_exts.data());
 
-	std::set<std::string> required_exts(m_device_extensions.begin(), m_device_extensions.end());
+	std::set<std::string> required_exts(extensions.begin(), extensions.end());
 	// if the required extension is supported it will be checked off of the set
 	// so if in the end the set is empty then all requirements are fullfilled
 	for (const auto &ext : available_exts) {
@@ -1017,12 +1857,9 @@ bool BaseApplication::is_gpu_suitable(VkPhysicalDevice gpu) const
 	VkPhysicalDeviceRayQueryFeaturesKHR rq_features = {};
 	rq_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
 	rq_features.pNext = &as_features;
-	VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtp_features = {};
-	rtp_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
-	rtp_features.pNext = &rq_features;
 	VkPhysicalDeviceVulkan12Features v12_features = {};
 	v12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
-	v12_features.pNext = &rtp_features;
+	v12_features.pNext = &rq_features;
 	VkPhysicalDeviceSynchronization2FeaturesKHR sh2 = {};
 	sh2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
 	sh2.pNext = &v12_features;
@@ -1033,7 +1870,7 @@ bool BaseApplication::is_gpu_suitable(VkPhysicalDevice gpu) const
 	
 	auto indices = find_queue_families(gpu);
 
-	bool extensions_supported = check_device_extension_support(gpu);
+	bool extensions_supported = check_device_extension_support(gpu, m_device_extensions);
 	bool swapchain_adequate = false;
 	if (extensions_supported) {
 		auto chain_details = query_swapchain_support(gpu);
@@ -1044,7 +1881,6 @@ bool BaseApplication::is_gpu_suitable(VkPhysicalDevice gpu) const
 	bool supported_features =
 		features.features.vertexPipelineStoresAndAtomics &&
 		features.features.samplerAnisotropy &&
-		rtp_features.rayTracingPipeline &&
 		rq_features.rayQuery &&
 		as_features.accelerationStructure &&
 		v12_features.bufferDeviceAddress &&
@@ -1055,6 +1891,24 @@ bool BaseApplication::is_gpu_suitable(VkPhysicalDevice gpu) const
 	return indices.is_complete() && extensions_supported && supported_features && swapchain_adequate;
 }
 
+bool BaseApplication::is_rt_pipeline_supported(VkPhysicalDevice gpu) const
+{
+	if (!check_device_extension_support(gpu, m_rt_pipeline_extensions)) return false;
+
+	VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtp_features = {};
+	rtp_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
+	rtp_features.pNext = nullptr;
+	VkPhysicalDeviceFeatures2 features;
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &rtp_features;
+	vkGetPhysicalDeviceFeatures2(gpu, &features);
+
+	// the hit shaders trace shadow rays
+	return rtp_features.rayTracingPipeline &&
+		rtp_features.rayTracingPipelineTraceRaysIndirect &&
+		vk_helpers::get_raytracing_properties(gpu).maxRayRecursionDepth >= RT_MAX_RECURSION_DEPTH;
+}
+
 QueueFamilyIndices BaseApplication::find_queue_families(VkPhysicalDevice gpu) const
 {
 	QueueFamilyIndices indices;
@@ -1130,13 +1984,14 @@ void BaseApplication::create_logical_device()
 	VkPhysicalDeviceRayTracingPipelineFeaturesKHR drtf = {};
 	drtf.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
 	drtf.rayTracingPipeline = VK_TRUE;
+	drtf.rayTracingPipelineTraceRaysIndirect = VK_TRUE;
 	drtf.pNext = &drqf;
 
 	VkPhysicalDeviceVulkan12Features v12f = {};
 	v12f.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 	v12f.bufferDeviceAddress = VK_TRUE;
 	v12f.scalarBlockLayout = VK_TRUE;
-	v12f.pNext = &drtf;
+	v12f.pNext = m_rt_pipeline_supported ? (void*)&drtf : (void*)&drqf;
 
 	VkPhysicalDeviceSynchronization2FeaturesKHR sh2 = {};
 	sh2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
@@ -1351,6 +2206,7 @@ void BaseApplication::create_swapchain()
 	vkGetSwapchainImagesKHR(m_device, m_swapchain, &img_count, nullptr);
 	m_swapchain_images.resize(img_count);
 	vkGetSwapchainImagesKHR(m_device, m_swapchain, &img_count, m_swapchain_images.data());
+	m_images_in_flight.assign(img_count, VK_NULL_HANDLE);
 
 	// store format and extent
 	m_swapchain_extent = extent;
@@ -1573,19 +2429,161 @@ void BaseApplication::create_graphics_pipeline()
 	vkDestroyShaderModule(m_device, frag_module, nullptr);
 }
 
-class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface
+void BaseApplication::create_gbuffer_pipeline()
 {
-public:
-	virtual shaderc_include_result* GetInclude(const char* requested_source,
-		shaderc_include_type type,
-		const char* requesting_source,
-		size_t include_depth) override
-	{
-		assert(type == shaderc_include_type_relative);
-		std::string filename = SHADER_DIR + std::string(requested_source);
+	// the scene uniforms come from the descriptor sets of the raster pipeline, 
+	// each model part pushes its geometry table entry and each dispatch its index
+	VkPushConstantRange pc_range = {};
+	pc_range.offset = 0;
+	pc_range.size = sizeof(GBufferPushConstants);
+	pc_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkPipelineLayoutCreateInfo plci = {};
+	plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	plci.setLayoutCount = 1;
+	plci.pSetLayouts = &m_descriptor_set_layout;
+	plci.pushConstantRangeCount = 1;
+	plci.pPushConstantRanges = &pc_range;
+
+	auto res = vkCreatePipelineLayout(m_device, &plci, nullptr, &m_gbuffer_pipeline_layout);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout");
+	}
+
+	auto vert_code = read_file(SHADER_DIR "gbuffer.vert");
+	auto frag_code = read_file(SHADER_DIR "gbuffer.frag");
+	auto vert_module = create_shader_module("gbuffer.vert", shaderc_vertex_shader, vert_code);
+	auto frag_module = create_shader_module("gbuffer.frag", shaderc_fragment_shader, frag_code);
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {};
+	shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shader_stages[0].module = vert_module;
+	shader_stages[0].pName = "main";
+	shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shader_stages[1].module = frag_module;
+	shader_stages[1].pName = "main";
+
+	// position and normal, the texture coordinates are not needed
+	auto binding_desc = Vertex::get_binding_description();
+	auto attrib_desc = Vertex::get_attribute_descriptions();
+
+	VkPipelineVertexInputStateCreateInfo vici = {};
+	vici.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vici.vertexBindingDescriptionCount = 1;
+	vici.pVertexBindingDescriptions = &binding_desc;
+	vici.vertexAttributeDescriptionCount = 2;
+	vici.pVertexAttributeDescriptions = attrib_desc.data();
+
+	VkPipelineInputAssemblyStateCreateInfo iaci = {};
+	iaci.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	iaci.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	iaci.primitiveRestartEnable = VK_FALSE;
+
+	// the whole rt image, the vertex shader keeps the surfaces in the render size part
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)m_swapchain_extent.width;
+	viewport.height = (float)m_swapchain_extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = m_swapchain_extent;
+
+	VkPipelineViewportStateCreateInfo vci = {};
+	vci.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	vci.viewportCount = 1;
+	vci.pViewports = &viewport;
+	vci.scissorCount = 1;
+	vci.pScissors = &scissor;
+
+	// rays hit both sides of the triangles. the rt pipeline calls a triangle front facing 
+	// when it is clockwise seen from the ray origin, the raster pipeline the other way round
+	VkPipelineRasterizationStateCreateInfo rci = {};
+	rci.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rci.polygonMode = VK_POLYGON_MODE_FILL;
+	rci.lineWidth = 1.0f;
+	rci.cullMode = VK_CULL_MODE_NONE;
+	rci.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+	VkPipelineMultisampleStateCreateInfo msci = {};
+	msci.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	msci.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo ds = {};
+	ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	ds.depthTestEnable = VK_TRUE;
+	ds.depthWriteEnable = VK_TRUE;
+	ds.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	VkPipelineColorBlendAttachmentState cba = {};
+	cba.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	cba.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo cbci = {};
+	cbci.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	cbci.attachmentCount = 1;
+	cbci.pAttachments = &cba;
+
+	VkPipelineRenderingCreateInfoKHR drci = {};
+	drci.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	drci.colorAttachmentCount = 1;
+	drci.pColorAttachmentFormats = &RT_GBUFFER_FORMAT;
+	drci.depthAttachmentFormat = m_depth_img_format;
+	drci.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+
+	VkGraphicsPipelineCreateInfo pci = {};	
+	pci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pci.pNext = &drci;
+	pci.stageCount = uint32_t(shader_stages.size());
+	pci.pStages = shader_stages.data();
+	pci.pVertexInputState = &vici;
+	pci.pInputAssemblyState = &iaci;
+	pci.pViewportState = &vci;
+	pci.pRasterizationState = &rci;
+	pci.pMultisampleState = &msci;
+	pci.pDepthStencilState = &ds;
+	pci.pColorBlendState = &cbci;
+	pci.pDynamicState = nullptr;
+	pci.layout = m_gbuffer_pipeline_layout;
+	pci.renderPass = VK_NULL_HANDLE;
+	pci.basePipelineIndex = -1;
+
+	res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pci, nullptr, &m_gbuffer_pipeline);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create gbuffer pipeline");
+	}
+
+	vkDestroyShaderModule(m_device, vert_module, nullptr);
+	vkDestroyShaderModule(m_device, frag_module, nullptr);
+}
+
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+	explicit ShaderIncluder(std::set<std::string> *included_files)
+		: m_included_files(included_files)
+	{
+	}
+
+	virtual shaderc_include_result* GetInclude(const char* requested_source,
+		shaderc_include_type type,
+		const char* requesting_source,
+		size_t include_depth) override
+	{
+		assert(type == shaderc_include_type_relative);
+		std::string filename = SHADER_DIR + std::string(requested_source);
 		auto data = read_file(filename.c_str());
 		std::string source { data.begin(), data.end() };
 		auto [it, inserted] = m_includes.insert({ filename, source });
+		if (m_included_files) {
+			m_included_files->insert(filename);
+		}
 		return new shaderc_include_result{
 			it->first.c_str(),
 			it->first.size(),
@@ -1603,16 +2601,273 @@ public:
 
 private:
 	std::unordered_map<std::string, std::string> m_includes;
+	std::set<std::string> *m_included_files;
 };
 
+void BaseApplication::create_resolve_pipeline()
+{
+	// descriptor set layout, accumulation image and scene uniforms
+	VkDescriptorSetLayoutBinding lb_0 = {};
+	lb_0.binding = 0;
+	lb_0.descriptorCount = 1;
+	lb_0.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_0.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	lb_0.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding lb_1 = {};
+	lb_1.binding = 1;
+	lb_1.descriptorCount = 1;
+	lb_1.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lb_1.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	lb_1.pImmutableSamplers = nullptr;
+
+	// denoised image
+	VkDescriptorSetLayoutBinding lb_2 = {};
+	lb_2.binding = 2;
+	lb_2.descriptorCount = 1;
+	lb_2.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_2.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	lb_2.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {
+		lb_0, lb_1, lb_2
+	};
+
+	VkDescriptorSetLayoutCreateInfo li = {};
+	li.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	li.bindingCount = uint32_t(bindings.size());
+	li.pBindings = bindings.data();
+	auto res = vkCreateDescriptorSetLayout(m_device, &li, nullptr, &m_resolve_descriptor_set_layout);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to create descriptor set layout");
+
+	VkPipelineLayoutCreateInfo plci = {};
+	plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	plci.setLayoutCount = 1;
+	plci.pSetLayouts = &m_resolve_descriptor_set_layout;
+	plci.pushConstantRangeCount = 0;
+	plci.pPushConstantRanges = nullptr;
+
+	res = vkCreatePipelineLayout(m_device, &plci, nullptr, &m_resolve_pipeline_layout);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout");
+	}
+
+	// fullscreen triangle, the fragment shader reads the accumulation image 1:1
+	auto vert_code = read_file(SHADER_DIR "resolve.vert");
+	auto frag_code = read_file(SHADER_DIR "resolve.frag");
+	auto vert_module = create_shader_module("resolve.vert", shaderc_vertex_shader, vert_code);
+	auto frag_module = create_shader_module("resolve.frag", shaderc_fragment_shader, frag_code);
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {};
+	shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shader_stages[0].module = vert_module;
+	shader_stages[0].pName = "main";
+	shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shader_stages[1].module = frag_module;
+	shader_stages[1].pName = "main";
+
+	VkPipelineVertexInputStateCreateInfo vici = {};
+	vici.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo iaci = {};
+	iaci.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	iaci.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	iaci.primitiveRestartEnable = VK_FALSE;
+
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)m_swapchain_extent.width;
+	viewport.height = (float)m_swapchain_extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = m_swapchain_extent;
+
+	VkPipelineViewportStateCreateInfo vci = {};
+	vci.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	vci.viewportCount = 1;
+	vci.pViewports = &viewport;
+	vci.scissorCount = 1;
+	vci.pScissors = &scissor;
+
+	VkPipelineRasterizationStateCreateInfo rci = {};
+	rci.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rci.polygonMode = VK_POLYGON_MODE_FILL;
+	rci.lineWidth = 1.0f;
+	rci.cullMode = VK_CULL_MODE_NONE;
+	rci.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	VkPipelineMultisampleStateCreateInfo msci = {};
+	msci.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	msci.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState cba = {};
+	cba.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	cba.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo cbci = {};
+	cbci.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	cbci.attachmentCount = 1;
+	cbci.pAttachments = &cba;
+
+	VkPipelineRenderingCreateInfoKHR drci = {};
+	drci.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	drci.colorAttachmentCount = 1;
+	drci.pColorAttachmentFormats = &m_swapchain_img_format;
+	drci.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+	drci.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+
+	VkGraphicsPipelineCreateInfo pci = {};	
+	pci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pci.pNext = &drci;
+	pci.stageCount = uint32_t(shader_stages.size());
+	pci.pStages = shader_stages.data();
+	pci.pVertexInputState = &vici;
+	pci.pInputAssemblyState = &iaci;
+	pci.pViewportState = &vci;
+	pci.pRasterizationState = &rci;
+	pci.pMultisampleState = &msci;
+	pci.pDepthStencilState = nullptr;
+	pci.pColorBlendState = &cbci;
+	pci.pDynamicState = nullptr;
+	pci.layout = m_resolve_pipeline_layout;
+	pci.renderPass = VK_NULL_HANDLE;
+	pci.basePipelineIndex = -1;
+
+	res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pci, nullptr, &m_resolve_pipeline);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create resolve pipeline");
+	}
+
+	vkDestroyShaderModule(m_device, vert_module, nullptr);
+	vkDestroyShaderModule(m_device, frag_module, nullptr);
+}
+
+void BaseApplication::create_denoise_pipeline()
+{
+	// descriptor set layout, the filter inputs, its two layer output and the scene uniforms
+	std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+	for (uint32_t b = 0; b < bindings.size(); ++b) {
+		bindings[b].binding = b;
+		bindings[b].descriptorCount = 1;
+		bindings[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[b].pImmutableSamplers = nullptr;
+	}
+	bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+	VkDescriptorSetLayoutCreateInfo li = {};
+	li.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	li.bindingCount = uint32_t(bindings.size());
+	li.pBindings = bindings.data();
+	auto res = vkCreateDescriptorSetLayout(m_device, &li, nullptr, &m_denoise_descriptor_set_layout);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to create descriptor set layout");
+
+	VkPushConstantRange pc_range = {};
+	pc_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pc_range.offset = 0;
+	pc_range.size = sizeof(DenoisePushConstants);
+
+	VkPipelineLayoutCreateInfo plci = {};
+	plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	plci.setLayoutCount = 1;
+	plci.pSetLayouts = &m_denoise_descriptor_set_layout;
+	plci.pushConstantRangeCount = 1;
+	plci.pPushConstantRanges = &pc_range;
+
+	res = vkCreatePipelineLayout(m_device, &plci, nullptr, &m_denoise_pipeline_layout);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout");
+	}
+
+	auto comp_code = read_file(SHADER_DIR "atrous.comp");
+	auto comp_module = create_shader_module("atrous.comp", shaderc_compute_shader, comp_code);
+
+	VkComputePipelineCreateInfo pci = {};
+	pci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pci.stage.module = comp_module;
+	pci.stage.pName = "main";
+	pci.layout = m_denoise_pipeline_layout;
+	pci.basePipelineIndex = -1;
+
+	res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pci, nullptr, &m_denoise_pipeline);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to create denoise pipeline");
+	}
+
+	vkDestroyShaderModule(m_device, comp_module, nullptr);
+}
+
+VkPipeline BaseApplication::create_rt_compute_pipeline(const char *name)
+{
+	// the compute integrators bind the rt descriptor set, so they see the same scene and accumulation images
+	if (!m_rt_compute_pipeline_layout) {
+		VkPushConstantRange pc_range = {};
+		pc_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pc_range.offset = 0;
+		pc_range.size = sizeof(WavefrontPushConstants);
+
+		VkPipelineLayoutCreateInfo plci = {};
+		plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		plci.setLayoutCount = 1;
+		plci.pSetLayouts = &m_rt_descriptor_set_layout;
+		plci.pushConstantRangeCount = 1;
+		plci.pPushConstantRanges = &pc_range;
+
+		auto res = vkCreatePipelineLayout(m_device, &plci, nullptr, &m_rt_compute_pipeline_layout);
+		if (res != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout");
+		}
+	}
+
+	auto comp_code = read_file(std::string(SHADER_DIR) + name);
+	auto comp_module = create_shader_module(name, shaderc_compute_shader, comp_code);
+
+	VkComputePipelineCreateInfo pci = {};
+	pci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pci.stage.module = comp_module;
+	pci.stage.pName = "main";
+	pci.layout = m_rt_compute_pipeline_layout;
+	pci.basePipelineIndex = -1;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pci, nullptr, &pipeline);
+	vkDestroyShaderModule(m_device, comp_module, nullptr);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error(std::string("failed to create compute pipeline ") + name);
+	}
+	return pipeline;
+}
+
+void BaseApplication::create_wavefront_pipelines()
+{
+	const std::array<const char*, WAVEFRONT_PASS_COUNT> names = {
+		"wf_generate.comp", "wf_args.comp", "wf_extend.comp", "wf_shade.comp", "wf_shadow.comp", "wf_accumulate.comp",
+		"wf_sort_histogram.comp", "wf_sort_scan.comp", "wf_sort_scatter.comp"
+	};
+	for (uint32_t i = 0; i < WAVEFRONT_PASS_COUNT; ++i) {
+		m_wavefront_pipelines[i] = create_rt_compute_pipeline(names[i]);
+	}
+}
+
 VkShaderModule BaseApplication::create_shader_module(const std::string &file_name, 
-	shaderc_shader_kind shader_kind, const std::vector<char>& code) const
+	shaderc_shader_kind shader_kind, const std::vector<char>& code, std::set<std::string> *includes) const
 {
 	shaderc::CompileOptions opts;
 	opts.SetGenerateDebugInfo();
 	opts.SetOptimizationLevel(shaderc_optimization_level_zero);
 	opts.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
-	opts.SetIncluder(std::make_unique<ShaderIncluder>());
+	opts.SetIncluder(std::make_unique<ShaderIncluder>(includes));
 	
 	std::string source{ code.begin(), code.end() };
 	auto result = m_shader_compiler.CompileGlslToSpv(source, shader_kind, file_name.c_str(), opts);
@@ -1701,14 +2956,14 @@ void BaseApplication::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
 
 void BaseApplication::create_image(uint32_t width, uint32_t height, VkFormat format, 
 								   VkImageTiling tiling, VkImageUsageFlags usage, 
-								   VkMemoryPropertyFlags props, VmaImageAllocation &img)
+								   VkMemoryPropertyFlags props, VmaImageAllocation &img, uint32_t layers)
 {
 	VkImageCreateInfo ii = {};
 	ii.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	ii.imageType = VK_IMAGE_TYPE_2D;
 	ii.extent = { width, height, 1 };
 	ii.mipLevels = 1;
-	ii.arrayLayers = 1;
+	ii.arrayLayers = layers;
 	ii.format = format;
 	ii.tiling = tiling;
 	ii.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1906,18 +3161,36 @@ void BaseApplication::load_model()
 		mtl.ns = tmat.shininess;
 		mtl.specular_color = glm::make_vec3(&tmat.specular[0]);
 		
-		part_info.pbr_material = materials::convert_mtl_to_pbr(mtl);
-		part_info.pbr_material.albedo.a = tmat.dissolve;
-		part_info.pbr_material.ior = tmat.ior;
+		materials::PBRMaterial pbr_material = materials::convert_mtl_to_pbr(mtl);
+		pbr_material.albedo.a = tmat.dissolve;
+		pbr_material.ior = tmat.ior;
+		part_info.material_index = uint32_t(m_materials.size());
+		m_materials.push_back(pbr_material);
+		// transparent materials do not cast shadows, a "casts_shadows 0|1" line in the mtl file overrides it
+		bool casts_shadows = tmat.dissolve >= 1.0f;
+		auto shadows_param = tmat.unknown_parameter.find("casts_shadows");
+		if (shadows_param != tmat.unknown_parameter.end()) {
+			casts_shadows = std::atoi(shadows_param->second.c_str()) != 0;
+		}
+		m_material_casts_shadows.push_back(casts_shadows);
         m_model_parts.push_back(part_info);
         printf("Add part %s {v0 %u, vc %u, i0 %u, ic %u}\t material [albedo {%.2f, %.2f, %.2f, %.2f}, metallic %.2f, roughness %.2f\n",
 			part.name.c_str(),
 			part_info.vertex_offset, part_info.vertex_count, part_info.index_offset, part_info.index_count,
-			part_info.pbr_material.albedo.r, part_info.pbr_material.albedo.g, 
-			part_info.pbr_material.albedo.b, part_info.pbr_material.albedo.a,
-			part_info.pbr_material.metallic, part_info.pbr_material.roughness);
+			pbr_material.albedo.r, pbr_material.albedo.g, 
+			pbr_material.albedo.b, pbr_material.albedo.a,
+			pbr_material.metallic, pbr_material.roughness);
 
 	}
+	// the parts that do not cast shadows get their own BLAS and instance, which the shadow rays can mask out.
+	// the geometry table and the raster draws follow this order
+	auto no_shadows = std::stable_partition(m_model_parts.begin(), m_model_parts.end(), [this](const ModelPart &p) {
+		return m_material_casts_shadows[p.material_index];
+	});
+	m_shadow_part_count = uint32_t(no_shadows - m_model_parts.begin());
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "Model parts: %u cast shadows, %u do not\n", m_shadow_part_count, uint32_t(m_model_parts.size()) - m_shadow_part_count);
+#endif
     fprintf(stdout, "Loaded model part: num vertices %" PRIu64 ", num indices %" PRIu64 "\n",
         m_model_vertices.size(),
         m_model_indices.size());
@@ -1955,9 +3228,10 @@ void BaseApplication::create_spheres()
 
 	auto rgen = [&]() {return dist(engine); };
 	const float scale = 0.3f;
+	const int half_count = SPHERE_GRID_SIZE / 2;
 #if 1
-	for (int a = -10; a < 10; ++a) {
-		for (int b = -10; b < 10; ++b) {
+	for (int a = -half_count; a < half_count; ++a) {
+		for (int b = -half_count; b < half_count; ++b) {
 			SpherePrimitive sphere = {};
 			float radius = 0.1 * glm::clamp(rgen(), 0.2f, 1.0f);
 			glm::vec3 center = glm::vec3(scale*a + scale *rgen(), scale*b + scale*rgen(), +radius);
@@ -1989,23 +3263,6 @@ void BaseApplication::create_spheres()
 			m_sphere_primitives.push_back(sphere);
 		}
 	}
-	// add a really big one
-	{
-		SpherePrimitive earth = {};
-		glm::vec3 center = glm::vec3(0.0, 0.0, -3000-0.01);
-		float radius = 3000;
-		glm::vec3 aabb_min = center - glm::vec3(radius);
-		glm::vec3 aabb_max = center + glm::vec3(radius);
-		earth.bbox.minX = aabb_min.x;
-		earth.bbox.minY = aabb_min.y;
-		earth.bbox.minZ = aabb_min.z;
-		earth.bbox.maxX = aabb_max.x;
-		earth.bbox.maxY = aabb_max.y;
-		earth.bbox.maxZ = aabb_max.z;
-		earth.albedo = glm::vec4(0.2f, 0.4f, 0.6f, 1.0f);
-		earth.material = materials::MaterialType::LAMBERTIAN;
-		m_sphere_primitives.push_back(earth);
-	}
 	
 #else
 	SpherePrimitive sphere;
@@ -2016,100 +3273,969 @@ void BaseApplication::create_spheres()
 #endif
 }
 
-void BaseApplication::create_vertex_buffer()
+// the ground used to be a sphere of radius 3000 among the small ones, its box overlapped every node of
+// the sphere BVH and most rays ran the intersection shader on it. two triangles in their own BLAS are
+// tested by the traversal hardware and keep the sphere BVH tight
+void BaseApplication::create_ground()
+{
+	m_ground_part = {};
+	m_ground_part.vertex_offset = uint32_t(m_model_vertices.size());
+	m_ground_part.vertex_count = 4;
+	m_ground_part.index_offset = uint32_t(m_model_indices.size());
+	m_ground_part.index_count = 6;
+
+	const float e = RT_GROUND_EXTENT;
+	const glm::vec2 corners[4] = { { -e, -e }, { e, -e }, { e, e }, { -e, e } };
+	for (const glm::vec2 &c : corners) {
+		Vertex v = {};
+		v.pos = glm::vec3(c, RT_GROUND_HEIGHT);
+		v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+		v.tex_coord = c / (2.0f * e) + 0.5f;
+		m_model_vertices.push_back(v);
+	}
+	m_model_indices.insert(m_model_indices.end(), { 0, 1, 2, 0, 2, 3 });
+
+	materials::PBRMaterial ground = {};
+	ground.albedo = glm::vec4(0.2f, 0.4f, 0.6f, 1.0f);
+	ground.roughness = 1.0f;
+	m_ground_part.material_index = uint32_t(m_materials.size());
+	m_materials.push_back(ground);
+	m_material_casts_shadows.push_back(true);
+}
+
+void BaseApplication::create_vertex_buffer()
+{
+	auto bufsize = sizeof(Vertex) * m_model_vertices.size();
+	
+	VmaBufferAllocation staging;
+	create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+				  staging);
+
+	void *data;
+	auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
+	std::memcpy(data, m_model_vertices.data(), bufsize);
+	vmaUnmapMemory(m_allocator, staging.alloc);
+
+	create_buffer(bufsize, 
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | 
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | 
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertex_buffer);
+	copy_buffer(staging.buffer, m_vertex_buffer.buffer, bufsize);
+
+	vmaDestroyBuffer(m_allocator, staging.buffer, staging.alloc);
+}
+
+void BaseApplication::create_index_buffer()
+{
+	VkDeviceSize bufsize = sizeof(uint32_t) * m_model_indices.size();
+	
+	VmaBufferAllocation staging;
+	create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+				  staging);
+
+	void *data;
+	auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
+	std::memcpy(data, m_model_indices.data(), bufsize);
+	vmaUnmapMemory(m_allocator, staging.alloc);
+
+	create_buffer(bufsize,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_index_buffer);
+	copy_buffer(staging.buffer, m_index_buffer.buffer, bufsize);
+
+	vmaDestroyBuffer(m_allocator, staging.buffer, staging.alloc);
+}
+
+void BaseApplication::create_uniform_buffers()
+{
+	VkDeviceSize bufsize = sizeof(SceneUniforms);
+	m_uni_buffers.resize(m_swapchain_images.size());
+
+	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
+		create_buffer(bufsize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					  m_uni_buffers[i]);
+	}
+}
+
+void BaseApplication::create_rt_stats_buffers()
+{
+	VkDeviceSize bufsize = sizeof(RTFrameStats);
+	m_rt_stats_buffers.resize(m_swapchain_images.size());
+	m_rt_stats_epoch.assign(m_swapchain_images.size(), 0);
+	m_rt_stats_extent.assign(m_swapchain_images.size(), VkExtent2D{ 1, 1 });
+
+	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
+		create_buffer(bufsize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					  m_rt_stats_buffers[i]);
+	}
+}
+
+void BaseApplication::create_rt_indirect_buffers()
+{
+	m_rt_indirect_buffers.resize(m_swapchain_images.size());
+	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
+		create_buffer(sizeof(RTIndirectCommands), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					  m_rt_indirect_buffers[i]);
+	}
+}
+
+void BaseApplication::update_render_extent(bool raytraced, bool moved)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	const float frame_time = std::chrono::duration<float, std::chrono::seconds::period>(now - m_last_frame_time).count();
+	m_last_frame_time = now;
+	if (moved) {
+		m_last_camera_move = now;
+	}
+
+	const bool interactive = raytraced &&
+		std::chrono::duration<float, std::chrono::seconds::period>(now - m_last_camera_move).count() < RT_STATIC_DELAY;
+	if (!interactive) {
+		m_render_scale = 1.0f;
+	} else if (frame_time > 1.1f * RT_TARGET_FRAME_TIME || frame_time < 0.9f * RT_TARGET_FRAME_TIME) {
+		// the trace time follows the pixel count, the square of the scale. 
+		// half of the correction per frame keeps the frames in flight from making it oscillate
+		const float ratio = RT_TARGET_FRAME_TIME / std::max(frame_time, 1e-4f);
+		m_render_scale = std::clamp(m_render_scale * std::pow(ratio, 0.25f), RT_MIN_RENDER_SCALE, 1.0f);
+	}
+	// in steps of 1/32, so that small changes of the frame time keep the history at its resolution
+	const float scale = std::round(m_render_scale * 32.0f) / 32.0f;
+	m_render_extent.width = std::max(uint32_t(float(m_swapchain_extent.width) * scale), 1u);
+	m_render_extent.height = std::max(uint32_t(float(m_swapchain_extent.height) * scale), 1u);
+}
+
+void BaseApplication::read_rt_stats(uint32_t img_idx)
+{
+	// like the uniform buffer, the stats of this image are from the last time it was rendered,
+	// draw_frame() waited for that submission. each frame is read once, the epoch is set again
+	// when the image is submitted
+	const uint64_t epoch = m_rt_stats_epoch[img_idx];
+	if (epoch == 0) return;
+	m_rt_stats_epoch[img_idx] = 0;
+
+	RTFrameStats stats;
+	RTFrameStats *mapped;
+	auto res = vmaMapMemory(m_allocator, m_rt_stats_buffers[img_idx].alloc, (void**)&mapped);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map rt stats memory");
+	stats = *mapped;
+	vmaUnmapMemory(m_allocator, m_rt_stats_buffers[img_idx].alloc);
+
+	// path statistics
+	m_path_count += stats.paths;
+	m_path_segment_count += stats.path_segments;
+	m_shade_lanes += stats.shade_lanes;
+	m_shade_lane_slots += stats.shade_lane_slots;
+	m_sphere_tests += stats.sphere_tests;
+	m_wavefront_bounces = std::max(m_wavefront_bounces, stats.wavefront_bounces);
+	// the wavefront integrator records fewer bounces than max_depth when the paths end before.
+	// a path that would have continued past them was cut, the samples of that frame are
+	// discarded and all bounces are recorded again
+	if (stats.wavefront_cut > 0 && m_wavefront_depth < RT_WAVEFRONT_MAX_DEPTH) {
+		m_wavefront_depth = RT_WAVEFRONT_MAX_DEPTH;
+		m_wavefront_depth_fixed = true;
+		rerecord_rt_command_buffers();
+		on_accumulated_samples_reset();
+	}
+	auto now = std::chrono::high_resolution_clock::now();
+	const float period = std::chrono::duration<float, std::chrono::seconds::period>(now - m_path_stats_start).count();
+	if (period >= RT_PATH_STATS_PERIOD) {
+		const double avg_length = m_path_count ? double(m_path_segment_count) / double(m_path_count) : 0.0;
+		const double rate = double(m_path_count) / period * 1e-6;
+		fprintf(stdout, "average path length %.2f, %.2f Msamples/s", avg_length, rate);
+		if (m_sphere_stats) {
+			const double sphere_tests = m_path_segment_count ? double(m_sphere_tests) / double(m_path_segment_count) : 0.0;
+			fprintf(stdout, ", %.2f sphere tests per path segment", sphere_tests);
+		}
+		fprintf(stdout, ", russian roulette %s, %s", m_russian_roulette ? "on" : "off", RT_INTEGRATOR_NAMES[m_integrator]);
+		if (m_integrator == RT_INTEGRATOR_WAVEFRONT) {
+			fprintf(stdout, ", hit sorting %s, shade lane utilisation %.1f%%",
+				m_hit_sorting ? "on" : "off", m_shade_lane_slots ? 100.0 * double(m_shade_lanes) / double(m_shade_lane_slots) : 0.0);
+		}
+		fprintf(stdout, "\n");
+		if (m_benchmark_period >= 0) {
+			// the first period of each integrator includes the switch and is not counted
+			const int32_t p = m_benchmark_period % int32_t(RT_BENCHMARK_PERIODS);
+			if (p > 0) {
+				m_benchmark_rates[m_integrator] += rate / double(RT_BENCHMARK_PERIODS - 1);
+			}
+			++m_benchmark_period;
+			// the periods of an integrator follow the ones of the integrator before it
+			const uint32_t next = uint32_t(m_benchmark_period) / RT_BENCHMARK_PERIODS;
+			if (m_benchmark_period % int32_t(RT_BENCHMARK_PERIODS) == 0 && next < RT_INTEGRATOR_COUNT) {
+				set_integrator(next);
+				on_accumulated_samples_reset();
+			} else if (next == RT_INTEGRATOR_COUNT) {
+				const double base = m_benchmark_rates[RT_INTEGRATOR_MEGAKERNEL];
+				fprintf(stdout, "benchmark:");
+				for (uint32_t i = 0; i < RT_INTEGRATOR_COUNT; ++i) {
+					fprintf(stdout, " %s %.2f Msamples/s", RT_INTEGRATOR_NAMES[i], m_benchmark_rates[i]);
+					if (i != RT_INTEGRATOR_MEGAKERNEL && base > 0.0) {
+						fprintf(stdout, " (%.2fx megakernel)", m_benchmark_rates[i] / base);
+					}
+					fprintf(stdout, i + 1 < RT_INTEGRATOR_COUNT ? "," : "\n");
+				}
+				m_benchmark_period = -1;
+			}
+		}
+		// twice the deepest bounce of a whole period leaves room for the rare longer paths
+		if (m_integrator == RT_INTEGRATOR_WAVEFRONT && !m_wavefront_depth_fixed && m_wavefront_bounces > 0) {
+			const uint32_t depth = std::clamp(2 * m_wavefront_bounces, RT_WAVEFRONT_MIN_DEPTH, RT_WAVEFRONT_MAX_DEPTH);
+			if (depth < m_wavefront_depth) {
+				m_wavefront_depth = depth;
+				rerecord_rt_command_buffers();
+			}
+		}
+		m_wavefront_bounces = 0;
+		m_path_count = 0;
+		m_path_segment_count = 0;
+		m_shade_lanes = 0;
+		m_shade_lane_slots = 0;
+		m_sphere_tests = 0;
+		m_path_stats_start = now;
+	}
+
+	// time to target error
+	if (m_target_reported || epoch != m_accumulation_epoch) return;
+
+	// the render extent may have changed since that frame
+	const VkExtent2D extent = m_rt_stats_extent[img_idx];
+	const float active_fraction = float(stats.active_pixels) / float(extent.width * extent.height);
+	if (active_fraction > RT_TARGET_ACTIVE_FRACTION) return;
+
+	m_target_reported = true;
+	auto elapsed = now - m_accumulation_start;
+	fprintf(stdout, "target error %.3f reached after %.1f ms, %u samples per pixel at most, %s sampling\n",
+		m_target_error,
+		std::chrono::duration<float, std::chrono::milliseconds::period>(elapsed).count(),
+		m_samples_accumulated,
+		m_adaptive_sampling ? "adaptive" : "uniform");
+}
+
+// the spheres are stored as three streams. the blas build reads the aabbs, the intersection shader
+// and the ray queries read 16 bytes of center and radius per candidate and the shading fields are
+// only read for the closest hit. the old interleaved records made every candidate fetch 48 bytes
+void BaseApplication::create_sphere_buffer()
+{
+	const size_t count = m_sphere_primitives.size();
+	std::vector<VkAabbPositionsKHR> aabbs(count);
+	std::vector<glm::vec4> geometry(count);
+	std::vector<SphereShading> shading(count);
+	for (size_t i = 0; i < count; ++i) {
+		const SpherePrimitive &sph = m_sphere_primitives[i];
+		aabbs[i] = sph.bbox;
+		const glm::vec3 center = glm::vec3(sph.bbox.minX + sph.bbox.maxX, sph.bbox.minY + sph.bbox.maxY, sph.bbox.minZ + sph.bbox.maxZ) * 0.5f;
+		geometry[i] = glm::vec4(center, (sph.bbox.maxX - sph.bbox.minX) * 0.5f);
+		shading[i] = {};
+		shading[i].albedo = sph.albedo;
+		shading[i].material = sph.material;
+		shading[i].fuzz = sph.fuzz;
+	}
+
+	auto upload = [&](const void *src, VkDeviceSize bufsize, VkBufferUsageFlags usage, VmaBufferAllocation &dst) {
+		VmaBufferAllocation staging;
+		create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			staging);
+
+		void *data;
+		auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
+		if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
+		std::memcpy(data, src, bufsize);
+		vmaUnmapMemory(m_allocator, staging.alloc);
+
+		create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | usage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dst);
+		copy_buffer(staging.buffer, dst.buffer, bufsize);
+
+		vmaDestroyBuffer(m_allocator, staging.buffer, staging.alloc);
+	};
+	upload(aabbs.data(), sizeof(VkAabbPositionsKHR) * count,
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, m_sphere_aabbs);
+	upload(geometry.data(), sizeof(glm::vec4) * count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_sphere_geometry);
+	upload(shading.data(), sizeof(SphereShading) * count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_sphere_shading);
+}
+
+void BaseApplication::create_light_buffer()
 {
-	auto bufsize = sizeof(Vertex) * m_model_vertices.size();
-	
+	// light list of the emissive spheres with the cdf of their power, so the
+	// shaders pick a light with a binary search and bright lights get more samples
+	std::vector<LightSphere> lights;
+	float total_power = 0.0f;
+	for (const SpherePrimitive &sph : m_sphere_primitives) {
+		if (sph.material != materials::MaterialType::EMISSIVE) continue;
+		LightSphere light = {};
+		light.center = glm::vec3(sph.bbox.minX + sph.bbox.maxX, sph.bbox.minY + sph.bbox.maxY, sph.bbox.minZ + sph.bbox.maxZ) * 0.5f;
+		light.radius = (sph.bbox.maxX - sph.bbox.minX) * 0.5f;
+		light.emission = glm::vec3(sph.albedo);
+		const float power = light_power(light.emission, light.radius);
+		if (power <= 0.0f) continue;
+		total_power += power;
+		light.cdf = total_power;
+		lights.push_back(light);
+	}
+	for (auto &l : lights) {
+		l.cdf /= total_power;
+	}
+	if (!lights.empty()) {
+		lights.back().cdf = 1.0f;
+	}
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "%zu lights in the light list\n", lights.size());
+#endif
+
+	LightTableHeader header = {};
+	header.light_count = uint32_t(lights.size());
+	header.total_power = total_power;
+
+	// keep the buffer valid when there are no lights
+	auto bufsize = sizeof(LightTableHeader) + sizeof(LightSphere) * std::max<size_t>(lights.size(), 1);
+
 	VmaBufferAllocation staging;
 	create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-				  staging);
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		staging);
 
-	void *data;
-	auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
+	uint8_t *data;
+	auto res = vmaMapMemory(m_allocator, staging.alloc, (void**)&data);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
-	std::memcpy(data, m_model_vertices.data(), bufsize);
+	std::memset(data, 0, bufsize);
+	std::memcpy(data, &header, sizeof(header));
+	if (!lights.empty()) {
+		std::memcpy(data + sizeof(header), lights.data(), sizeof(LightSphere) * lights.size());
+	}
 	vmaUnmapMemory(m_allocator, staging.alloc);
 
-	create_buffer(bufsize, 
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | 
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | 
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertex_buffer);
-	copy_buffer(staging.buffer, m_vertex_buffer.buffer, bufsize);
+	create_buffer(bufsize,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_light_buffer);
+	copy_buffer(staging.buffer, m_light_buffer.buffer, bufsize);
 
 	vmaDestroyBuffer(m_allocator, staging.buffer, staging.alloc);
 }
 
-void BaseApplication::create_index_buffer()
+void BaseApplication::create_radiance_cache()
 {
-	VkDeviceSize bufsize = sizeof(uint32_t) * m_model_indices.size();
-	
+	create_buffer(sizeof(radiance_cache::Cell) * RT_RADIANCE_CACHE_CELLS,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_radiance_cache);
+	clear_radiance_cache();
+	if (m_rt_pipeline_supported) {
+		m_radiance_cache_age_pipeline = create_rt_compute_pipeline("radiance_cache_age.comp");
+	}
+}
+
+void BaseApplication::clear_radiance_cache()
+{
+	// the cache holds world space radiance, so it survives camera moves but not changes to the scene.
+	// the cells of the views the camera left age out on the gpu.
+	// the clear is recorded in front of the next frame, the frames in flight keep the old content
+	m_radiance_cache_clear_pending = true;
+}
+
+bool BaseApplication::pending_writes() const
+{
+	return m_radiance_cache_clear_pending || !m_pending_materials.empty();
+}
+
+void BaseApplication::record_pending_writes(VkCommandBuffer cmd_buf)
+{
+	if (m_radiance_cache_clear_pending) {
+		// the barriers order the clear after the frames before it and before the traces after it
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+		vkCmdFillBuffer(cmd_buf, m_radiance_cache.buffer, 0, VK_WHOLE_SIZE, 0);
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		m_radiance_cache_clear_pending = false;
+	}
+
+	if (!m_pending_materials.empty()) {
+		// the table is read by the hit shaders and the compute integrators
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+		// vkCmdUpdateBuffer copies the data into the command buffer, it is limited to 64KB per call
+		const VkDeviceSize bufsize = sizeof(materials::PBRMaterial) * m_pending_materials.size();
+		const VkDeviceSize max_update_size = 65536;
+		for (VkDeviceSize offset = 0; offset < bufsize; offset += max_update_size) {
+			const VkDeviceSize sz = std::min(max_update_size, bufsize - offset);
+			vkCmdUpdateBuffer(cmd_buf, m_material_buffer.buffer, offset, sz, reinterpret_cast<const uint8_t*>(m_pending_materials.data()) + offset);
+		}
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+		m_pending_materials.clear();
+	}
+}
+
+void BaseApplication::create_sampler_tables()
+{
+	SamplerTablesHeader header = {};
+	header.sobol_matrices = sampler_tables::sobol_matrices();
+	header.blue_noise_size = RT_BLUE_NOISE_SIZE;
+	const std::vector<float> blue_noise = sampler_tables::blue_noise_tile(RT_BLUE_NOISE_SIZE);
+
+	auto bufsize = sizeof(SamplerTablesHeader) + sizeof(float) * blue_noise.size();
+
 	VmaBufferAllocation staging;
 	create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-				  staging);
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		staging);
 
-	void *data;
-	auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
+	uint8_t *data;
+	auto res = vmaMapMemory(m_allocator, staging.alloc, (void**)&data);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
-	std::memcpy(data, m_model_indices.data(), bufsize);
+	std::memcpy(data, &header, sizeof(header));
+	std::memcpy(data + sizeof(header), blue_noise.data(), sizeof(float) * blue_noise.size());
 	vmaUnmapMemory(m_allocator, staging.alloc);
 
 	create_buffer(bufsize,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-		VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_index_buffer);
-	copy_buffer(staging.buffer, m_index_buffer.buffer, bufsize);
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_sampler_tables);
+	copy_buffer(staging.buffer, m_sampler_tables.buffer, bufsize);
 
 	vmaDestroyBuffer(m_allocator, staging.buffer, staging.alloc);
 }
 
-void BaseApplication::create_uniform_buffers()
+void BaseApplication::create_batch_resources()
 {
-	VkDeviceSize bufsize = sizeof(SceneUniforms);
-	m_uni_buffers.resize(m_swapchain_images.size());
+	// the batch images do not follow the swapchain, they live as long as the scene
+	create_image(RT_BATCH_WIDTH, RT_BATCH_HEIGHT, RT_ACCUMULATION_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_batch_img, RT_BATCH_VIEWS);
 
-	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
-		create_buffer(bufsize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-					  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					  m_uni_buffers[i]);
-	}
+	m_batch_img_view = vk_helpers::create_image_view_2d_array(m_device, m_batch_img.image, RT_ACCUMULATION_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, RT_BATCH_VIEWS);
+
+	VkImageSubresourceRange isr = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS };
+	auto cmd_buf = begin_single_time_commands(m_graphics_queue, m_graphics_cmd_pool);
+	vk_helpers::image_barrier(cmd_buf, m_batch_img.image, isr,
+		VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL);
+	end_single_time_commands(m_graphics_queue, m_graphics_cmd_pool, cmd_buf);
+
+	// written by the host before every batch
+	create_buffer(sizeof(BatchView) * RT_BATCH_VIEWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, m_batch_views);
 }
 
-void BaseApplication::create_sphere_buffer()
+void BaseApplication::create_geometry_buffers()
 {
-	auto bufsize = sizeof(SpherePrimitive) * m_sphere_primitives.size();
-	
+	// geometry table, one entry per model part in BLAS geometry order, then the ground
+	std::vector<GeometryInfo> geometries;
+	const VkDeviceAddress vertices_address = vk_helpers::get_buffer_address(m_device, m_vertex_buffer.buffer);
+	const VkDeviceAddress indices_address = vk_helpers::get_buffer_address(m_device, m_index_buffer.buffer);
+	for (const ModelPart &part : m_model_parts) {
+		GeometryInfo geom = {};
+		geom.vertices_ref = vertices_address + sizeof(Vertex)*part.vertex_offset;
+		geom.indices_ref = indices_address + sizeof(uint32_t)*part.index_offset;
+		geom.material_index = part.material_index;
+		geometries.push_back(geom);
+	}
+	{
+		// the ground instance is not transformed
+		GeometryInfo geom = {};
+		geom.vertices_ref = vertices_address + sizeof(Vertex)*m_ground_part.vertex_offset;
+		geom.indices_ref = indices_address + sizeof(uint32_t)*m_ground_part.index_offset;
+		geom.material_index = m_ground_part.material_index;
+		geom.flags = GEOMETRY_WORLD_SPACE;
+		geometries.push_back(geom);
+	}
+
+	auto bufsize = sizeof(GeometryInfo) * geometries.size();
+
 	VmaBufferAllocation staging;
 	create_buffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
 		staging);
-	
+
 	void *data;
 	auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
-	std::memcpy(data, m_sphere_primitives.data(), bufsize);
+	std::memcpy(data, geometries.data(), bufsize);
 	vmaUnmapMemory(m_allocator, staging.alloc);
 
 	create_buffer(bufsize,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_sphere_buffer);
-	copy_buffer(staging.buffer, m_sphere_buffer.buffer, bufsize);
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_geometry_buffer);
+	copy_buffer(staging.buffer, m_geometry_buffer.buffer, bufsize);
 
 	vmaDestroyBuffer(m_allocator, staging.buffer, staging.alloc);
+
+	// material table, written through update_material_buffer()
+	create_buffer(sizeof(materials::PBRMaterial) * m_materials.size(),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_material_buffer);
+	update_material_buffer();
+}
+
+void BaseApplication::update_material_buffer()
+{
+	std::vector<materials::PBRMaterial> mats = m_materials;
+	if (m_clay_materials) {
+		for (auto &m : mats) {
+			m.albedo = glm::vec4(glm::vec3(0.7f), 1.0f);
+			m.metallic = 0.0f;
+			m.roughness = 1.0f;
+		}
+	}
+
+	// written in front of the next frame, the frames in flight keep the old table
+	m_pending_materials = std::move(mats);
+}
+
+void BaseApplication::on_toggle_throughput_mode()
+{
+	m_throughput_mode = !m_throughput_mode;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "throughput mode %s\n", m_throughput_mode ? "on" : "off");
+#endif
+}
+
+void BaseApplication::on_samples_per_launch_changed(bool increase)
+{
+	if (increase) {
+		m_samples_per_launch = std::min(m_samples_per_launch * 2, RT_MAX_SAMPLES_PER_LAUNCH);
+	} else {
+		m_samples_per_launch = std::max(m_samples_per_launch / 2, 1u);
+	}
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "samples per launch %u\n", m_samples_per_launch);
+#endif
+}
+
+void BaseApplication::on_toggle_adaptive_sampling()
+{
+	m_adaptive_sampling = !m_adaptive_sampling;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "adaptive sampling %s\n", m_adaptive_sampling ? "on" : "off");
+#endif
+}
+
+void BaseApplication::on_toggle_russian_roulette()
+{
+	m_russian_roulette = !m_russian_roulette;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "russian roulette %s\n", m_russian_roulette ? "on" : "off");
+#endif
+}
+
+void BaseApplication::on_toggle_next_event_estimation()
+{
+	m_next_event_estimation = !m_next_event_estimation;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "next event estimation %s\n", m_next_event_estimation ? "on" : "off");
+#endif
+}
+
+void BaseApplication::on_toggle_restir()
+{
+	m_restir = !m_restir;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "restir direct light %s\n", m_restir ? "on" : "off");
+#endif
+}
+
+void BaseApplication::on_radiance_cache_mode_changed()
+{
+	m_radiance_cache_mode = (m_radiance_cache_mode + 1) % 3;
+#if defined(ENABLE_DEBUG_MARKERS)
+	static const char *names[] = { "off", "on", "occupancy view" };
+	fprintf(stdout, "radiance cache %s\n", names[m_radiance_cache_mode]);
+#endif
+}
+
+void BaseApplication::on_sampler_changed()
+{
+	m_sampler = (m_sampler + 1) % RT_SAMPLER_COUNT;
+#if defined(ENABLE_DEBUG_MARKERS)
+	static const char *names[] = { "random", "sobol", "blue noise" };
+	fprintf(stdout, "%s sampler\n", names[m_sampler]);
+#endif
+}
+
+void BaseApplication::on_toggle_denoiser()
+{
+	m_denoiser = !m_denoiser;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "denoiser %s\n", m_denoiser ? "on" : "off");
+#endif
+}
+
+void BaseApplication::on_integrator_changed()
+{
+	uint32_t integrator = (m_integrator + 1) % RT_INTEGRATOR_COUNT;
+	if (integrator == RT_INTEGRATOR_MEGAKERNEL && !m_rt_pipeline_supported) {
+		integrator++;
+	}
+	set_integrator(integrator);
+}
+
+void BaseApplication::on_benchmark_started()
+{
+	// the integrators trace the same scene from an empty accumulation, one after the other
+	if (!rt_commands_ready()) {
+		fprintf(stdout, "the raytracing pipeline is not ready, no benchmark\n");
+		return;
+	}
+	fprintf(stdout, "benchmarking the integrators, %.0f s each\n", RT_BENCHMARK_PERIODS * RT_PATH_STATS_PERIOD);
+	const uint32_t first = m_rt_pipeline_supported ? RT_INTEGRATOR_MEGAKERNEL : RT_INTEGRATOR_WAVEFRONT;
+	m_raytraced = true;
+	m_benchmark_period = int32_t(first * RT_BENCHMARK_PERIODS);
+	m_benchmark_rates.fill(0.0);
+	set_integrator(first);
+}
+
+void BaseApplication::set_integrator(uint32_t integrator)
+{
+	if (integrator == RT_INTEGRATOR_WAVEFRONT && !m_wavefront_pipelines[0]) {
+		create_wavefront_pipelines();
+	} else if (integrator == RT_INTEGRATOR_RAY_QUERY && !m_ray_query_pipeline) {
+		m_ray_query_pipeline = create_rt_compute_pipeline("pathtrace.comp");
+	}
+	m_integrator = integrator;
+	m_wavefront_depth = RT_WAVEFRONT_MAX_DEPTH;
+	m_wavefront_depth_fixed = false;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "%s integrator%s\n", RT_INTEGRATOR_NAMES[m_integrator],
+		m_integrator == RT_INTEGRATOR_WAVEFRONT ? ", one sample per pixel per launch" : "");
+#endif
+	rerecord_rt_command_buffers();
+}
+
+void BaseApplication::on_toggle_hit_sorting()
+{
+	m_hit_sorting = !m_hit_sorting;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "hit sorting %s%s\n", m_hit_sorting ? "on" : "off",
+		m_integrator == RT_INTEGRATOR_WAVEFRONT ? "" : ", it applies to the wavefront integrator");
+#endif
+	rerecord_rt_command_buffers();
+}
+
+void BaseApplication::on_toggle_raster_primary()
+{
+	m_raster_primary = !m_raster_primary;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "rasterized primary visibility %s%s\n", m_raster_primary ? "on" : "off",
+		m_integrator == RT_INTEGRATOR_MEGAKERNEL ? "" : ", it applies to the megakernel integrator");
+#endif
+	rerecord_rt_command_buffers();
+}
+
+// tonemapping of resolve.frag, keep the two in sync
+static glm::vec3 tonemap_aces(glm::vec3 x)
+{
+	const float a = 2.51f;
+	const float b = 0.03f;
+	const float c = 2.43f;
+	const float d = 0.59f;
+	const float e = 0.14f;
+	return glm::clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0f, 1.0f);
+}
+
+static float linear_to_srgb(float c)
+{
+	return c > 0.0031308f ? 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f : 12.92f * c;
+}
+
+// binary ppm of a layer of an rgba32f image
+static void write_ppm(const std::string &filename, const glm::vec4 *pixels, uint32_t width, uint32_t height, float exposure)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file: " + filename);
+	}
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<uint8_t> row(3 * width);
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			const glm::vec3 c = tonemap_aces(glm::vec3(pixels[y * width + x]) * std::exp2(exposure));
+			for (int k = 0; k < 3; ++k) {
+				row[3 * x + k] = uint8_t(std::lround(linear_to_srgb(c[k]) * 255.0f));
+			}
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+}
+
+void BaseApplication::on_batch_render_requested()
+{
+	if (!m_rt_pipeline) {
+		fprintf(stdout, "batch rendering needs the rt pipeline\n");
+		return;
+	}
+	// the batch reuses the descriptor set and the scene uniforms of the first swapchain image
+	vkDeviceWaitIdle(m_device);
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// turntable around the up axis of the scene, the first view is the current camera
+	const glm::mat4 view = m_camera.get_view_matrix();
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), float(RT_BATCH_WIDTH) / float(RT_BATCH_HEIGHT), 0.1f, 10.0f);
+	proj[1][1] *= -1;
+	std::array<BatchView, RT_BATCH_VIEWS> views;
+	for (uint32_t v = 0; v < RT_BATCH_VIEWS; ++v) {
+		const float angle = glm::two_pi<float>() * float(v) / float(RT_BATCH_VIEWS);
+		views[v].iview = glm::inverse(view * glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+		views[v].iproj = glm::inverse(proj);
+	}
+	void *data;
+	auto res = vmaMapMemory(m_allocator, m_batch_views.alloc, &data);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
+	std::memcpy(data, views.data(), sizeof(BatchView) * views.size());
+	vmaUnmapMemory(m_allocator, m_batch_views.alloc);
+
+	const VkDeviceSize layer_pixels = VkDeviceSize(RT_BATCH_WIDTH) * RT_BATCH_HEIGHT;
+	const VkDeviceSize readback_size = sizeof(glm::vec4) * layer_pixels * RT_BATCH_VIEWS;
+	VmaBufferAllocation readback;
+	create_buffer(readback_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, readback);
+
+	auto cmd_buf = begin_single_time_commands(m_graphics_queue, m_graphics_cmd_pool);
+	record_pending_writes(cmd_buf);
+	vk_helpers::debug_marker_push(cmd_buf, "Batch");
+	bind_rt_pipeline(cmd_buf, m_rt_desc_sets[0]);
+
+	using Region = ShaderBindingTableBuilder::Region;
+	const VkStridedDeviceAddressRegionKHR raygen_region = m_rt_sbt_layout->region(Region::Raygen, m_rt_sbt_address);
+	const VkStridedDeviceAddressRegionKHR miss_region = m_rt_sbt_layout->region(Region::Miss, m_rt_sbt_address);
+	const VkStridedDeviceAddressRegionKHR hitgroup_region = m_rt_sbt_layout->region(Region::Hit, m_rt_sbt_address);
+	const VkStridedDeviceAddressRegionKHR callable_region = m_rt_sbt_layout->region(Region::Callable, m_rt_sbt_address);
+	// every dispatch traces all views, the pipeline is bound once and the views share the caches of the acceleration structures
+	for (uint32_t d = 0; d < RT_BATCH_DISPATCHES; ++d) {
+		if (d > 0) {
+			vk_helpers::memory_barrier(cmd_buf,
+				VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+				VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		}
+		RTPushConstants pc = {};
+		pc.batch_samples = RT_BATCH_SAMPLES_PER_DISPATCH;
+		pc.batch_samples_before = d * RT_BATCH_SAMPLES_PER_DISPATCH;
+		vkCmdPushConstants(cmd_buf, m_rt_pipeline_layout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(RTPushConstants), &pc);
+		vkCmdTraceRaysKHR(cmd_buf, &raygen_region, &miss_region, &hitgroup_region, &callable_region,
+			RT_BATCH_WIDTH, RT_BATCH_HEIGHT, RT_BATCH_VIEWS);
+	}
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, RT_BATCH_VIEWS };
+	region.imageExtent = { RT_BATCH_WIDTH, RT_BATCH_HEIGHT, 1 };
+	vkCmdCopyImageToBuffer(cmd_buf, m_batch_img.image, VK_IMAGE_LAYOUT_GENERAL, readback.buffer, 1, &region);
+	// the next batch overwrites the images, they go back to the raygen
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_NONE_KHR,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+	vk_helpers::debug_marker_pop(cmd_buf, "Batch");
+	end_single_time_commands(m_graphics_queue, m_graphics_cmd_pool, cmd_buf);
+
+	const float trace_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	res = vmaMapMemory(m_allocator, readback.alloc, &data);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
+	const glm::vec4 *pixels = static_cast<const glm::vec4*>(data);
+	for (uint32_t v = 0; v < RT_BATCH_VIEWS; ++v) {
+		const std::string filename = "batch_view_" + std::to_string(v) + ".ppm";
+		write_ppm(filename, pixels + v * layer_pixels, RT_BATCH_WIDTH, RT_BATCH_HEIGHT, m_exposure);
+	}
+	vmaUnmapMemory(m_allocator, readback.alloc);
+	vmaDestroyBuffer(m_allocator, readback.buffer, readback.alloc);
+
+	fprintf(stdout, "batch of %u views at %ux%u, %u samples per pixel, traced in %.1f ms, written to batch_view_*.ppm\n",
+		RT_BATCH_VIEWS, RT_BATCH_WIDTH, RT_BATCH_HEIGHT, RT_BATCH_DISPATCHES * RT_BATCH_SAMPLES_PER_DISPATCH, trace_ms);
+}
+
+void BaseApplication::on_toggle_transparent_shadows()
+{
+	m_transparent_shadows = !m_transparent_shadows;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "model parts without shadows %s\n", m_transparent_shadows ? "cast shadows anyway" : "are masked out of the shadow rays");
+#endif
+	// the cached radiance was gathered with the other shadows
+	clear_radiance_cache();
+}
+
+void BaseApplication::on_toggle_sphere_stats()
+{
+	m_sphere_stats = !m_sphere_stats;
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "sphere test counting %s\n", m_sphere_stats ? "on" : "off");
+#endif
+	// the period mixes frames with and without the counter otherwise
+	m_path_count = 0;
+	m_path_segment_count = 0;
+	m_shade_lanes = 0;
+	m_shade_lane_slots = 0;
+	m_sphere_tests = 0;
+	m_wavefront_bounces = 0;
+	m_path_stats_start = std::chrono::high_resolution_clock::now();
+}
+
+// shadow ray throughput as occlusion queries against tracing to the closest hit, both modes trace the
+// same rays from the primary hits of the current camera. the time of the primary rays alone is subtracted
+void BaseApplication::on_shadow_benchmark_started()
+{
+	if (!m_rt_pipeline) {
+		fprintf(stdout, "the shadow benchmark needs the rt pipeline\n");
+		return;
+	}
+	// the launches of a mode are timed on the gpu, between a timestamp before the first and one after the last.
+	// the wall clock around the submission would add the submit and the wait to the short launches
+	VkPhysicalDeviceProperties gpu_props;
+	vkGetPhysicalDeviceProperties(m_gpu, &gpu_props);
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_gpu, &family_count, nullptr);
+	std::vector<VkQueueFamilyProperties> families(family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_gpu, &family_count, families.data());
+	const uint32_t timestamp_bits = families[find_queue_families(m_gpu).graphics_family.value()].timestampValidBits;
+	if (timestamp_bits == 0) {
+		fprintf(stdout, "the shadow benchmark needs timestamp queries on the graphics queue\n");
+		return;
+	}
+	const uint64_t timestamp_mask = timestamp_bits >= 64 ? ~0ull : (1ull << timestamp_bits) - 1ull;
+
+	// like the batch, the launches use the descriptor set and the scene uniforms of the first swapchain image
+	vkDeviceWaitIdle(m_device);
+
+	// the launches count their shadow rays in the frame statistics of the first image. the primary rays
+	// count in its other fields, so the statistics of its last frame are dropped
+	m_rt_stats_epoch[0] = 0;
+	RTFrameStats *stats;
+	auto res = vmaMapMemory(m_allocator, m_rt_stats_buffers[0].alloc, (void**)&stats);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map rt stats memory");
+
+	using Region = ShaderBindingTableBuilder::Region;
+	const VkStridedDeviceAddressRegionKHR raygen_region = m_rt_sbt_layout->region(Region::Raygen, m_rt_sbt_address);
+	const VkStridedDeviceAddressRegionKHR miss_region = m_rt_sbt_layout->region(Region::Miss, m_rt_sbt_address);
+	const VkStridedDeviceAddressRegionKHR hitgroup_region = m_rt_sbt_layout->region(Region::Hit, m_rt_sbt_address);
+	const VkStridedDeviceAddressRegionKHR callable_region = m_rt_sbt_layout->region(Region::Callable, m_rt_sbt_address);
+
+	VkQueryPool query_pool;
+	VkQueryPoolCreateInfo qpci = {};
+	qpci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	qpci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	qpci.queryCount = 2 * RT_SHADOW_BENCHMARK_COUNT;
+	res = vkCreateQueryPool(m_device, &qpci, nullptr, &query_pool);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to create timestamp query pool");
+
+	std::array<double, RT_SHADOW_BENCHMARK_COUNT> seconds{};
+	std::array<uint32_t, RT_SHADOW_BENCHMARK_COUNT> rays{};
+	for (uint32_t mode = RT_SHADOW_BENCHMARK_PRIMARY; mode < RT_SHADOW_BENCHMARK_COUNT; ++mode) {
+		stats->shadow_rays = 0;
+		auto cmd_buf = begin_single_time_commands(m_graphics_queue, m_graphics_cmd_pool);
+		// only the first launches have writes in front of them, before the timestamps
+		record_pending_writes(cmd_buf);
+		vk_helpers::debug_marker_push(cmd_buf, "Shadow benchmark");
+		bind_rt_pipeline(cmd_buf, m_rt_desc_sets[0]);
+		vkCmdResetQueryPool(cmd_buf, query_pool, 2 * mode, 2);
+		vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 2 * mode);
+		for (uint32_t d = 0; d < RT_SHADOW_BENCHMARK_DISPATCHES; ++d) {
+			RTPushConstants pc = {};
+			pc.batch_samples_before = d;
+			pc.shadow_benchmark = mode;
+			vkCmdPushConstants(cmd_buf, m_rt_pipeline_layout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(RTPushConstants), &pc);
+			vkCmdTraceRaysKHR(cmd_buf, &raygen_region, &miss_region, &hitgroup_region, &callable_region,
+				RT_BATCH_WIDTH, RT_BATCH_HEIGHT, 1);
+		}
+		vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 2 * mode + 1);
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR);
+		vk_helpers::debug_marker_pop(cmd_buf, "Shadow benchmark");
+		end_single_time_commands(m_graphics_queue, m_graphics_cmd_pool, cmd_buf);
+
+		uint64_t timestamps[2] = {};
+		res = vkGetQueryPoolResults(m_device, query_pool, 2 * mode, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		if (res != VK_SUCCESS) throw std::runtime_error("failed to read the shadow benchmark timestamps");
+		const uint64_t ticks = (timestamps[1] - timestamps[0]) & timestamp_mask;
+		seconds[mode] = double(ticks) * double(gpu_props.limits.timestampPeriod) * 1e-9;
+		rays[mode] = stats->shadow_rays;
+	}
+	vkDestroyQueryPool(m_device, query_pool, nullptr);
+	vmaUnmapMemory(m_allocator, m_rt_stats_buffers[0].alloc);
+
+	fprintf(stdout, "shadow benchmark, %u shadow rays in %u launches at %ux%u, gpu time of the primary rays %.1f ms\n",
+		rays[RT_SHADOW_BENCHMARK_OCCLUSION], RT_SHADOW_BENCHMARK_DISPATCHES, RT_BATCH_WIDTH, RT_BATCH_HEIGHT,
+		seconds[RT_SHADOW_BENCHMARK_PRIMARY] * 1e3);
+	std::array<double, RT_SHADOW_BENCHMARK_COUNT> rates{};
+	for (uint32_t mode = RT_SHADOW_BENCHMARK_OCCLUSION; mode < RT_SHADOW_BENCHMARK_COUNT; ++mode) {
+		const double shadow_seconds = std::max(seconds[mode] - seconds[RT_SHADOW_BENCHMARK_PRIMARY], 1e-6);
+		rates[mode] = double(rays[mode]) / shadow_seconds * 1e-6;
+		fprintf(stdout, "  %-16s %.1f ms, %.1f Mrays/s\n", RT_SHADOW_BENCHMARK_NAMES[mode], shadow_seconds * 1e3, rates[mode]);
+	}
+	if (rates[RT_SHADOW_BENCHMARK_CLOSEST_HIT] > 0.0) {
+		fprintf(stdout, "  occlusion queries at %.2fx the closest hit rate\n",
+			rates[RT_SHADOW_BENCHMARK_OCCLUSION] / rates[RT_SHADOW_BENCHMARK_CLOSEST_HIT]);
+	}
+}
+
+void BaseApplication::rerecord_rt_command_buffers()
+{
+	if (!rt_commands_ready()) return;
+
+	// the frames in flight keep their command buffers until they are done
+	std::vector<VkCommandBuffer> old_cmd_buffers = std::move(m_rt_cmd_buffers);
+	old_cmd_buffers.insert(old_cmd_buffers.end(), m_rt_throughput_cmd_buffers.begin(), m_rt_throughput_cmd_buffers.end());
+	if (!old_cmd_buffers.empty()) {
+		m_deletion_queue.push(m_frame_count + MAX_FRAMES_IN_FLIGHT, [this, old_cmd_buffers]() {
+			vkFreeCommandBuffers(m_device, m_graphics_cmd_pool, uint32_t(old_cmd_buffers.size()), old_cmd_buffers.data());
+		});
+	}
+	m_rt_cmd_buffers.clear();
+	m_rt_throughput_cmd_buffers.clear();
+	create_rt_command_buffers();
+	m_path_count = 0;
+	m_path_segment_count = 0;
+	m_shade_lanes = 0;
+	m_shade_lane_slots = 0;
+	m_sphere_tests = 0;
+	m_wavefront_bounces = 0;
+	m_path_stats_start = std::chrono::high_resolution_clock::now();
+}
+
+void BaseApplication::on_toggle_clay_materials()
+{
+	// material edits are a buffer write, the sbt and the rt command buffers stay as they are
+	m_clay_materials = !m_clay_materials;
+	update_material_buffer();
+	clear_radiance_cache();
 }
 
-void BaseApplication::create_bottom_acceleration_structure()
+// one geometry per part
+void BaseApplication::create_bottom_acceleration_structure(const ModelPart *parts, uint32_t part_count, ASBuffers &as)
 {
+	if (part_count == 0) return;
     std::vector<VkAccelerationStructureGeometryKHR> geometries;
     std::vector<uint32_t> max_primitive_counts;
-    for (const ModelPart &part : m_model_parts) {
+    for (uint32_t p = 0; p < part_count; ++p) {
+        const ModelPart &part = parts[p];
         VkAccelerationStructureGeometryKHR geom = {};
         geom.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
         geom.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
@@ -2157,19 +4283,19 @@ void BaseApplication::create_bottom_acceleration_structure()
 	// create all the necessary buffers
 	// structure buffer
 	create_buffer(sizes.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_bottom_as.structure_buffer);
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, as.structure_buffer);
 	// scratch buffer
 	create_buffer(sizes.buildScratchSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_bottom_as.scratch_buffer, scratch_alignment);
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, as.scratch_buffer, scratch_alignment);
 
 	VkAccelerationStructureCreateInfoKHR ci = {};
 	ci.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-	ci.buffer = m_bottom_as.structure_buffer.buffer;
+	ci.buffer = as.structure_buffer.buffer;
 	ci.offset = 0;
 	ci.size = sizes.accelerationStructureSize;
 	ci.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
 
-	auto res = vkCreateAccelerationStructureKHR(m_device, &ci, nullptr, &m_bottom_as.structure);
+	auto res = vkCreateAccelerationStructureKHR(m_device, &ci, nullptr, &as.structure);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to create acceleration structure");
 	
 	// build as
@@ -2181,12 +4307,13 @@ void BaseApplication::create_bottom_acceleration_structure()
         geom_trias.transformData.deviceAddress = 0;
     }
 	build_info.srcAccelerationStructure = VK_NULL_HANDLE;
-	build_info.dstAccelerationStructure = m_bottom_as.structure;
-	build_info.scratchData.deviceAddress = vk_helpers::get_buffer_address(m_device, m_bottom_as.scratch_buffer.buffer);
+	build_info.dstAccelerationStructure = as.structure;
+	build_info.scratchData.deviceAddress = vk_helpers::get_buffer_address(m_device, as.scratch_buffer.buffer);
 
     // fill all geometry build ranges
     std::vector<VkAccelerationStructureBuildRangeInfoKHR> geom_ranges;
-    for (const ModelPart &part : m_model_parts) {
+    for (uint32_t p = 0; p < part_count; ++p) {
+        const ModelPart &part = parts[p];
         VkAccelerationStructureBuildRangeInfoKHR range = {};
         range.firstVertex = part.vertex_offset;
         range.primitiveCount = part.index_count/3;
@@ -2212,7 +4339,7 @@ void BaseApplication::create_bottom_acceleration_structure_spheres()
 
 	VkAccelerationStructureGeometryAabbsDataKHR& geom_aabbs = geom.geometry.aabbs;
 	geom_aabbs.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR;
-	geom_aabbs.stride = sizeof(SpherePrimitive);
+	geom_aabbs.stride = sizeof(VkAabbPositionsKHR);
 	// for now 
 	geom_aabbs.data.deviceAddress = 0;
 
@@ -2260,7 +4387,7 @@ void BaseApplication::create_bottom_acceleration_structure_spheres()
 
 	// build as
 	// fill all the addresses needed
-	geom_aabbs.data.deviceAddress = vk_helpers::get_buffer_address(m_device, m_sphere_buffer.buffer) + offsetof(SpherePrimitive, bbox);
+	geom_aabbs.data.deviceAddress = vk_helpers::get_buffer_address(m_device, m_sphere_aabbs.buffer);
 	build_info.srcAccelerationStructure = VK_NULL_HANDLE;
 	build_info.dstAccelerationStructure = m_bottom_as_spheres.structure;
 	build_info.scratchData.deviceAddress = vk_helpers::get_buffer_address(m_device, m_bottom_as_spheres.scratch_buffer.buffer);
@@ -2283,6 +4410,56 @@ void BaseApplication::create_bottom_acceleration_structure_spheres()
 
 void BaseApplication::create_top_acceleration_structure()
 {
+	std::vector<VkAccelerationStructureInstanceKHR> instances;
+	{
+		// model, one instance per model BLAS
+		glm::mat4 transform = m_model_tranformation;
+		transform = glm::transpose(transform);
+		VkAccelerationStructureInstanceKHR instance = {};
+		memcpy(&instance.transform, &transform[0][0], sizeof(float) * 12);
+		instance.flags = 0;
+		instance.instanceShaderBindingTableRecordOffset = 0;
+		if (m_bottom_as.structure) {
+			instance.instanceCustomIndex = 0; // first entry of the model in the geometry table
+			instance.mask = RT_INSTANCE_MASK_MODEL;
+			instance.accelerationStructureReference = vk_helpers::get_acceleration_structure_address(m_device, m_bottom_as.structure);
+			instances.push_back(instance);
+		}
+		if (m_bottom_as_no_shadows.structure) {
+			// the parts that do not cast shadows follow the others in the geometry table
+			instance.instanceCustomIndex = m_shadow_part_count;
+			instance.mask = RT_INSTANCE_MASK_MODEL_NO_SHADOWS;
+			instance.accelerationStructureReference = vk_helpers::get_acceleration_structure_address(m_device, m_bottom_as_no_shadows.structure);
+			instances.push_back(instance);
+		}
+	}
+	{
+		// spheres
+		glm::mat4 transform = glm::mat4(1.0f);
+		transform = glm::transpose(transform);
+		VkAccelerationStructureInstanceKHR instance = {};
+		memcpy(&instance.transform, &transform[0][0], sizeof(float) * 12);
+		instance.instanceCustomIndex = 1;
+		instance.mask = RT_INSTANCE_MASK_SPHERES;
+		instance.flags = 0;
+		instance.instanceShaderBindingTableRecordOffset = 2; // all model geometries share the shade/shadow records of the first instance
+		instance.accelerationStructureReference = vk_helpers::get_acceleration_structure_address(m_device, m_bottom_as_spheres.structure);
+		instances.push_back(instance);
+	}
+	{
+		// ground, with its own hit records after the spheres
+		glm::mat4 transform = glm::mat4(1.0f);
+		transform = glm::transpose(transform);
+		VkAccelerationStructureInstanceKHR instance = {};
+		memcpy(&instance.transform, &transform[0][0], sizeof(float) * 12);
+		instance.instanceCustomIndex = uint32_t(m_model_parts.size()); // after the model parts in the geometry table
+		instance.mask = RT_INSTANCE_MASK_GROUND;
+		instance.flags = 0;
+		instance.instanceShaderBindingTableRecordOffset = 4;
+		instance.accelerationStructureReference = vk_helpers::get_acceleration_structure_address(m_device, m_bottom_as_ground.structure);
+		instances.push_back(instance);
+	}
+
 	VkAccelerationStructureGeometryKHR geom = {};
 	geom.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
 	geom.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
@@ -2306,7 +4483,7 @@ void BaseApplication::create_top_acceleration_structure()
 	build_info.dstAccelerationStructure = VK_NULL_HANDLE;
 	build_info.scratchData.deviceAddress = 0;
 
-	const uint32_t max_primitive_counts[1] = { 2 };
+	const uint32_t max_primitive_counts[1] = { uint32_t(instances.size()) };
 
 	// get the needed sizes for the buffers
 	VkAccelerationStructureBuildSizesInfoKHR sizes = {};
@@ -2344,34 +4521,10 @@ void BaseApplication::create_top_acceleration_structure()
 			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
 			staging);
 
-		VkAccelerationStructureInstanceKHR* instance_ptr;
-		auto res = vmaMapMemory(m_allocator, staging.alloc, (void**)&instance_ptr);
-		if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
-		
-		{
-			// model
-			glm::mat4 transform = m_model_tranformation;
-			transform = glm::transpose(transform);
-			memcpy(&instance_ptr->transform, &transform[0][0], sizeof(float) * 12);
-			instance_ptr->instanceCustomIndex = 0;
-			instance_ptr->mask = 0xFF;
-			instance_ptr->flags = 0;
-			instance_ptr->instanceShaderBindingTableRecordOffset = 0;
-			instance_ptr->accelerationStructureReference = vk_helpers::get_acceleration_structure_address(m_device, m_bottom_as.structure);
-		}
-		instance_ptr++;
-		{
-			// spheres
-			glm::mat4 transform = glm::mat4(1.0f);
-			transform = glm::transpose(transform);
-			memcpy(&instance_ptr->transform, &transform[0][0], sizeof(float) * 12);
-			instance_ptr->instanceCustomIndex = 1;
-			instance_ptr->mask = 0xFF;
-			instance_ptr->flags = 0;
-			instance_ptr->instanceShaderBindingTableRecordOffset = m_model_parts.size()*2; // here we set 2 because we have shade/shadow shaders for the first instance
-			instance_ptr->accelerationStructureReference = vk_helpers::get_acceleration_structure_address(m_device, m_bottom_as_spheres.structure);;
-		}
-
+		void *data;
+		auto res = vmaMapMemory(m_allocator, staging.alloc, &data);
+		if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
+		memcpy(data, instances.data(), instances_size);
 		vmaUnmapMemory(m_allocator, staging.alloc);
 
 		const uint32_t instances_alignment = 16;
@@ -2414,26 +4567,176 @@ void BaseApplication::create_raytracing_pipeline_layout()
 	lb_0.binding = 0;
 	lb_0.descriptorCount = 1;
 	lb_0.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-	lb_0.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+	lb_0.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
 	lb_0.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding lb_1 = {};
 	lb_1.binding = 1;
 	lb_1.descriptorCount = 1;
 	lb_1.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	lb_1.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	lb_1.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
 	lb_1.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding lb_2;
 	lb_2.binding = 2;
 	lb_2.descriptorCount = 1;
 	lb_2.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	lb_2.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+	lb_2.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_INTERSECTION_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
 	lb_2.pImmutableSamplers = nullptr;
 
-	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {
-		lb_0, lb_1, lb_2
+	// geometry table
+	VkDescriptorSetLayoutBinding lb_3 = {};
+	lb_3.binding = 3;
+	lb_3.descriptorCount = 1;
+	lb_3.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_3.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_3.pImmutableSamplers = nullptr;
+
+	// material table
+	VkDescriptorSetLayoutBinding lb_4 = {};
+	lb_4.binding = 4;
+	lb_4.descriptorCount = 1;
+	lb_4.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_4.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_4.pImmutableSamplers = nullptr;
+
+	// luminance moments
+	VkDescriptorSetLayoutBinding lb_5 = {};
+	lb_5.binding = 5;
+	lb_5.descriptorCount = 1;
+	lb_5.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_5.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_5.pImmutableSamplers = nullptr;
+
+	// frame stats
+	VkDescriptorSetLayoutBinding lb_6 = {};
+	lb_6.binding = 6;
+	lb_6.descriptorCount = 1;
+	lb_6.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_6.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_INTERSECTION_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_6.pImmutableSamplers = nullptr;
+
+	// light list
+	VkDescriptorSetLayoutBinding lb_7 = {};
+	lb_7.binding = 7;
+	lb_7.descriptorCount = 1;
+	lb_7.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_7.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_7.pImmutableSamplers = nullptr;
+
+	// light reservoirs
+	VkDescriptorSetLayoutBinding lb_8 = {};
+	lb_8.binding = 8;
+	lb_8.descriptorCount = 1;
+	lb_8.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_8.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	lb_8.pImmutableSamplers = nullptr;
+
+	// radiance cache
+	VkDescriptorSetLayoutBinding lb_9 = {};
+	lb_9.binding = 9;
+	lb_9.descriptorCount = 1;
+	lb_9.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_9.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_9.pImmutableSamplers = nullptr;
+
+	// sampler tables
+	VkDescriptorSetLayoutBinding lb_10 = {};
+	lb_10.binding = 10;
+	lb_10.descriptorCount = 1;
+	lb_10.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_10.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_10.pImmutableSamplers = nullptr;
+
+	// primary surfaces
+	VkDescriptorSetLayoutBinding lb_11 = {};
+	lb_11.binding = 11;
+	lb_11.descriptorCount = 1;
+	lb_11.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_11.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_11.pImmutableSamplers = nullptr;
+
+	// primary albedo
+	VkDescriptorSetLayoutBinding lb_12 = {};
+	lb_12.binding = 12;
+	lb_12.descriptorCount = 1;
+	lb_12.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_12.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_12.pImmutableSamplers = nullptr;
+
+	// sphere centers and radii, the wavefront passes do not see the shader records
+	VkDescriptorSetLayoutBinding lb_13 = {};
+	lb_13.binding = 13;
+	lb_13.descriptorCount = 1;
+	lb_13.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_13.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_13.pImmutableSamplers = nullptr;
+
+	// wavefront state
+	VkDescriptorSetLayoutBinding lb_14 = {};
+	lb_14.binding = 14;
+	lb_14.descriptorCount = 1;
+	lb_14.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_14.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_14.pImmutableSamplers = nullptr;
+
+	// wavefront queues
+	VkDescriptorSetLayoutBinding lb_15 = {};
+	lb_15.binding = 15;
+	lb_15.descriptorCount = 1;
+	lb_15.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_15.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_15.pImmutableSamplers = nullptr;
+
+	// keys and histograms of the hit sort
+	VkDescriptorSetLayoutBinding lb_16 = {};
+	lb_16.binding = 16;
+	lb_16.descriptorCount = 1;
+	lb_16.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_16.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_16.pImmutableSamplers = nullptr;
+
+	// rasterized primary visibility
+	VkDescriptorSetLayoutBinding lb_17 = {};
+	lb_17.binding = 17;
+	lb_17.descriptorCount = 1;
+	lb_17.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_17.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	lb_17.pImmutableSamplers = nullptr;
+
+	// cameras of the batch views
+	VkDescriptorSetLayoutBinding lb_18 = {};
+	lb_18.binding = 18;
+	lb_18.descriptorCount = 1;
+	lb_18.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_18.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	lb_18.pImmutableSamplers = nullptr;
+
+	// batch images
+	VkDescriptorSetLayoutBinding lb_19 = {};
+	lb_19.binding = 19;
+	lb_19.descriptorCount = 1;
+	lb_19.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	lb_19.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	lb_19.pImmutableSamplers = nullptr;
+
+	// sphere shading fields
+	VkDescriptorSetLayoutBinding lb_20 = {};
+	lb_20.binding = 20;
+	lb_20.descriptorCount = 1;
+	lb_20.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lb_20.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	lb_20.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 21> bindings = {
+		lb_0, lb_1, lb_2, lb_3, lb_4, lb_5, lb_6, lb_7, lb_8, lb_9, lb_10, lb_11, lb_12, lb_13, lb_14, lb_15, lb_16, lb_17, lb_18, lb_19, lb_20
 	};
+	// without the rt pipeline only the compute integrators use the set
+	if (!m_rt_pipeline_supported) {
+		for (auto &b : bindings) {
+			b.stageFlags &= VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+	}
 
 	VkDescriptorSetLayoutCreateInfo sli = {};
 	sli.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -2442,6 +4745,7 @@ void BaseApplication::create_raytracing_pipeline_layout()
 	sli.flags = 0;
 	auto res = vkCreateDescriptorSetLayout(m_device, &sli, nullptr, &m_rt_descriptor_set_layout);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to create descriptor set layout");
+	if (!m_rt_pipeline_supported) return;
 
 	// Pipeline Layout
 	VkPipelineLayoutCreateInfo plci = {};
@@ -2449,8 +4753,12 @@ void BaseApplication::create_raytracing_pipeline_layout()
 	plci.flags = 0;
 	plci.setLayoutCount = 1;
 	plci.pSetLayouts = &m_rt_descriptor_set_layout;
-	plci.pushConstantRangeCount = 0;
-	plci.pPushConstantRanges = nullptr;
+	VkPushConstantRange pc_range = {};
+	pc_range.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	pc_range.offset = 0;
+	pc_range.size = sizeof(RTPushConstants);
+	plci.pushConstantRangeCount = 1;
+	plci.pPushConstantRanges = &pc_range;
 
 	res = vkCreatePipelineLayout(m_device, &plci, nullptr, &m_rt_pipeline_layout);
 	if (res != VK_SUCCESS) {
@@ -2458,168 +4766,339 @@ void BaseApplication::create_raytracing_pipeline_layout()
 	}
 }
 
-void BaseApplication::create_raytracing_pipeline()
+static VkShaderStageFlagBits shader_stage_from_kind(shaderc_shader_kind kind)
 {
-	// raygen
-	auto raygen_module = create_shader_module("simple.rgen", shaderc_raygen_shader, read_file(SHADER_DIR "simple.rgen"));
-	auto chit_module = create_shader_module("simple.rchit", shaderc_closesthit_shader, read_file(SHADER_DIR "simple.rchit"));
-	auto miss_module = create_shader_module("simple.rmiss", shaderc_miss_shader, read_file(SHADER_DIR "simple.rmiss"));
-	auto shadow_chit_module = create_shader_module("shadow.rchit", shaderc_closesthit_shader, read_file(SHADER_DIR "shadow.rchit"));
-	auto shadow_miss_module = create_shader_module("shadow.rmiss", shaderc_miss_shader, read_file(SHADER_DIR "shadow.rmiss"));
-	auto sphere_int_module = create_shader_module("sphere.rint", shaderc_intersection_shader, read_file(SHADER_DIR "sphere.rint"));
-	auto sphere_chit_module = create_shader_module("sphere.rchit", shaderc_closesthit_shader, read_file(SHADER_DIR "sphere.rchit"));
-
-	VkPipelineShaderStageCreateInfo rgci = {};
-	rgci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	rgci.stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
-	rgci.module = raygen_module;
-	rgci.pName = "main";
-
-	VkPipelineShaderStageCreateInfo chci = {};
-	chci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	chci.stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-	chci.module = chit_module;
-	chci.pName = "main";
-
-	VkPipelineShaderStageCreateInfo mci = {};
-	mci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	mci.stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-	mci.module = miss_module;
-	mci.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shadow_chci = {};
-	shadow_chci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	shadow_chci.stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-	shadow_chci.module = shadow_chit_module;
-	shadow_chci.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shadow_mci = {};
-	shadow_mci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	shadow_mci.stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-	shadow_mci.module = shadow_miss_module;
-	shadow_mci.pName = "main";
-
-	VkPipelineShaderStageCreateInfo sphere_ici = {};
-	sphere_ici.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	sphere_ici.stage = VK_SHADER_STAGE_INTERSECTION_BIT_KHR;
-	sphere_ici.module = sphere_int_module;
-	sphere_ici.pName = "main";
-
-	VkPipelineShaderStageCreateInfo sphere_chci = {};
-	sphere_chci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	sphere_chci.stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-	sphere_chci.module = sphere_chit_module;
-	sphere_chci.pName = "main";
-
-	std::array<VkPipelineShaderStageCreateInfo, 7> stages = { rgci, chci, mci, shadow_chci, shadow_mci, sphere_ici, sphere_chci };
-	std::array<VkRayTracingShaderGroupCreateInfoKHR, 7> groups = {};
-
-	// raygen group
-	groups[0].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[0].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-	groups[0].generalShader = 0;
-	groups[0].closestHitShader = VK_SHADER_UNUSED_KHR;
-	groups[0].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[0].intersectionShader = VK_SHADER_UNUSED_KHR;
-	// hitgroup
-	groups[1].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[1].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-	groups[1].generalShader = VK_SHADER_UNUSED_KHR;
-	groups[1].closestHitShader = 1;
-	groups[1].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[1].intersectionShader = VK_SHADER_UNUSED_KHR;
-	// shadow hitgroup
-	groups[2].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[2].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-	groups[2].generalShader = VK_SHADER_UNUSED_KHR;
-	groups[2].closestHitShader = 3;
-	groups[2].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[2].intersectionShader = VK_SHADER_UNUSED_KHR;
-	// sphere hit group
-	groups[3].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[3].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR;
-	groups[3].generalShader = VK_SHADER_UNUSED_KHR;
-	groups[3].closestHitShader = 6;
-	groups[3].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[3].intersectionShader = 5;
-	// sphere shadow hitgroup
-	groups[4].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[4].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR;
-	groups[4].generalShader = VK_SHADER_UNUSED_KHR;
-	groups[4].closestHitShader = 3;
-	groups[4].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[4].intersectionShader = 5;
-	// miss group
-	groups[5].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[5].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-	groups[5].generalShader = 2;
-	groups[5].closestHitShader = VK_SHADER_UNUSED_KHR;
-	groups[5].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[5].intersectionShader = VK_SHADER_UNUSED_KHR;
-	// shadow miss group
-	groups[6].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-	groups[6].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-	groups[6].generalShader = 4;
-	groups[6].closestHitShader = VK_SHADER_UNUSED_KHR;
-	groups[6].anyHitShader = VK_SHADER_UNUSED_KHR;
-	groups[6].intersectionShader = VK_SHADER_UNUSED_KHR;
+	switch (kind) {
+	case shaderc_raygen_shader: return VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	case shaderc_miss_shader: return VK_SHADER_STAGE_MISS_BIT_KHR;
+	case shaderc_closesthit_shader: return VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+	case shaderc_anyhit_shader: return VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+	case shaderc_intersection_shader: return VK_SHADER_STAGE_INTERSECTION_BIT_KHR;
+	case shaderc_callable_shader: return VK_SHADER_STAGE_CALLABLE_BIT_KHR;
+	default: throw std::runtime_error("not a raytracing shader kind");
+	}
+}
 
-	VkPipelineLibraryCreateInfoKHR libci = {};
-	libci.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
-	libci.libraryCount = 0;
+// Each library is compiled on its own and then all of them are linked into m_rt_pipeline.
+// A new material type is a new library (or a new group in one), the group indices
+// of the linked pipeline are discovered by name so nothing else needs to change.
+static std::vector<RTLibraryDesc> get_raytracing_library_descs()
+{
+	const uint32_t unused = VK_SHADER_UNUSED_KHR;
+	std::vector<RTLibraryDesc> descs;
+	{
+		RTLibraryDesc d;
+		d.name = "raygen_miss";
+		d.stages = {
+			{ "simple.rgen", shaderc_raygen_shader },
+			{ "simple.rmiss", shaderc_miss_shader },
+			{ "shadow.rmiss", shaderc_miss_shader },
+		};
+		d.groups = {
+			{ "raygen", VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR, 0, unused, unused, unused },
+			{ "miss", VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR, 1, unused, unused, unused },
+			{ "shadow_miss", VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR, 2, unused, unused, unused },
+		};
+		descs.push_back(d);
+	}
+	{
+		RTLibraryDesc d;
+		d.name = "triangles";
+		d.stages = {
+			{ "simple.rchit", shaderc_closesthit_shader },
+			{ "shadow.rchit", shaderc_closesthit_shader },
+			{ "ground.rchit", shaderc_closesthit_shader },
+		};
+		d.groups = {
+			{ "triangle_hit", VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR, unused, 0, unused, unused },
+			{ "triangle_shadow_hit", VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR, unused, 1, unused, unused },
+			{ "ground_hit", VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR, unused, 2, unused, unused },
+			{ "ground_shadow_hit", VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR, unused, 1, unused, unused },
+		};
+		descs.push_back(d);
+	}
+	{
+		RTLibraryDesc d;
+		d.name = "spheres";
+		d.stages = {
+			{ "sphere.rint", shaderc_intersection_shader },
+			{ "sphere.rchit", shaderc_closesthit_shader },
+			{ "shadow.rchit", shaderc_closesthit_shader },
+		};
+		d.groups = {
+			{ "sphere_hit", VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR, unused, 1, unused, 0 },
+			{ "sphere_shadow_hit", VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR, unused, 2, unused, 0 },
+		};
+		descs.push_back(d);
+	}
+	return descs;
+}
+
+static VkRayTracingPipelineInterfaceCreateInfoKHR get_raytracing_pipeline_interface()
+{
+	// all libraries and the linked pipeline must agree on these
+	VkRayTracingPipelineInterfaceCreateInfoKHR ii = {};
+	ii.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_INTERFACE_CREATE_INFO_KHR;
+	ii.maxPipelineRayPayloadSize = RT_MAX_RAY_PAYLOAD_SIZE;
+	ii.maxPipelineRayHitAttributeSize = RT_MAX_HIT_ATTRIBUTE_SIZE;
+	return ii;
+}
+
+RTPipelineLibrary BaseApplication::create_raytracing_library(const RTLibraryDesc &desc)
+{
+	RTPipelineLibrary lib;
+
+	std::vector<VkPipelineShaderStageCreateInfo> stages;
+	for (const auto &[file_name, kind] : desc.stages) {
+		const std::string path = SHADER_DIR + file_name;
+		lib.sources.insert(path);
+
+		VkPipelineShaderStageCreateInfo sci = {};
+		sci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		sci.stage = shader_stage_from_kind(kind);
+		sci.pName = "main";
+		try {
+			sci.module = create_shader_module(file_name, kind, read_file(path), &lib.sources);
+		} catch (...) {
+			for (auto &s : stages) vkDestroyShaderModule(m_device, s.module, nullptr);
+			throw;
+		}
+		stages.push_back(sci);
+	}
+
+	std::vector<VkRayTracingShaderGroupCreateInfoKHR> groups;
+	for (const auto &g : desc.groups) {
+		VkRayTracingShaderGroupCreateInfoKHR gci = {};
+		gci.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+		gci.type = g.type;
+		gci.generalShader = g.general;
+		gci.closestHitShader = g.closest_hit;
+		gci.anyHitShader = g.any_hit;
+		gci.intersectionShader = g.intersection;
+		groups.push_back(gci);
+	}
+
+	auto ii = get_raytracing_pipeline_interface();
 
 	VkRayTracingPipelineCreateInfoKHR ci = {};
 	ci.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
-	ci.flags = 0;
+	ci.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
 	ci.stageCount = uint32_t(stages.size());
 	ci.pStages = stages.data();
 	ci.groupCount = uint32_t(groups.size());
 	ci.pGroups = groups.data();
-	ci.maxPipelineRayRecursionDepth = 1;
+	ci.maxPipelineRayRecursionDepth = RT_MAX_RECURSION_DEPTH;
+	ci.pLibraryInfo = nullptr;
+	ci.pLibraryInterface = &ii;
+	ci.layout = m_rt_pipeline_layout;
+	ci.basePipelineHandle = VK_NULL_HANDLE;
+	ci.basePipelineIndex = 0;
+
+	auto res = vk_helpers::create_raytracing_pipeline_deferred(m_device, ci, lib.pipeline);
+
+	for (auto &s : stages) {
+		vkDestroyShaderModule(m_device, s.module, nullptr);
+	}
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to create raytracing pipeline library " + desc.name);
+	return lib;
+}
+
+RTPipelineBuild BaseApplication::create_raytracing_pipeline(std::vector<RTPipelineLibrary> libraries)
+{
+	const auto descs = get_raytracing_library_descs();
+	libraries.resize(descs.size());
+
+	// compile the missing libraries in parallel
+	std::vector<std::future<RTPipelineLibrary>> compiles(descs.size());
+	for (size_t i = 0; i < descs.size(); ++i) {
+		if (libraries[i].pipeline) continue;
+		compiles[i] = std::async(std::launch::async, [this, &descs, i]() { return create_raytracing_library(descs[i]); });
+	}
+
+	std::vector<VkPipeline> created;
+	std::exception_ptr error;
+	for (size_t i = 0; i < descs.size(); ++i) {
+		if (!compiles[i].valid()) continue;
+		try {
+			libraries[i] = compiles[i].get();
+			created.push_back(libraries[i].pipeline);
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}
+	if (error) {
+		for (auto p : created) vkDestroyPipeline(m_device, p, nullptr);
+		std::rethrow_exception(error);
+	}
+
+	// link, the groups of the linked pipeline are the groups of each library in library order
+	RTPipelineBuild build;
+	std::vector<VkPipeline> library_pipelines;
+	uint32_t group_base = 0;
+	for (size_t i = 0; i < descs.size(); ++i) {
+		library_pipelines.push_back(libraries[i].pipeline);
+		for (size_t g = 0; g < descs[i].groups.size(); ++g) {
+			build.group_indices[descs[i].groups[g].name] = group_base + uint32_t(g);
+		}
+		group_base += uint32_t(descs[i].groups.size());
+	}
+	build.group_count = group_base;
+
+	VkPipelineLibraryCreateInfoKHR libci = {};
+	libci.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+	libci.libraryCount = uint32_t(library_pipelines.size());
+	libci.pLibraries = library_pipelines.data();
+
+	auto ii = get_raytracing_pipeline_interface();
+
+	// the stack size is set when the pipeline is bound, from the stacks of its shaders
+	const VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_RAY_TRACING_PIPELINE_STACK_SIZE_KHR };
+	VkPipelineDynamicStateCreateInfo dsci = {};
+	dsci.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dsci.dynamicStateCount = 1;
+	dsci.pDynamicStates = dynamic_states;
+
+	VkRayTracingPipelineCreateInfoKHR ci = {};
+	ci.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
+	ci.flags = 0;
+	ci.stageCount = 0;
+	ci.pStages = nullptr;
+	ci.groupCount = 0;
+	ci.pGroups = nullptr;
+	ci.maxPipelineRayRecursionDepth = RT_MAX_RECURSION_DEPTH;
 	ci.pLibraryInfo = &libci;
-	ci.pLibraryInterface = nullptr;
+	ci.pLibraryInterface = &ii;
+	ci.pDynamicState = &dsci;
 	ci.layout = m_rt_pipeline_layout;
 	ci.basePipelineHandle = VK_NULL_HANDLE;
 	ci.basePipelineIndex = 0;
 
-	auto res = vkCreateRayTracingPipelinesKHR(m_device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &ci, nullptr, &m_rt_pipeline);
-	if (res != VK_SUCCESS) throw std::runtime_error("failed to create a raytracing pipeline");
+	auto res = vk_helpers::create_raytracing_pipeline_deferred(m_device, ci, build.pipeline);
+	if (res != VK_SUCCESS) {
+		for (auto p : created) vkDestroyPipeline(m_device, p, nullptr);
+		throw std::runtime_error("failed to link the raytracing pipeline");
+	}
+
+	// the deepest call chain instead of the default for the recursion depth, which assumes every shader
+	// can recurse: the raygen, one shader of a path ray or of a raygen shadow ray, and below the shading
+	// hit shaders one shader of their shadow rays. the shadow shaders trace nothing
+	auto group_stack = [&](const char *group, VkShaderGroupShaderKHR shader) {
+		return vkGetRayTracingShaderGroupStackSizeKHR(m_device, build.pipeline, build.group_indices.at(group), shader);
+	};
+	const VkDeviceSize raygen = group_stack("raygen", VK_SHADER_GROUP_SHADER_GENERAL_KHR);
+	const VkDeviceSize shadow = std::max({
+		group_stack("shadow_miss", VK_SHADER_GROUP_SHADER_GENERAL_KHR),
+		group_stack("triangle_shadow_hit", VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR),
+		group_stack("sphere_shadow_hit", VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR),
+		group_stack("sphere_shadow_hit", VK_SHADER_GROUP_SHADER_INTERSECTION_KHR),
+		group_stack("ground_shadow_hit", VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR) });
+	const VkDeviceSize shade = std::max({
+		group_stack("miss", VK_SHADER_GROUP_SHADER_GENERAL_KHR),
+		group_stack("triangle_hit", VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR),
+		group_stack("sphere_hit", VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR),
+		group_stack("sphere_hit", VK_SHADER_GROUP_SHADER_INTERSECTION_KHR),
+		group_stack("ground_hit", VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR),
+		shadow });
+	build.stack_size = uint32_t(raygen + shade + shadow);
+#if defined(ENABLE_DEBUG_MARKERS)
+	fprintf(stdout, "raytracing pipeline stack %u bytes (raygen %u, hit %u, shadow %u), payload %u bytes\n",
+		build.stack_size, uint32_t(raygen), uint32_t(shade), uint32_t(shadow), RT_MAX_RAY_PAYLOAD_SIZE);
+#endif
 
-	vkDestroyShaderModule(m_device, raygen_module, nullptr);
-	vkDestroyShaderModule(m_device, chit_module, nullptr);
-	vkDestroyShaderModule(m_device, miss_module, nullptr);
-	vkDestroyShaderModule(m_device, shadow_chit_module, nullptr);
-	vkDestroyShaderModule(m_device, shadow_miss_module, nullptr);
-	vkDestroyShaderModule(m_device, sphere_chit_module, nullptr);
-	vkDestroyShaderModule(m_device, sphere_int_module, nullptr);
+	build.libraries = std::move(libraries);
+	return build;
 }
 
 void BaseApplication::create_rt_image()
 {
-	create_image(m_swapchain_extent.width, m_swapchain_extent.height, VK_FORMAT_R8G8B8A8_UNORM,
-				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 
-				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_img);
+	// the launches alternate between the layers, so a launch can read the history 
+	// of any pixel while it writes its own, which the reprojection needs
+	create_image(m_swapchain_extent.width, m_swapchain_extent.height, RT_ACCUMULATION_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, 
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_img, RT_HISTORY_LAYERS);
+
+	m_rt_img_view = vk_helpers::create_image_view_2d_array(m_device, m_rt_img.image, RT_ACCUMULATION_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, RT_HISTORY_LAYERS);
+
+	create_image(m_swapchain_extent.width, m_swapchain_extent.height, RT_MOMENTS_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, 
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_moments_img, RT_HISTORY_LAYERS);
+
+	m_rt_moments_img_view = vk_helpers::create_image_view_2d_array(m_device, m_rt_moments_img.image, RT_MOMENTS_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, RT_HISTORY_LAYERS);
+
+	create_image(m_swapchain_extent.width, m_swapchain_extent.height, RT_SURFACE_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, 
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_surface_img, RT_HISTORY_LAYERS);
+
+	m_rt_surface_img_view = vk_helpers::create_image_view_2d_array(m_device, m_rt_surface_img.image, RT_SURFACE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, RT_HISTORY_LAYERS);
+
+	// denoiser inputs and output, the filter iterations alternate between the two layers
+	create_image(m_swapchain_extent.width, m_swapchain_extent.height, RT_ALBEDO_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, 
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_albedo_img);
+
+	m_rt_albedo_img_view = vk_helpers::create_image_view_2d(m_device, m_rt_albedo_img.image, RT_ALBEDO_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
 
-	m_rt_img_view = vk_helpers::create_image_view_2d(m_device, m_rt_img.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	create_image(m_swapchain_extent.width, m_swapchain_extent.height, RT_DENOISE_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, 
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_denoise_img, 2);
+
+	m_rt_denoise_img_view = vk_helpers::create_image_view_2d_array(m_device, m_rt_denoise_img.image, RT_DENOISE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 2);
+
+	// drawn by the raster pass and read by the raygen, general layout suits both
+	create_image(m_swapchain_extent.width, m_swapchain_extent.height, RT_GBUFFER_FORMAT,
+				 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rt_gbuffer_img);
+
+	m_rt_gbuffer_img_view = vk_helpers::create_image_view_2d(m_device, m_rt_gbuffer_img.image, RT_GBUFFER_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	// the accumulation images stay in general layout for their whole life, 
+	// so the frames never discard what the previous ones accumulated
+	VkImageSubresourceRange isr = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS };
+	auto cmd_buf = begin_single_time_commands(m_graphics_queue, m_graphics_cmd_pool);
+	for (VkImage img : { m_rt_img.image, m_rt_moments_img.image, m_rt_surface_img.image, m_rt_albedo_img.image, m_rt_denoise_img.image, m_rt_gbuffer_img.image }) {
+		vk_helpers::image_barrier(cmd_buf, img, isr,
+			VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL);
+	}
+	end_single_time_commands(m_graphics_queue, m_graphics_cmd_pool, cmd_buf);
+
+	// the reservoirs are only read after the first launch of an accumulation wrote them
+	VkDeviceSize reservoirs_size = 2 * sizeof(LightReservoir) * m_swapchain_extent.width * m_swapchain_extent.height;
+	create_buffer(reservoirs_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_restir_reservoirs);
+
+	// one path per pixel for the wavefront integrator, the queue header feeds its indirect dispatches
+	const VkDeviceSize pixels = VkDeviceSize(m_swapchain_extent.width) * m_swapchain_extent.height;
+	create_buffer(RT_WAVEFRONT_FIELDS * pixels * sizeof(glm::uvec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_wavefront_state);
+	create_buffer(sizeof(WavefrontQueuesHeader) + RT_WAVEFRONT_QUEUES * pixels * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_wavefront_queues);
+	// two key arrays, the values that are not in the queue and a histogram per block of paths
+	const VkDeviceSize sort_blocks = (pixels + RT_SORT_BLOCK_SIZE - 1) / RT_SORT_BLOCK_SIZE;
+	create_buffer((3 * pixels + RT_SORT_RADIX * sort_blocks) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_wavefront_sort);
 }
 
 void BaseApplication::create_descriptor_pool()
 {
 	uint32_t imgs_count = (uint32_t)m_swapchain_images.size();
 	// specify bigger sizes than needed
-	std::array<VkDescriptorPoolSize, 3> ps = {};
+	std::array<VkDescriptorPoolSize, 4> ps = {};
 	ps[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	ps[0].descriptorCount = 2*imgs_count;
+	ps[0].descriptorCount = 4*imgs_count;
 	ps[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	ps[1].descriptorCount = 2*imgs_count;
+	ps[1].descriptorCount = 13*imgs_count;
 	ps[2].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
 	ps[2].descriptorCount = 2*imgs_count;
+	ps[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	ps[3].descriptorCount = 13*imgs_count;
 
 	VkDescriptorPoolCreateInfo pi = {};
 	pi.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	pi.poolSizeCount = uint32_t(ps.size());
 	pi.pPoolSizes = ps.data();
-	pi.maxSets = 2*imgs_count; // one for rt and one for default
+	pi.maxSets = 4*imgs_count; // one for rt, one for resolve, one for denoise and one for default
 
 	auto res = vkCreateDescriptorPool(m_device, &pi, nullptr, &m_desc_pool);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to create descriptor pool");
@@ -2701,7 +5180,97 @@ void BaseApplication::create_rt_descriptor_sets()
 		ubi.offset = 0;
 		ubi.range = sizeof(SceneUniforms);
 
-		std::array<VkWriteDescriptorSet, 3> dw = {};
+		VkDescriptorBufferInfo gbi = {};
+		gbi.buffer = m_geometry_buffer.buffer;
+		gbi.offset = 0;
+		gbi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo mbi = {};
+		mbi.buffer = m_material_buffer.buffer;
+		mbi.offset = 0;
+		mbi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorImageInfo moi = {};
+		moi.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		moi.imageView = m_rt_moments_img_view;
+		moi.sampler = nullptr;
+
+		VkDescriptorBufferInfo abi = {};
+		abi.buffer = m_rt_stats_buffers[i].buffer;
+		abi.offset = 0;
+		abi.range = sizeof(RTFrameStats);
+
+		VkDescriptorBufferInfo lbi = {};
+		lbi.buffer = m_light_buffer.buffer;
+		lbi.offset = 0;
+		lbi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo rbi = {};
+		rbi.buffer = m_restir_reservoirs.buffer;
+		rbi.offset = 0;
+		rbi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo cbi = {};
+		cbi.buffer = m_radiance_cache.buffer;
+		cbi.offset = 0;
+		cbi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo sbi = {};
+		sbi.buffer = m_sampler_tables.buffer;
+		sbi.offset = 0;
+		sbi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorImageInfo sui = {};
+		sui.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		sui.imageView = m_rt_surface_img_view;
+		sui.sampler = nullptr;
+
+		VkDescriptorImageInfo ali = {};
+		ali.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		ali.imageView = m_rt_albedo_img_view;
+		ali.sampler = nullptr;
+
+		VkDescriptorBufferInfo spi = {};
+		spi.buffer = m_sphere_geometry.buffer;
+		spi.offset = 0;
+		spi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo ssi = {};
+		ssi.buffer = m_sphere_shading.buffer;
+		ssi.offset = 0;
+		ssi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo wsi = {};
+		wsi.buffer = m_wavefront_state.buffer;
+		wsi.offset = 0;
+		wsi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo wqi = {};
+		wqi.buffer = m_wavefront_queues.buffer;
+		wqi.offset = 0;
+		wqi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo wsoi = {};
+		wsoi.buffer = m_wavefront_sort.buffer;
+		wsoi.offset = 0;
+		wsoi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorImageInfo gbui = {};
+		gbui.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		gbui.imageView = m_rt_gbuffer_img_view;
+		gbui.sampler = nullptr;
+
+		VkDescriptorBufferInfo bvi = {};
+		bvi.buffer = m_batch_views.buffer;
+		bvi.offset = 0;
+		bvi.range = VK_WHOLE_SIZE;
+
+		VkDescriptorImageInfo bii = {};
+		bii.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		bii.imageView = m_batch_img_view;
+		bii.sampler = nullptr;
+
+		std::array<VkWriteDescriptorSet, 21> dw = {};
 
 		dw[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		dw[0].dstSet = m_rt_desc_sets[i];
@@ -2726,109 +5295,319 @@ void BaseApplication::create_rt_descriptor_sets()
 		dw[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		dw[2].descriptorCount = 1;
 		dw[2].pBufferInfo = &ubi;
+
+		dw[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[3].dstSet = m_rt_desc_sets[i];
+		dw[3].dstBinding = 3;
+		dw[3].dstArrayElement = 0;
+		dw[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[3].descriptorCount = 1;
+		dw[3].pBufferInfo = &gbi;
+
+		dw[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[4].dstSet = m_rt_desc_sets[i];
+		dw[4].dstBinding = 4;
+		dw[4].dstArrayElement = 0;
+		dw[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[4].descriptorCount = 1;
+		dw[4].pBufferInfo = &mbi;
+
+		dw[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[5].dstSet = m_rt_desc_sets[i];
+		dw[5].dstBinding = 5;
+		dw[5].dstArrayElement = 0;
+		dw[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[5].descriptorCount = 1;
+		dw[5].pImageInfo = &moi;
+
+		dw[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[6].dstSet = m_rt_desc_sets[i];
+		dw[6].dstBinding = 6;
+		dw[6].dstArrayElement = 0;
+		dw[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[6].descriptorCount = 1;
+		dw[6].pBufferInfo = &abi;
+
+		dw[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[7].dstSet = m_rt_desc_sets[i];
+		dw[7].dstBinding = 7;
+		dw[7].dstArrayElement = 0;
+		dw[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[7].descriptorCount = 1;
+		dw[7].pBufferInfo = &lbi;
+
+		dw[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[8].dstSet = m_rt_desc_sets[i];
+		dw[8].dstBinding = 8;
+		dw[8].dstArrayElement = 0;
+		dw[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[8].descriptorCount = 1;
+		dw[8].pBufferInfo = &rbi;
+
+		dw[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[9].dstSet = m_rt_desc_sets[i];
+		dw[9].dstBinding = 9;
+		dw[9].dstArrayElement = 0;
+		dw[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[9].descriptorCount = 1;
+		dw[9].pBufferInfo = &cbi;
+
+		dw[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[10].dstSet = m_rt_desc_sets[i];
+		dw[10].dstBinding = 10;
+		dw[10].dstArrayElement = 0;
+		dw[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[10].descriptorCount = 1;
+		dw[10].pBufferInfo = &sbi;
+
+		dw[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[11].dstSet = m_rt_desc_sets[i];
+		dw[11].dstBinding = 11;
+		dw[11].dstArrayElement = 0;
+		dw[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[11].descriptorCount = 1;
+		dw[11].pImageInfo = &sui;
+
+		dw[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[12].dstSet = m_rt_desc_sets[i];
+		dw[12].dstBinding = 12;
+		dw[12].dstArrayElement = 0;
+		dw[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[12].descriptorCount = 1;
+		dw[12].pImageInfo = &ali;
+
+		dw[13].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[13].dstSet = m_rt_desc_sets[i];
+		dw[13].dstBinding = 13;
+		dw[13].dstArrayElement = 0;
+		dw[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[13].descriptorCount = 1;
+		dw[13].pBufferInfo = &spi;
+
+		dw[14].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[14].dstSet = m_rt_desc_sets[i];
+		dw[14].dstBinding = 14;
+		dw[14].dstArrayElement = 0;
+		dw[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[14].descriptorCount = 1;
+		dw[14].pBufferInfo = &wsi;
+
+		dw[15].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[15].dstSet = m_rt_desc_sets[i];
+		dw[15].dstBinding = 15;
+		dw[15].dstArrayElement = 0;
+		dw[15].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[15].descriptorCount = 1;
+		dw[15].pBufferInfo = &wqi;
+
+		dw[16].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[16].dstSet = m_rt_desc_sets[i];
+		dw[16].dstBinding = 16;
+		dw[16].dstArrayElement = 0;
+		dw[16].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[16].descriptorCount = 1;
+		dw[16].pBufferInfo = &wsoi;
+
+		dw[17].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[17].dstSet = m_rt_desc_sets[i];
+		dw[17].dstBinding = 17;
+		dw[17].dstArrayElement = 0;
+		dw[17].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[17].descriptorCount = 1;
+		dw[17].pImageInfo = &gbui;
+
+		dw[18].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[18].dstSet = m_rt_desc_sets[i];
+		dw[18].dstBinding = 18;
+		dw[18].dstArrayElement = 0;
+		dw[18].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[18].descriptorCount = 1;
+		dw[18].pBufferInfo = &bvi;
+
+		dw[19].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[19].dstSet = m_rt_desc_sets[i];
+		dw[19].dstBinding = 19;
+		dw[19].dstArrayElement = 0;
+		dw[19].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[19].descriptorCount = 1;
+		dw[19].pImageInfo = &bii;
+
+		dw[20].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[20].dstSet = m_rt_desc_sets[i];
+		dw[20].dstBinding = 20;
+		dw[20].dstArrayElement = 0;
+		dw[20].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		dw[20].descriptorCount = 1;
+		dw[20].pBufferInfo = &ssi;
    
 		vkUpdateDescriptorSets(m_device, uint32_t(dw.size()), dw.data(), 0, nullptr);
 	}
 
 }
 
+void BaseApplication::create_resolve_descriptor_sets()
+{
+	std::vector<VkDescriptorSetLayout> layouts(m_swapchain_images.size(), m_resolve_descriptor_set_layout);
+
+	VkDescriptorSetAllocateInfo ai = {};
+	ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	ai.descriptorPool = m_desc_pool;
+	ai.descriptorSetCount = uint32_t(m_swapchain_images.size());
+	ai.pSetLayouts = layouts.data();
+
+	m_resolve_desc_sets.resize(m_swapchain_images.size());
+	auto res = vkAllocateDescriptorSets(m_device, &ai, m_resolve_desc_sets.data());
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to allocate descriptor sets");
+
+	for (size_t i = 0; i < m_resolve_desc_sets.size(); ++i) {
+		VkDescriptorImageInfo ii = {};
+		ii.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		ii.imageView = m_rt_img_view;
+		ii.sampler = nullptr;
+
+		VkDescriptorBufferInfo ubi = {};
+		ubi.buffer = m_uni_buffers[i].buffer;
+		ubi.offset = 0;
+		ubi.range = sizeof(SceneUniforms);
+
+		VkDescriptorImageInfo dni = {};
+		dni.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		dni.imageView = m_rt_denoise_img_view;
+		dni.sampler = nullptr;
+
+		std::array<VkWriteDescriptorSet, 3> dw = {};
+		dw[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[0].dstSet = m_resolve_desc_sets[i];
+		dw[0].dstBinding = 0;
+		dw[0].dstArrayElement = 0;
+		dw[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[0].descriptorCount = 1;
+		dw[0].pImageInfo = &ii;
+
+		dw[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[1].dstSet = m_resolve_desc_sets[i];
+		dw[1].dstBinding = 1;
+		dw[1].dstArrayElement = 0;
+		dw[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		dw[1].descriptorCount = 1;
+		dw[1].pBufferInfo = &ubi;
+
+		dw[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[2].dstSet = m_resolve_desc_sets[i];
+		dw[2].dstBinding = 2;
+		dw[2].dstArrayElement = 0;
+		dw[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		dw[2].descriptorCount = 1;
+		dw[2].pImageInfo = &dni;
+
+		vkUpdateDescriptorSets(m_device, uint32_t(dw.size()), dw.data(), 0, nullptr);
+	}
+}
+
+void BaseApplication::create_denoise_descriptor_sets()
+{
+	std::vector<VkDescriptorSetLayout> layouts(m_swapchain_images.size(), m_denoise_descriptor_set_layout);
+
+	VkDescriptorSetAllocateInfo ai = {};
+	ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	ai.descriptorPool = m_desc_pool;
+	ai.descriptorSetCount = uint32_t(m_swapchain_images.size());
+	ai.pSetLayouts = layouts.data();
+
+	m_denoise_desc_sets.resize(m_swapchain_images.size());
+	auto res = vkAllocateDescriptorSets(m_device, &ai, m_denoise_desc_sets.data());
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to allocate descriptor sets");
+
+	// in binding order
+	const std::array<VkImageView, 5> views = {
+		m_rt_img_view, m_rt_moments_img_view, m_rt_surface_img_view, m_rt_albedo_img_view, m_rt_denoise_img_view
+	};
+
+	for (size_t i = 0; i < m_denoise_desc_sets.size(); ++i) {
+		std::array<VkDescriptorImageInfo, 5> ii = {};
+		std::array<VkWriteDescriptorSet, 6> dw = {};
+		for (uint32_t b = 0; b < views.size(); ++b) {
+			ii[b].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			ii[b].imageView = views[b];
+			ii[b].sampler = nullptr;
+
+			dw[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			dw[b].dstSet = m_denoise_desc_sets[i];
+			dw[b].dstBinding = b;
+			dw[b].dstArrayElement = 0;
+			dw[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			dw[b].descriptorCount = 1;
+			dw[b].pImageInfo = &ii[b];
+		}
+
+		VkDescriptorBufferInfo ubi = {};
+		ubi.buffer = m_uni_buffers[i].buffer;
+		ubi.offset = 0;
+		ubi.range = sizeof(SceneUniforms);
+
+		dw[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		dw[5].dstSet = m_denoise_desc_sets[i];
+		dw[5].dstBinding = 5;
+		dw[5].dstArrayElement = 0;
+		dw[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		dw[5].descriptorCount = 1;
+		dw[5].pBufferInfo = &ubi;
+
+		vkUpdateDescriptorSets(m_device, uint32_t(dw.size()), dw.data(), 0, nullptr);
+	}
+}
+
 void BaseApplication::create_shader_binding_table()
 {
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR props = vk_helpers::get_raytracing_properties(m_gpu);
 	
-	fprintf(stdout, "group handle size %u\n", props.shaderGroupHandleSize);
-	fprintf(stdout, "group handle alignment %u\n", props.shaderGroupHandleAlignment);
-	fprintf(stdout, "group base alignment %u\n", props.shaderGroupBaseAlignment);
-	fprintf(stdout, "group max stride %u\n", props.maxShaderGroupStride);
-	fprintf(stdout, "max recursion depth %u\n", props.maxRayRecursionDepth);
-
-	if (props.shaderGroupHandleSize != sizeof(ShaderGroupHandle)) {
-		throw std::runtime_error("we assume at compile time that shadergroup handle size is 32 bytes");
-	}
-	if (props.shaderGroupBaseAlignment != 64) {
-		throw std::runtime_error("we assume at compile time that shadergroup base alignment is 64 bytes");
-	}
-
-	const uint32_t num_raygen = 1;
-    const uint32_t num_triangle_geometries = m_model_parts.size();
-    const uint32_t num_sphere_geometries = 1;
-    const uint32_t num_ray_classes = 2; // shade/shadow
-	const uint32_t num_hitgroups = (num_triangle_geometries+num_sphere_geometries) * num_ray_classes;
-	const uint32_t num_miss = num_ray_classes;
-	VkDeviceSize sz =
-		num_raygen * get_sbt_raygen_record_size() +
-		num_hitgroups * get_sbt_hit_record_size() +
-		num_miss * get_sbt_miss_record_size();
-
-	create_buffer(sz, VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+	// the properties do not change, they are printed for the first pipeline only
+	if (!m_rt_sbt_layout) {
+		fprintf(stdout, "group handle size %u\n", props.shaderGroupHandleSize);
+		fprintf(stdout, "group handle alignment %u\n", props.shaderGroupHandleAlignment);
+		fprintf(stdout, "group base alignment %u\n", props.shaderGroupBaseAlignment);
+		fprintf(stdout, "group max stride %u\n", props.maxShaderGroupStride);
+		fprintf(stdout, "max recursion depth %u\n", props.maxRayRecursionDepth);
+	}
+
+	using Region = ShaderBindingTableBuilder::Region;
+	ShaderBindingTableBuilder sbt(props);
+
+	// raygen
+	sbt.add_record(Region::Raygen, get_rt_group_index("raygen"));
+	// miss, in ray class order shade/shadow
+	sbt.add_record(Region::Miss, get_rt_group_index("miss"));
+	sbt.add_record(Region::Miss, get_rt_group_index("shadow_miss"));
+	// hit, in instance sbt offset order, then ray class order.
+	// all triangle geometries share one record per ray class, they find their
+	// vertices and material in the geometry table, so the sbt does not depend on the scene
+	sbt.add_record(Region::Hit, get_rt_group_index("triangle_hit"));
+	sbt.add_record(Region::Hit, get_rt_group_index("triangle_shadow_hit"));
+	SBTRecordHitSphere spheres_rec;
+	spheres_rec.geometry_ref = vk_helpers::get_buffer_address(m_device, m_sphere_geometry.buffer);
+	spheres_rec.shading_ref = vk_helpers::get_buffer_address(m_device, m_sphere_shading.buffer);
+	sbt.add_record(Region::Hit, get_rt_group_index("sphere_hit"), spheres_rec);
+	sbt.add_record(Region::Hit, get_rt_group_index("sphere_shadow_hit"), spheres_rec);
+	sbt.add_record(Region::Hit, get_rt_group_index("ground_hit"));
+	sbt.add_record(Region::Hit, get_rt_group_index("ground_shadow_hit"));
+
+	create_buffer(sbt.size(), VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_rt_sbt, props.shaderGroupBaseAlignment);
 
 	m_rt_sbt_address = vk_helpers::get_buffer_address(m_device, m_rt_sbt.buffer);
 
+	const uint32_t group_count = m_rt_group_count;
+	std::vector<uint8_t> handles(size_t(group_count) * props.shaderGroupHandleSize);
+	auto res = vkGetRayTracingShaderGroupHandlesKHR(m_device, m_rt_pipeline, 0, group_count, handles.size(), handles.data());
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to get shader group handles");
+
 	uint8_t *data;
-	auto res = vmaMapMemory(m_allocator, m_rt_sbt.alloc, (void**)&data);
+	res = vmaMapMemory(m_allocator, m_rt_sbt.alloc, (void**)&data);
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to map memory");
-
-	
-	const uint32_t group_count = 7u;
-	ShaderGroupHandle handles[group_count];
-	vkGetRayTracingShaderGroupHandlesKHR(m_device, m_rt_pipeline, 0, group_count, sizeof(ShaderGroupHandle) * group_count, handles);
-
-	// write raygen groups
-	{
-		ShaderGroupHandle raygen_rec = handles[0];
-		std::memcpy(data, &raygen_rec, sizeof(raygen_rec));
-		data += get_sbt_raygen_record_size();
-	}
-	// write hitgroups
-	{
-		// hit groups
-		// triangles 
-        for (const ModelPart &part : m_model_parts) {
-            SBTRecordHitMesh mesh_rec;
-            mesh_rec.shader = handles[1];
-            mesh_rec.vertices_ref = sizeof(Vertex)*part.vertex_offset +
-                vk_helpers::get_buffer_address(m_device, m_vertex_buffer.buffer);
-            mesh_rec.indices_ref = sizeof(uint32_t)*part.index_offset + 
-                vk_helpers::get_buffer_address(m_device, m_index_buffer.buffer);
-			mesh_rec.pbr_material = part.pbr_material;
-
-            ShaderGroupHandle mesh_occlusion_rec = handles[2];
-
-            std::memcpy(data, &mesh_rec, sizeof(mesh_rec));
-            data += get_sbt_hit_record_size();
-            // triangles shadow
-            std::memcpy(data, &mesh_occlusion_rec, sizeof(mesh_occlusion_rec));
-            data += get_sbt_hit_record_size();
-        }
-        {
-            SBTRecordHitSphere spheres_rec;
-            spheres_rec.shader = handles[3];
-            spheres_rec.spheres_ref = vk_helpers::get_buffer_address(m_device, m_sphere_buffer.buffer);
-
-            ShaderGroupHandle spheres_occlusion_rec = handles[4];
-
-            // spheres
-            std::memcpy(data, &spheres_rec, sizeof(spheres_rec));
-            data += get_sbt_hit_record_size();
-            // spheres shadow
-            std::memcpy(data, &spheres_occlusion_rec, sizeof(spheres_occlusion_rec));
-            data += get_sbt_hit_record_size();
-        }
-	}
-	// write miss groups
-	{
-		ShaderGroupHandle miss_rec = handles[5];
-		ShaderGroupHandle miss_occlusion_rec = handles[6];
-		// miss groups 
-		std::memcpy(data, &miss_rec, sizeof(miss_rec));
-		data += get_sbt_miss_record_size();
-		// miss shadow
-		std::memcpy(data, &miss_occlusion_rec, sizeof(miss_occlusion_rec));
-	}
-	
-
+	sbt.write(data, handles);
 	vmaUnmapMemory(m_allocator, m_rt_sbt.alloc);
+
+	m_rt_sbt_layout = std::move(sbt);
 }
 
 VkFormat BaseApplication::find_supported_format(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const
@@ -2881,6 +5660,25 @@ void BaseApplication::create_command_pools()
 	if (res != VK_SUCCESS) {
 		throw std::runtime_error("failed to create command pool");
 	}
+
+	// re-recorded every frame that has buffer writes
+	pci.queueFamilyIndex = indices.graphics_family.value();
+	pci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		res = vkCreateCommandPool(m_device, &pci, nullptr, &m_frame_cmd_pools[i]);
+		if (res != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool");
+		}
+		VkCommandBufferAllocateInfo cbi = {};
+		cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbi.commandPool = m_frame_cmd_pools[i];
+		cbi.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbi.commandBufferCount = 1;
+		res = vkAllocateCommandBuffers(m_device, &cbi, &m_frame_cmd_buffers[i]);
+		if (res != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffers");
+		}
+	}
 }
 
 void BaseApplication::create_command_buffers()
@@ -2964,7 +5762,7 @@ void BaseApplication::create_command_buffers()
 								0, 1, &m_desc_sets[i], 0, nullptr);
         for (auto p : m_model_parts) {
 			vkCmdPushConstants(m_cmd_buffers[i], m_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT,
-				0, sizeof(materials::PBRMaterial), &p.pbr_material);
+				0, sizeof(materials::PBRMaterial), &m_materials[p.material_index]);
             vkCmdDrawIndexed(m_cmd_buffers[i], p.index_count, 1, p.index_offset, p.vertex_offset, 0);
         }
 
@@ -2988,104 +5786,328 @@ void BaseApplication::create_command_buffers()
 
 void BaseApplication::create_rt_command_buffers()
 {
-	// the command buffers are the same number as the swapchain images
+	// the command buffers are the same number as the swapchain images,
+	// one set traces a single dispatch per frame and one set several dispatches for throughput mode
 	m_rt_cmd_buffers.resize(m_swapchain_images.size());
+	m_rt_throughput_cmd_buffers.resize(m_swapchain_images.size());
 
-	VkCommandBufferAllocateInfo cbi = {};
-	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbi.commandPool = m_graphics_cmd_pool;
-	cbi.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cbi.commandBufferCount = (uint32_t)m_rt_cmd_buffers.size();
+	for (auto *cmd_buffers : { &m_rt_cmd_buffers, &m_rt_throughput_cmd_buffers }) {
+		VkCommandBufferAllocateInfo cbi = {};
+		cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbi.commandPool = m_graphics_cmd_pool;
+		cbi.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbi.commandBufferCount = (uint32_t)cmd_buffers->size();
 
-	auto res = vkAllocateCommandBuffers(m_device, &cbi, m_rt_cmd_buffers.data());
-	if (res != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate command buffers");
+		auto res = vkAllocateCommandBuffers(m_device, &cbi, cmd_buffers->data());
+		if (res != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffers");
+		}
 	}
 
-	for (size_t i = 0; i < m_rt_cmd_buffers.size(); ++i) {
-		VkCommandBufferBeginInfo bi = {};
-		bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		bi.flags = 0;
-		bi.pInheritanceInfo = nullptr;
-		res = vkBeginCommandBuffer(m_rt_cmd_buffers[i], &bi);
-		if (res != VK_SUCCESS) { throw std::runtime_error("failed to begin recording commands"); }
+	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
+		record_rt_commands(m_rt_cmd_buffers[i], uint32_t(i), 1);
+		record_rt_commands(m_rt_throughput_cmd_buffers[i], uint32_t(i), RT_THROUGHPUT_DISPATCHES);
+	}
+}
 
-		VkImageSubresourceRange isr = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-		
-		vk_helpers::image_barrier(m_rt_cmd_buffers[i], m_rt_img.image, isr,
-			VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL);
+void BaseApplication::record_rt_commands(VkCommandBuffer cmd_buf, uint32_t img_idx, uint32_t dispatch_count)
+{
+	VkCommandBufferBeginInfo bi = {};
+	bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bi.flags = 0;
+	bi.pInheritanceInfo = nullptr;
+	auto res = vkBeginCommandBuffer(cmd_buf, &bi);
+	if (res != VK_SUCCESS) { throw std::runtime_error("failed to begin recording commands"); }
+
+	VkImageSubresourceRange isr = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 	
-		vk_helpers::debug_marker_push(m_rt_cmd_buffers[i], "Trace Rays");
-		vkCmdBindPipeline(m_rt_cmd_buffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rt_pipeline);
-		vkCmdBindDescriptorSets(m_rt_cmd_buffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rt_pipeline_layout,
-			0, 1, &m_rt_desc_sets[i], 0, nullptr);
-
-		const size_t raygen_stride = get_sbt_raygen_record_size();
-		const size_t hitgroup_stride = get_sbt_hit_record_size();
-		const size_t miss_stride = get_sbt_miss_record_size();
-        const uint32_t num_raygen = 1;
-        const uint32_t num_triangle_geometries = m_model_parts.size();
-        const uint32_t num_sphere_geometries = 1;
-        const uint32_t num_ray_classes = 2; // shade/shadow
-        const uint32_t num_hitgroups = (num_triangle_geometries+num_sphere_geometries) * num_ray_classes;
-        const uint32_t num_miss = num_ray_classes;
-		size_t raygen_offset = 0;
-		size_t hitgroups_offset = raygen_stride * num_raygen;
-		size_t miss_offset = hitgroups_offset + hitgroup_stride * num_hitgroups;
-		VkStridedDeviceAddressRegionKHR raygen_region = { 
-			m_rt_sbt_address+raygen_offset, 
-			raygen_stride, 
-			raygen_stride*num_raygen 
-		};
-		VkStridedDeviceAddressRegionKHR hitgroup_region = { 
-			m_rt_sbt_address+hitgroups_offset, 
-			hitgroup_stride, 
-			hitgroup_stride*num_hitgroups 
-		};
-		VkStridedDeviceAddressRegionKHR miss_region = { 
-			m_rt_sbt_address+miss_offset, 
-			miss_stride, 
-			miss_stride*num_miss 
-		};
-		VkStridedDeviceAddressRegionKHR callable_region = { 0, 0, 0 };
-		vkCmdTraceRaysKHR(m_rt_cmd_buffers[i],
-			&raygen_region, &miss_region, &hitgroup_region, &callable_region,
-			m_width, m_height, 1);
+	// the accumulation images stay in general layout, so global barriers cover them and the stats buffer.
+	// the previous frame's trace, denoise and resolve access the accumulation images
+	vkCmdFillBuffer(cmd_buf, m_rt_stats_buffers[img_idx].buffer, 0, sizeof(RTFrameStats), 0);
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+
+	if (m_integrator == RT_INTEGRATOR_WAVEFRONT) {
+		record_wavefront_commands(cmd_buf, img_idx, dispatch_count);
+	} else if (m_integrator == RT_INTEGRATOR_RAY_QUERY) {
+		vk_helpers::debug_marker_push(cmd_buf, "Ray Query");
+		vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_ray_query_pipeline);
+		vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_rt_compute_pipeline_layout,
+			0, 1, &m_rt_desc_sets[img_idx], 0, nullptr);
+		for (uint32_t d = 0; d < dispatch_count; ++d) {
+			if (d > 0) {
+				// the next dispatch accumulates on top of the previous one
+				vk_helpers::memory_barrier(cmd_buf,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+			}
+			WavefrontPushConstants pc = {};
+			pc.dispatch_index = d;
+			vkCmdPushConstants(cmd_buf, m_rt_compute_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(WavefrontPushConstants), &pc);
+			vkCmdDispatchIndirect(cmd_buf, m_rt_indirect_buffers[img_idx].buffer, offsetof(RTIndirectCommands, tiles));
+		}
+		vk_helpers::debug_marker_pop(cmd_buf, "Ray Query");
+	} else {
+		// the cells of the radiance cache no path used for a while are freed before the trace
+		vk_helpers::debug_marker_push(cmd_buf, "Radiance Cache Age");
+		vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_radiance_cache_age_pipeline);
+		vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_rt_compute_pipeline_layout,
+			0, 1, &m_rt_desc_sets[img_idx], 0, nullptr);
+		vkCmdDispatch(cmd_buf, RT_RADIANCE_CACHE_CELLS / radiance_cache::AGE_SLICES / 64, 1, 1);
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		vk_helpers::debug_marker_pop(cmd_buf, "Radiance Cache Age");
+
+		vk_helpers::debug_marker_push(cmd_buf, "Trace Rays");
+		bind_rt_pipeline(cmd_buf, m_rt_desc_sets[img_idx]);
+
+		using Region = ShaderBindingTableBuilder::Region;
+		const VkStridedDeviceAddressRegionKHR raygen_region = m_rt_sbt_layout->region(Region::Raygen, m_rt_sbt_address);
+		const VkStridedDeviceAddressRegionKHR miss_region = m_rt_sbt_layout->region(Region::Miss, m_rt_sbt_address);
+		const VkStridedDeviceAddressRegionKHR hitgroup_region = m_rt_sbt_layout->region(Region::Hit, m_rt_sbt_address);
+		const VkStridedDeviceAddressRegionKHR callable_region = m_rt_sbt_layout->region(Region::Callable, m_rt_sbt_address);
+		// the render size is read from the indirect buffer at execution
+		const VkDeviceAddress indirect_address = vk_helpers::get_buffer_address(m_device, m_rt_indirect_buffers[img_idx].buffer);
+		for (uint32_t d = 0; d < dispatch_count; ++d) {
+			if (d > 0) {
+				// the next dispatch accumulates on top of the previous one
+				vk_helpers::memory_barrier(cmd_buf,
+					VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+					VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+			}
+			if (raster_primary_active()) {
+				// every dispatch starts its first sample at surfaces rasterized through its own jitter
+				record_gbuffer_commands(cmd_buf, img_idx, d);
+			}
+			RTPushConstants pc = {};
+			pc.dispatch_index = d;
+			vkCmdPushConstants(cmd_buf, m_rt_pipeline_layout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(RTPushConstants), &pc);
+			vkCmdTraceRaysIndirectKHR(cmd_buf,
+				&raygen_region, &miss_region, &hitgroup_region, &callable_region,
+				indirect_address + offsetof(RTIndirectCommands, trace));
+		}
+		vk_helpers::debug_marker_pop(cmd_buf, "Trace Rays");
+	}
 
-		vk_helpers::image_barrier(m_rt_cmd_buffers[i], m_rt_img.image, isr,
-			VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL,
-			VK_PIPELINE_STAGE_2_BLIT_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	// denoise and resolve read the accumulation images, the host reads the stats after the fence
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_HOST_BIT_KHR, 
+		VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_HOST_READ_BIT_KHR);
+
+	vk_helpers::debug_marker_push(cmd_buf, "Denoise");
+	vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_denoise_pipeline);
+	vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_denoise_pipeline_layout,
+		0, 1, &m_denoise_desc_sets[img_idx], 0, nullptr);
+	for (uint32_t it = 0; it < RT_DENOISE_ITERATIONS; ++it) {
+		if (it > 0) {
+			// every iteration filters the output of the previous one
+			vk_helpers::memory_barrier(cmd_buf,
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+		}
+		DenoisePushConstants pc = {};
+		pc.iteration = it;
+		vkCmdPushConstants(cmd_buf, m_denoise_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants), &pc);
+		vkCmdDispatchIndirect(cmd_buf, m_rt_indirect_buffers[img_idx].buffer, offsetof(RTIndirectCommands, tiles));
+	}
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+		VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+	vk_helpers::debug_marker_pop(cmd_buf, "Denoise");
+
+	vk_helpers::debug_marker_push(cmd_buf, "Resolve");
+
+	vk_helpers::image_barrier(cmd_buf, m_swapchain_images[img_idx], isr,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, // semaphore waits to get image for write in this stage, the layout change must happen after this
+		VK_ACCESS_2_NONE_KHR,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+		VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+		VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR);
+
+	VkRenderingAttachmentInfoKHR color_attachment_info = {};
+	color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	color_attachment_info.imageView = m_swapchain_img_views[img_idx];
+	color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
+	color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+	VkRenderingInfoKHR rp_info = {};
+	rp_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+	rp_info.renderArea.offset = { 0, 0 };
+	rp_info.renderArea.extent = m_swapchain_extent;
+	rp_info.layerCount = 1;
+	rp_info.colorAttachmentCount = 1;
+	rp_info.pColorAttachments = &color_attachment_info;
+
+	vkCmdBeginRenderingKHR(cmd_buf, &rp_info);
+	vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_resolve_pipeline);
+	vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_resolve_pipeline_layout,
+		0, 1, &m_resolve_desc_sets[img_idx], 0, nullptr);
+	vkCmdDraw(cmd_buf, 3, 1, 0, 0);
+	vkCmdEndRenderingKHR(cmd_buf);
+
+	vk_helpers::image_barrier(cmd_buf, m_swapchain_images[img_idx], isr,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR,
+		VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	vk_helpers::debug_marker_pop(cmd_buf, "Resolve");
+	res = vkEndCommandBuffer(cmd_buf);
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error("failed to end recording commands");
+	}
+}
 
-		vk_helpers::debug_marker_pop(m_rt_cmd_buffers[i], "Trace Rays");
+void BaseApplication::record_gbuffer_commands(VkCommandBuffer cmd_buf, uint32_t img_idx, uint32_t dispatch_index)
+{
+	vk_helpers::debug_marker_push(cmd_buf, "GBuffer");
+
+	// the previous frame's raygen reads the gbuffer, the raster path uses the depth image
+	VkImageSubresourceRange isr_depth = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR);
+	vk_helpers::image_barrier(cmd_buf, m_depth_img.image, isr_depth,
+		VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+	// pixels without a surface stay 0
+	VkRenderingAttachmentInfoKHR color_attachment_info = {};
+	color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	color_attachment_info.imageView = m_rt_gbuffer_img_view;
+	color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	color_attachment_info.clearValue.color.uint32[0] = 0;
+	VkRenderingAttachmentInfoKHR depth_attachment_info = {};
+	depth_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	depth_attachment_info.imageView = m_depth_img_view;
+	depth_attachment_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depth_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depth_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment_info.clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderingInfoKHR rp_info = {};
+	rp_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+	rp_info.renderArea.offset = { 0, 0 };
+	rp_info.renderArea.extent = m_swapchain_extent;
+	rp_info.layerCount = 1;
+	rp_info.colorAttachmentCount = 1;
+	rp_info.pColorAttachments = &color_attachment_info;
+	rp_info.pDepthAttachment = &depth_attachment_info;
+
+	vkCmdBeginRenderingKHR(cmd_buf, &rp_info);
+	vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gbuffer_pipeline);
+	VkBuffer buffers[] = { m_vertex_buffer.buffer };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(cmd_buf, 0, 1, buffers, offsets);
+	vkCmdBindIndexBuffer(cmd_buf, m_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_gbuffer_pipeline_layout,
+		0, 1, &m_desc_sets[img_idx], 0, nullptr);
+	// the model parts are the geometry table entries of the model instance, in the same order
+	GBufferPushConstants pc = {};
+	pc.dispatch_index = dispatch_index;
+	for (uint32_t g = 0; g < m_model_parts.size(); ++g) {
+		const ModelPart &p = m_model_parts[g];
+		pc.geometry = g;
+		vkCmdPushConstants(cmd_buf, m_gbuffer_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GBufferPushConstants), &pc);
+		vkCmdDrawIndexed(cmd_buf, p.index_count, 1, p.index_offset, p.vertex_offset, 0);
+	}
+	vkCmdEndRenderingKHR(cmd_buf);
 
-		vk_helpers::debug_marker_push(m_rt_cmd_buffers[i], "Blit");
-		
-		vk_helpers::image_barrier(m_rt_cmd_buffers[i], m_swapchain_images[i], isr,
-			VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_PIPELINE_STAGE_2_BLIT_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-        VkImageBlit blit = {};
-        blit.dstOffsets[0] = { 0, 0, 0 };
-        blit.dstOffsets[1] = { int32_t(m_width), int32_t(m_height), 1 };
-        blit.srcOffsets[0] = { 0, 0, 0 };
-        blit.srcOffsets[1] = { int32_t(m_width), int32_t(m_height), 1 };
-        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-        vkCmdBlitImage(m_rt_cmd_buffers[i],
-                m_rt_img.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                m_swapchain_images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
-
-		vk_helpers::image_barrier(m_rt_cmd_buffers[i], m_swapchain_images[i], isr,
-			VK_PIPELINE_STAGE_2_BLIT_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-
-		vk_helpers::debug_marker_pop(m_rt_cmd_buffers[i], "Blit");
-		res = vkEndCommandBuffer(m_rt_cmd_buffers[i]);
-		if (res != VK_SUCCESS) {
-			throw std::runtime_error("failed to end recording commands");
+	vk_helpers::memory_barrier(cmd_buf,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+		VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR);
+	vk_helpers::debug_marker_pop(cmd_buf, "GBuffer");
+}
+
+void BaseApplication::record_wavefront_commands(VkCommandBuffer cmd_buf, uint32_t img_idx, uint32_t dispatch_count)
+{
+	vk_helpers::debug_marker_push(cmd_buf, "Wavefront");
+	vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_rt_compute_pipeline_layout,
+		0, 1, &m_rt_desc_sets[img_idx], 0, nullptr);
+
+	// every pass reads what the previous one wrote, the queue counts also feed the indirect dispatches
+	auto pass_barrier = [cmd_buf]() {
+		vk_helpers::memory_barrier(cmd_buf,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR |
+			VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+	};
+	auto bind_pass = [&](WavefrontPass pass, uint32_t d, uint32_t bounce, uint32_t sort_pass = 0) {
+		vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_wavefront_pipelines[pass]);
+		WavefrontPushConstants pc = {};
+		pc.dispatch_index = d;
+		pc.bounce = bounce;
+		pc.sort_pass = sort_pass;
+		pc.depth = m_wavefront_depth;
+		vkCmdPushConstants(cmd_buf, m_rt_compute_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(WavefrontPushConstants), &pc);
+	};
+
+	const VkBuffer indirect_buffer = m_rt_indirect_buffers[img_idx].buffer;
+	const VkBuffer queues = m_wavefront_queues.buffer;
+	for (uint32_t d = 0; d < dispatch_count; ++d) {
+		// empty queues, the generate pass fills the first one
+		pass_barrier();
+		vkCmdFillBuffer(cmd_buf, queues, 0, offsetof(WavefrontQueuesHeader, path_args), 0);
+		pass_barrier();
+		bind_pass(WAVEFRONT_GENERATE, d, 0);
+		vkCmdDispatchIndirect(cmd_buf, indirect_buffer, offsetof(RTIndirectCommands, tiles));
+
+		// the bounces are recorded up to the depth the paths reached in the previous frames, once
+		// all paths ended their dispatches have no workgroups but the barriers between them remain
+		for (uint32_t b = 0; b < m_wavefront_depth; ++b) {
+			pass_barrier();
+			bind_pass(WAVEFRONT_ARGS, d, b);
+			vkCmdDispatch(cmd_buf, 1, 1, 1);
+			pass_barrier();
+			bind_pass(WAVEFRONT_EXTEND, d, b);
+			vkCmdDispatchIndirect(cmd_buf, queues, offsetof(WavefrontQueuesHeader, path_args));
+			if (m_hit_sorting) {
+				// the queue is reordered by the material keys the extend pass wrote, so the
+				// subgroups of the shade pass mostly take the same branch
+				for (uint32_t p = 0; p < RT_SORT_PASSES; ++p) {
+					pass_barrier();
+					bind_pass(WAVEFRONT_SORT_HISTOGRAM, d, b, p);
+					vkCmdDispatchIndirect(cmd_buf, queues, offsetof(WavefrontQueuesHeader, sort_args));
+					pass_barrier();
+					bind_pass(WAVEFRONT_SORT_SCAN, d, b, p);
+					vkCmdDispatch(cmd_buf, 1, 1, 1);
+					pass_barrier();
+					bind_pass(WAVEFRONT_SORT_SCATTER, d, b, p);
+					vkCmdDispatchIndirect(cmd_buf, queues, offsetof(WavefrontQueuesHeader, sort_args));
+				}
+			}
+			// at most one shadow ray per path, so the shadow pass has the dispatch size of the bounce
+			for (auto pass : { WAVEFRONT_SHADE, WAVEFRONT_SHADOW }) {
+				pass_barrier();
+				bind_pass(pass, d, b);
+				vkCmdDispatchIndirect(cmd_buf, queues, offsetof(WavefrontQueuesHeader, path_args));
+			}
+		}
+		if (m_wavefront_depth < RT_WAVEFRONT_MAX_DEPTH) {
+			// counts the paths the last bounce continued, see read_rt_stats()
+			pass_barrier();
+			bind_pass(WAVEFRONT_ARGS, d, m_wavefront_depth);
+			vkCmdDispatch(cmd_buf, 1, 1, 1);
 		}
+
+		pass_barrier();
+		bind_pass(WAVEFRONT_ACCUMULATE, d, 0);
+		vkCmdDispatchIndirect(cmd_buf, indirect_buffer, offsetof(RTIndirectCommands, tiles));
 	}
+	vk_helpers::debug_marker_pop(cmd_buf, "Wavefront");
 }
 
 void BaseApplication::create_sync_objects()
@@ -3119,7 +6141,7 @@ void BaseApplication::create_sync_objects()
 		throw std::runtime_error("failed to create fences");
 }
 
-void BaseApplication::update_uniform_buffer(uint32_t idx)
+void BaseApplication::update_uniform_buffer(uint32_t idx, uint32_t samples_this_frame)
 {
 	static auto start_time = std::chrono::high_resolution_clock::now();
 	//auto curr_time = std::chrono::high_resolution_clock::now();
@@ -3134,7 +6156,42 @@ void BaseApplication::update_uniform_buffer(uint32_t idx)
 	ubo.proj[1][1] *= -1;
 	ubo.iview = glm::inverse(ubo.view);
 	ubo.iproj = glm::inverse(ubo.proj);
-	ubo.samples_accum = (m_samples_accumulated++);
+	// the history of a moved camera or a resized render is found by projecting the primary hits 
+	// with the previous camera to the previous render size
+	ubo.reproject_history = camera_moved() || render_resized() ? 1 : 0;
+	const glm::mat4 prev_view = ubo.reproject_history ? m_prev_view : ubo.view;
+	ubo.prev_view_proj = ubo.proj * prev_view;
+	ubo.prev_camera_pos = glm::inverse(prev_view) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	ubo.render_size = glm::uvec2(m_render_extent.width, m_render_extent.height);
+	ubo.prev_render_size = ubo.reproject_history ? glm::uvec2(m_prev_render_extent.width, m_prev_render_extent.height) : ubo.render_size;
+	m_prev_view = ubo.view;
+	m_prev_render_extent = m_render_extent;
+	ubo.image_size = glm::uvec2(m_swapchain_extent.width, m_swapchain_extent.height);
+	// the rasterized surfaces move through the pixels along the r2 sequence, the first
+	// frame of an accumulation looks through the pixel centers like the traced first sample.
+	// this is the point of the first dispatch, dispatch_jitter() in common.glsl steps on to the others
+	const double launch = double(m_samples_accumulated / launch_samples());
+	ubo.primary_jitter = glm::vec2(float(std::fmod(0.5 + launch * 0.7548776662466927, 1.0)), float(std::fmod(0.5 + launch * 0.5698402909980532, 1.0)));
+	ubo.raster_primary = raster_primary_active() ? 1 : 0;
+	ubo.shadow_mask = shadow_mask();
+	ubo.sphere_stats = m_sphere_stats ? 1 : 0;
+	ubo.frame = uint32_t(m_frame_count);
+	// samples_accum is the number of samples already in the image before this frame
+	ubo.samples_accum = m_samples_accumulated;
+	ubo.samples_per_launch = launch_samples();
+	ubo.exposure = m_exposure;
+	ubo.target_error = m_target_error;
+	ubo.adaptive_sampling = m_adaptive_sampling ? 1 : 0;
+	ubo.adaptive_min_samples = RT_ADAPTIVE_MIN_SAMPLES;
+	ubo.russian_roulette = m_russian_roulette ? 1 : 0;
+	ubo.next_event_estimation = m_next_event_estimation ? 1 : 0;
+	ubo.restir = m_restir ? 1 : 0;
+	ubo.radiance_cache = m_radiance_cache_mode;
+	ubo.sampler = m_sampler;
+	m_samples_accumulated += samples_this_frame;
+	// every launch writes the other layer, the resolve shows the last one
+	ubo.accumulation_layer = (m_samples_accumulated / launch_samples() + 1) % RT_HISTORY_LAYERS;
+	ubo.denoise_iterations = m_denoiser ? RT_DENOISE_ITERATIONS : 0;
 
 	ubo.light_pos = glm::vec4(4.0f * std::cos(time), 4.0f * std::sin(time), 5.0f, 1.0f);
 	void *data;
@@ -3142,12 +6199,25 @@ void BaseApplication::update_uniform_buffer(uint32_t idx)
 	if (res != VK_SUCCESS) throw std::runtime_error("failed to map uniform buffer memory");
 	std::memcpy(data, &ubo, sizeof(SceneUniforms));
 	vmaUnmapMemory(m_allocator, m_uni_buffers[idx].alloc);
+
+	RTIndirectCommands cmds = {};
+	cmds.trace = { m_render_extent.width, m_render_extent.height, 1 };
+	cmds.tiles = { (m_render_extent.width + 7) / 8, (m_render_extent.height + 7) / 8, 1 };
+	res = vmaMapMemory(m_allocator, m_rt_indirect_buffers[idx].alloc, &data);
+	if (res != VK_SUCCESS) throw std::runtime_error("failed to map indirect buffer memory");
+	std::memcpy(data, &cmds, sizeof(RTIndirectCommands));
+	vmaUnmapMemory(m_allocator, m_rt_indirect_buffers[idx].alloc);
 }
 
 void BaseApplication::draw_frame()
 {
+	poll_raytracing_pipeline();
+	const bool raytraced = raytracing_active();
+
 	vkWaitForFences(m_device, 1, &m_fen_flight[m_current_frame_idx], 
 					VK_TRUE, std::numeric_limits<uint64_t>::max());
+	// the frame that used this fence slot has completed, so has everything before it
+	m_deletion_queue.flush(m_frame_count);
 	
 	uint32_t img_idx;
 	auto res = vkAcquireNextImageKHR(m_device, m_swapchain, std::numeric_limits<uint64_t>::max(),
@@ -3160,18 +6230,56 @@ void BaseApplication::draw_frame()
 	} else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) {
 		throw std::runtime_error("failed to acquire swapchain image");
 	}
+	// the image can be acquired while the submission that last rendered it, from another fence
+	// slot, is still running. its uniforms, indirect commands and stats are reused per image
+	if (m_images_in_flight[img_idx] != VK_NULL_HANDLE) {
+		vkWaitForFences(m_device, 1, &m_images_in_flight[img_idx], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	m_images_in_flight[img_idx] = m_fen_flight[m_current_frame_idx];
+
+	// a reset or a camera move since the previous frame starts a new time to target measurement
+	const bool moved = camera_moved();
+	update_render_extent(raytraced, moved);
+	const bool reprojected = moved || render_resized();
+	if (m_samples_accumulated == 0 || reprojected) {
+		m_accumulation_start = std::chrono::high_resolution_clock::now();
+		m_accumulation_epoch++;
+		m_target_reported = false;
+	}
+	if (raytraced) {
+		read_rt_stats(img_idx);
+	}
 
-	update_uniform_buffer(img_idx);
+	// throughput mode traces several dispatches before presenting, as long as
+	// nothing reset the accumulation since the previous frame and the camera is static
+	const bool throughput = raytraced && m_throughput_mode && m_samples_accumulated > 0 && !reprojected;
+	const uint32_t dispatch_count = throughput ? RT_THROUGHPUT_DISPATCHES : 1;
+	update_uniform_buffer(img_idx, raytraced ? dispatch_count * launch_samples() : 1);
+
+	// buffer writes go in front of the frame, the fence of this slot has signaled so its command buffer is free
+	std::array<VkCommandBufferSubmitInfoKHR, 2> cmd_submits = {};
+	uint32_t cmd_submit_count = 0;
+	if (pending_writes()) {
+		VkCommandBuffer write_cmd_buf = m_frame_cmd_buffers[m_current_frame_idx];
+		vkResetCommandPool(m_device, m_frame_cmd_pools[m_current_frame_idx], 0);
+		VkCommandBufferBeginInfo bi = {};
+		bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		res = vkBeginCommandBuffer(write_cmd_buf, &bi);
+		if (res != VK_SUCCESS) { throw std::runtime_error("failed to begin recording commands"); }
+		record_pending_writes(write_cmd_buf);
+		res = vkEndCommandBuffer(write_cmd_buf);
+		if (res != VK_SUCCESS) { throw std::runtime_error("failed to record command buffer"); }
+		cmd_submits[cmd_submit_count].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+		cmd_submits[cmd_submit_count].commandBuffer = write_cmd_buf;
+		cmd_submit_count++;
+	}
 
 	VkSemaphoreSubmitInfoKHR wait_sem = {};
 	wait_sem.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
 	wait_sem.semaphore = m_sem_img_available[m_current_frame_idx];
-	if (!m_raytraced) {
-		wait_sem.stageMask =
-			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
-	} else {
-		wait_sem.stageMask = VK_PIPELINE_STAGE_2_BLIT_BIT_KHR;
-	}
+	// both the raster pass and the rt resolve pass write the swapchain image as color attachment
+	wait_sem.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
 	wait_sem.deviceIndex = 0;
 
 	// signals when everything is done
@@ -3181,9 +6289,13 @@ void BaseApplication::draw_frame()
 	signal_sem.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
 	signal_sem.deviceIndex = 0;
 
-	VkCommandBufferSubmitInfoKHR cmd_submit = {};
+	VkCommandBufferSubmitInfoKHR &cmd_submit = cmd_submits[cmd_submit_count++];
 	cmd_submit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
-	cmd_submit.commandBuffer = m_raytraced ? m_rt_cmd_buffers[img_idx] : m_cmd_buffers[img_idx];
+	if (!raytraced) {
+		cmd_submit.commandBuffer = m_cmd_buffers[img_idx];
+	} else {
+		cmd_submit.commandBuffer = throughput ? m_rt_throughput_cmd_buffers[img_idx] : m_rt_cmd_buffers[img_idx];
+	}
 	cmd_submit.deviceMask = 0;
 	
 	VkSubmitInfo2KHR submit_info = {};
@@ -3192,8 +6304,8 @@ void BaseApplication::draw_frame()
 	submit_info.pWaitSemaphoreInfos = &wait_sem;
 	submit_info.signalSemaphoreInfoCount = 1;
 	submit_info.pSignalSemaphoreInfos = &signal_sem;
-	submit_info.commandBufferInfoCount = 1;
-	submit_info.pCommandBufferInfos = &cmd_submit;
+	submit_info.commandBufferInfoCount = cmd_submit_count;
+	submit_info.pCommandBufferInfos = cmd_submits.data();
 
 	// we reset fences here because we need it after checking for swapchain recreation
 	// else we could apply it after vkWaitForFences
@@ -3202,6 +6314,8 @@ void BaseApplication::draw_frame()
 	if (res != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit command buffers to queue");
 	}
+	m_rt_stats_epoch[img_idx] = raytraced ? m_accumulation_epoch : 0;
+	m_rt_stats_extent[img_idx] = m_render_extent;
 
 	VkPresentInfoKHR pi = {};
 	pi.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -3214,6 +6328,14 @@ void BaseApplication::draw_frame()
 	pi.pResults = nullptr;
 
 	res = vkQueuePresentKHR(m_present_queue, &pi);
+#if defined(ENABLE_DEBUG_MARKERS)
+	if (!m_first_frame_presented) {
+		m_first_frame_presented = true;
+		auto elapsed = std::chrono::high_resolution_clock::now() - m_init_time;
+		fprintf(stdout, "first frame presented after %.1f ms\n",
+			std::chrono::duration<float, std::chrono::milliseconds::period>(elapsed).count());
+	}
+#endif
 	if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || m_window_resized) {
 		m_window_resized = false;
 		recreate_swapchain();
@@ -3221,6 +6343,7 @@ void BaseApplication::draw_frame()
 		throw std::runtime_error("failed to present swapchain image");
 	}
 	m_current_frame_idx = (m_current_frame_idx + 1) % MAX_FRAMES_IN_FLIGHT;
+	m_frame_count++;
 }
 
 int main()
@@ -0,0 +1,106 @@
+#include "radiance_cache.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace radiance_cache
+{
+
+uint32_t pcg_hash(uint32_t v)
+{
+	const uint32_t state = v * 747796405u + 2891336453u;
+	const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint32_t level(float dist)
+{
+	return uint32_t(std::clamp(std::floor(std::log2(std::max(dist / LOD_DISTANCE, 1.0f))), 0.0f, 15.0f));
+}
+
+void key(const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec3 &camera_pos, uint32_t &slot_hash, uint32_t &checksum)
+{
+	const uint32_t lod = level(glm::length(pos - camera_pos));
+	const float cell_size = CELL_SIZE * float(1u << lod);
+	uint32_t p[3];
+	uint32_t n[3];
+	for (int i = 0; i < 3; ++i) {
+		// negative cells wrap like uvec3(ivec3()) does
+		p[i] = uint32_t(int32_t(std::floor(pos[i] / cell_size)));
+		n[i] = uint32_t(std::clamp((normal[i] * 0.5f + 0.5f) * 4.0f, 0.0f, 3.0f));
+	}
+	const uint32_t rest = lod | (n[0] << 4u) | (n[1] << 6u) | (n[2] << 8u);
+
+	slot_hash = pcg_hash(pcg_hash(pcg_hash(pcg_hash(p[0]) + p[1]) + p[2]) + rest);
+	const uint32_t c = pcg_hash(pcg_hash(pcg_hash(pcg_hash(p[2] ^ 0x68e31da4u) ^ p[1]) ^ p[0]) ^ rest);
+	checksum = std::max(c, 1u);
+}
+
+int find(std::vector<Cell> &cells, uint32_t slot_hash, uint32_t checksum, bool insert)
+{
+	const uint32_t mask = uint32_t(cells.size()) - 1u;
+	for (uint32_t i = 0; i < PROBES; ++i) {
+		const uint32_t slot = (slot_hash + i) & mask;
+		const uint32_t c = cells[slot].checksum;
+		if (c == checksum) return int(slot);
+		if (c == 0u) {
+			if (!insert) return -1;
+			cells[slot].checksum = checksum;
+			return int(slot);
+		}
+	}
+	return -1;
+}
+
+void insert(std::vector<Cell> &cells, const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec3 &camera_pos, const glm::vec3 &radiance, uint32_t frame)
+{
+	for (int i = 0; i < 3; ++i) {
+		if (std::isnan(radiance[i]) || std::isinf(radiance[i])) return;
+	}
+	uint32_t slot_hash, checksum;
+	key(pos, normal, camera_pos, slot_hash, checksum);
+	const int cell = find(cells, slot_hash, checksum, true);
+	if (cell < 0) return;
+	cells[cell].last_used = frame;
+	if (cells[cell].sample_count >= MAX_SAMPLES) return;
+
+	for (int i = 0; i < 3; ++i) {
+		cells[cell].radiance[i] += uint32_t(std::clamp(radiance[i], 0.0f, MAX_RADIANCE) * FIXED_POINT + 0.5f);
+	}
+	cells[cell].sample_count++;
+}
+
+bool lookup(std::vector<Cell> &cells, const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec3 &camera_pos, uint32_t frame, glm::vec3 &radiance)
+{
+	radiance = glm::vec3(0.0f);
+	uint32_t slot_hash, checksum;
+	key(pos, normal, camera_pos, slot_hash, checksum);
+	const int cell = find(cells, slot_hash, checksum, false);
+	if (cell < 0) return false;
+	cells[cell].last_used = frame;
+
+	const uint32_t count = cells[cell].sample_count;
+	if (count < MIN_SAMPLES) return false;
+	for (int i = 0; i < 3; ++i) {
+		radiance[i] = float(cells[cell].radiance[i]) / (float(count) * FIXED_POINT);
+	}
+	return true;
+}
+
+void age(std::vector<Cell> &cells, uint32_t slot, uint32_t frame)
+{
+	// unsigned, so the frame counter may wrap
+	if (cells[slot].checksum == 0u || frame - cells[slot].last_used <= MAX_AGE) return;
+	cells[slot] = Cell{};
+}
+
+void age_slice(std::vector<Cell> &cells, uint32_t frame)
+{
+	const uint32_t slice_size = uint32_t(cells.size()) / AGE_SLICES;
+	const uint32_t begin = frame % AGE_SLICES * slice_size;
+	for (uint32_t slot = begin; slot < begin + slice_size; ++slot) {
+		age(cells, slot, frame);
+	}
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef RADIANCE_CACHE_H
+#define RADIANCE_CACHE_H
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// cpu mirror of shaders/radiance_cache.glsl, the key, the linear probing, the fixed point sums and the aging.
+// the shader claims and updates the cells with atomics, here they are updated in order
+namespace radiance_cache
+{
+	// matches RadianceCacheCell
+	struct Cell
+	{
+		uint32_t checksum; // 0 for a free cell
+		uint32_t sample_count;
+		uint32_t radiance[3]; // fixed point sums
+		uint32_t last_used; // frame of the last insert or lookup
+	};
+
+	const float CELL_SIZE = 0.02f;
+	const float LOD_DISTANCE = 2.0f;
+	const uint32_t PROBES = 8;
+	const uint32_t MIN_SAMPLES = 16;
+	const uint32_t MAX_SAMPLES = 4096;
+	const float FIXED_POINT = 256.0f;
+	const float MAX_RADIANCE = 64.0f;
+	const uint32_t MAX_AGE = 256;
+	const uint32_t AGE_SLICES = 16;
+
+	// pcg_hash() of random.glsl
+	uint32_t pcg_hash(uint32_t v);
+
+	uint32_t level(float dist);
+	void key(const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec3 &camera_pos, uint32_t &slot_hash, uint32_t &checksum);
+
+	// radiance_cache_find(), the cell count must be a power of two
+	int find(std::vector<Cell> &cells, uint32_t slot_hash, uint32_t checksum, bool insert);
+
+	void insert(std::vector<Cell> &cells, const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec3 &camera_pos, const glm::vec3 &radiance, uint32_t frame);
+	bool lookup(std::vector<Cell> &cells, const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec3 &camera_pos, uint32_t frame, glm::vec3 &radiance);
+
+	// radiance_cache_age()
+	void age(std::vector<Cell> &cells, uint32_t slot, uint32_t frame);
+	// radiance_cache_age.comp, the slice of the cells the frame visits
+	void age_slice(std::vector<Cell> &cells, uint32_t frame);
+}
+
+#endif
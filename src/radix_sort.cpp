@@ -0,0 +1,73 @@
+#include "radix_sort.h"
+
+#include <stdexcept>
+
+namespace radix_sort
+{
+
+static uint32_t digit(uint32_t key, uint32_t pass)
+{
+	return (key >> (pass * RADIX_BITS)) & (RADIX - 1);
+}
+
+uint32_t block_count(uint32_t count)
+{
+	return (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+std::vector<uint32_t> histogram(const std::vector<uint32_t> &keys, uint32_t pass)
+{
+	const uint32_t count = uint32_t(keys.size());
+	const uint32_t blocks = block_count(count);
+	std::vector<uint32_t> hist(RADIX * blocks, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		hist[digit(keys[i], pass) * blocks + i / BLOCK_SIZE]++;
+	}
+	return hist;
+}
+
+void scan(std::vector<uint32_t> &histogram)
+{
+	uint32_t sum = 0;
+	for (auto &h : histogram) {
+		const uint32_t c = h;
+		h = sum;
+		sum += c;
+	}
+}
+
+void scatter(const std::vector<uint32_t> &keys, const std::vector<uint32_t> &values,
+	const std::vector<uint32_t> &offsets, uint32_t pass,
+	std::vector<uint32_t> &keys_out, std::vector<uint32_t> &values_out)
+{
+	const uint32_t count = uint32_t(keys.size());
+	const uint32_t blocks = block_count(count);
+	if (values.size() != count || offsets.size() != RADIX * blocks) {
+		throw std::runtime_error("radix sort inputs do not match the key count");
+	}
+	keys_out.resize(count);
+	values_out.resize(count);
+
+	// a key goes after the keys of its digit in the earlier blocks and the earlier keys of its block
+	std::vector<uint32_t> next(offsets);
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint32_t dst = next[digit(keys[i], pass) * blocks + i / BLOCK_SIZE]++;
+		keys_out[dst] = keys[i];
+		values_out[dst] = values[i];
+	}
+}
+
+void sort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values)
+{
+	std::vector<uint32_t> keys_tmp;
+	std::vector<uint32_t> values_tmp;
+	for (uint32_t pass = 0; pass < PASSES; ++pass) {
+		std::vector<uint32_t> offsets = histogram(keys, pass);
+		scan(offsets);
+		scatter(keys, values, offsets, pass, keys_tmp, values_tmp);
+		std::swap(keys, keys_tmp);
+		std::swap(values, values_tmp);
+	}
+}
+
+}
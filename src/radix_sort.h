@@ -0,0 +1,39 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <vector>
+#include <cstdint>
+
+// cpu reference of the hit sort of the wavefront integrator, shaders/wf_sort_*.comp. it splits the
+// sort into the same kernels, so the buffers of every kernel, read back from any device, can be
+// compared with it element by element
+namespace radix_sort
+{
+	const uint32_t RADIX_BITS = 4;
+	const uint32_t RADIX = 1u << RADIX_BITS;
+	// keys per workgroup of the histogram and scatter kernels
+	const uint32_t BLOCK_SIZE = 256;
+	// material keys of wf_sort.glsl, the passes sort them from the lowest digit up
+	const uint32_t KEY_BITS = 8;
+	const uint32_t PASSES = KEY_BITS / RADIX_BITS;
+	// the values are sorted back into the path queue
+	static_assert(PASSES % 2 == 0, "the last pass must write the first buffers");
+
+	uint32_t block_count(uint32_t count);
+
+	// wf_sort_histogram.comp, keys of each digit of the pass in each block, digit major
+	std::vector<uint32_t> histogram(const std::vector<uint32_t> &keys, uint32_t pass);
+
+	// wf_sort_scan.comp, exclusive prefix sum in place, the offsets of the scatter
+	void scan(std::vector<uint32_t> &histogram);
+
+	// wf_sort_scatter.comp, stable within each block
+	void scatter(const std::vector<uint32_t> &keys, const std::vector<uint32_t> &values, 
+		const std::vector<uint32_t> &offsets, uint32_t pass,
+		std::vector<uint32_t> &keys_out, std::vector<uint32_t> &values_out);
+
+	// all passes, the result of the sort kernels
+	void sort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values);
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "sampler.h"
+
+#include <cmath>
+
+namespace sampler
+{
+
+static uint32_t random_tea(uint32_t val0, uint32_t val1)
+{
+	uint32_t v0 = val0;
+	uint32_t v1 = val1;
+	uint32_t s0 = 0u;
+	for (uint32_t n = 0u; n < 16u; n++) {
+		s0 += 0x9E3779B9u;
+		v0 += ((v1 << 4u) + 0xA341316Cu) ^ (v1 + s0) ^ ((v1 >> 5u) + 0xC8013EA4u);
+		v1 += ((v0 << 4u) + 0xAD90777Du) ^ (v0 + s0) ^ ((v0 >> 5u) + 0x7E95761Eu);
+	}
+	return v0;
+}
+
+static uint32_t random_lcg(uint32_t &seed)
+{
+	const uint32_t LCG_A = 1664525u;
+	const uint32_t LCG_C = 1013904223u;
+	seed = (LCG_A * seed + LCG_C) & 0x3FFFFFFFu;
+	return seed & 0x00FFFFFFu;
+}
+
+static uint32_t bitfield_reverse(uint32_t x)
+{
+	x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+	x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+	x = ((x >> 4u) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4u);
+	x = ((x >> 8u) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8u);
+	return (x >> 16u) | (x << 16u);
+}
+
+static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+uint32_t pcg_hash(uint32_t v)
+{
+	const uint32_t state = v * 747796405u + 2891336453u;
+	const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint32_t sobol_sample(const Tables &tables, uint32_t index, uint32_t dim)
+{
+	uint32_t x = 0u;
+	for (uint32_t bit = 0u; index != 0u; ++bit, index >>= 1u) {
+		if ((index & 1u) != 0u) {
+			x ^= tables.sobol_matrices[dim * sampler_tables::SOBOL_BITS + bit];
+		}
+	}
+	return x;
+}
+
+uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+{
+	x = bitfield_reverse(x);
+	x = laine_karras_permutation(x, seed);
+	return bitfield_reverse(x);
+}
+
+uint32_t init(Type type, uint32_t pixel_x, uint32_t pixel_y, uint32_t width, uint32_t sample_index)
+{
+	if (type == RANDOM) {
+		return random_tea(pixel_y * width + pixel_x, sample_index) & 0x3FFFFFFFu;
+	}
+	return (uint32_t(type) << 30u) | ((sample_index & 0xFFFFFu) << 10u);
+}
+
+float random_float(const Tables &tables, uint32_t &seed, uint32_t pixel_x, uint32_t pixel_y)
+{
+	const uint32_t type = seed >> 30u;
+	if (type == RANDOM) {
+		return float(random_lcg(seed)) / float(0x01000000);
+	}
+
+	const uint32_t index = (seed >> 10u) & 0xFFFFFu;
+	const uint32_t dim = seed & 0x3FFu;
+	seed = (seed & 0xC0000000u) | ((seed + 1u) & 0x3FFFFFFFu);
+
+	const uint32_t pixel_seed = type == SOBOL ? pcg_hash(pixel_x + pcg_hash(pixel_y)) : 0u;
+	const uint32_t pair_seed = pcg_hash(pixel_seed ^ pcg_hash(dim >> 1u));
+	const uint32_t shuffled = nested_uniform_scramble(index, pair_seed);
+	const uint32_t x = nested_uniform_scramble(sobol_sample(tables, shuffled, dim & 1u), pcg_hash(pair_seed + (dim & 1u) + 1u));
+	float u = float(x >> 8u) / float(0x01000000);
+
+	if (type == BLUE_NOISE) {
+		const uint32_t size = tables.blue_noise_size;
+		const uint32_t h = pcg_hash(dim + 0x9E3779B9u);
+		const uint32_t px = (pixel_x + h) % size;
+		const uint32_t py = (pixel_y + (h >> 16u)) % size;
+		const float v = u + tables.blue_noise[py * size + px];
+		u = v - std::floor(v);
+	}
+	return u;
+}
+
+}
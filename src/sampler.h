@@ -0,0 +1,38 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "sampler_tables.h"
+
+// cpu mirror of the samplers of shaders/random.glsl, sampler_init() and random_float(),
+// so their sequences can be checked offline with the tables of sampler_tables.cpp
+namespace sampler
+{
+	enum Type : uint32_t
+	{
+		RANDOM = 0,
+		SOBOL = 1,
+		BLUE_NOISE = 2,
+	};
+
+	// the SamplerTables buffer
+	struct Tables
+	{
+		std::array<uint32_t, sampler_tables::SOBOL_DIMENSIONS * sampler_tables::SOBOL_BITS> sobol_matrices;
+		uint32_t blue_noise_size;
+		std::vector<float> blue_noise;
+	};
+
+	uint32_t pcg_hash(uint32_t v);
+	uint32_t sobol_sample(const Tables &tables, uint32_t index, uint32_t dim);
+	uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed);
+
+	uint32_t init(Type type, uint32_t pixel_x, uint32_t pixel_y, uint32_t width, uint32_t sample_index);
+	// in [0, 1), advances the state to the next dimension
+	float random_float(const Tables &tables, uint32_t &seed, uint32_t pixel_x, uint32_t pixel_y);
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "sampler_tables.h"
+
+#include <cmath>
+#include <random>
+#include <limits>
+#include <stdexcept>
+
+namespace sampler_tables
+{
+
+std::array<uint32_t, SOBOL_DIMENSIONS * SOBOL_BITS> sobol_matrices()
+{
+	std::array<uint32_t, SOBOL_DIMENSIONS * SOBOL_BITS> m = {};
+	// dimension 0 is van der Corput
+	for (uint32_t bit = 0; bit < SOBOL_BITS; ++bit) {
+		m[bit] = 1u << (31 - bit);
+	}
+	// dimension 1 comes from the primitive polynomial x + 1
+	uint32_t v = 1u << 31;
+	for (uint32_t bit = 0; bit < SOBOL_BITS; ++bit) {
+		m[SOBOL_BITS + bit] = v;
+		v ^= v >> 1;
+	}
+	return m;
+}
+
+// Ulichney, "The void-and-cluster method for dither array generation".
+// the energy of a pixel is a toroidal gaussian sum over the set pixels, clusters 
+// are the set pixels of highest energy and voids the free pixels of lowest energy
+class VoidAndCluster
+{
+	uint32_t m_size;
+	std::vector<float> m_kernel; // gaussian by toroidal offset
+	std::vector<float> m_energy;
+	std::vector<uint8_t> m_set;
+
+public:
+	explicit VoidAndCluster(uint32_t size)
+		: m_size(size)
+		, m_kernel(size_t(size) * size)
+		, m_energy(size_t(size) * size, 0.0f)
+		, m_set(size_t(size) * size, 0)
+	{
+		const float sigma = 1.9f;
+		for (uint32_t y = 0; y < size; ++y) {
+			for (uint32_t x = 0; x < size; ++x) {
+				const float dx = float(std::min(x, size - x));
+				const float dy = float(std::min(y, size - y));
+				m_kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+			}
+		}
+	}
+
+	bool is_set(uint32_t p) const { return m_set[p] != 0; }
+
+	void set(uint32_t p, bool value)
+	{
+		m_set[p] = value ? 1 : 0;
+		const float sign = value ? 1.0f : -1.0f;
+		const uint32_t px = p % m_size;
+		const uint32_t py = p / m_size;
+		for (uint32_t y = 0; y < m_size; ++y) {
+			const uint32_t ky = (y + m_size - py) % m_size;
+			for (uint32_t x = 0; x < m_size; ++x) {
+				const uint32_t kx = (x + m_size - px) % m_size;
+				m_energy[y * m_size + x] += sign * m_kernel[ky * m_size + kx];
+			}
+		}
+	}
+
+	uint32_t tightest_cluster() const
+	{
+		uint32_t best = 0;
+		float best_energy = -std::numeric_limits<float>::max();
+		for (uint32_t p = 0; p < m_energy.size(); ++p) {
+			if (m_set[p] && m_energy[p] > best_energy) {
+				best_energy = m_energy[p];
+				best = p;
+			}
+		}
+		return best;
+	}
+
+	uint32_t largest_void() const
+	{
+		uint32_t best = 0;
+		float best_energy = std::numeric_limits<float>::max();
+		for (uint32_t p = 0; p < m_energy.size(); ++p) {
+			if (!m_set[p] && m_energy[p] < best_energy) {
+				best_energy = m_energy[p];
+				best = p;
+			}
+		}
+		return best;
+	}
+};
+
+std::vector<float> blue_noise_tile(uint32_t size, uint32_t seed)
+{
+	if (size < 4) throw std::runtime_error("blue noise tile is too small");
+	const uint32_t count = size * size;
+
+	// random initial pattern, relaxed until the tightest cluster is the largest void
+	VoidAndCluster vc(size);
+	std::mt19937 engine(seed);
+	std::uniform_int_distribution<uint32_t> dist(0, count - 1);
+	uint32_t initial = count / 10;
+	for (uint32_t i = 0; i < initial;) {
+		uint32_t p = dist(engine);
+		if (vc.is_set(p)) continue;
+		vc.set(p, true);
+		++i;
+	}
+	for (uint32_t iter = 0; iter < count; ++iter) {
+		const uint32_t cluster = vc.tightest_cluster();
+		vc.set(cluster, false);
+		const uint32_t void_p = vc.largest_void();
+		vc.set(void_p, true);
+		if (void_p == cluster) break;
+	}
+	std::vector<uint8_t> initial_pattern(count);
+	for (uint32_t p = 0; p < count; ++p) {
+		initial_pattern[p] = vc.is_set(p) ? 1 : 0;
+	}
+
+	std::vector<uint32_t> ranks(count, 0);
+
+	// ranks below the initial pattern, by removing clusters
+	{
+		VoidAndCluster removal(size);
+		for (uint32_t p = 0; p < count; ++p) {
+			if (initial_pattern[p]) removal.set(p, true);
+		}
+		for (uint32_t rank = initial; rank-- > 0;) {
+			const uint32_t p = removal.tightest_cluster();
+			removal.set(p, false);
+			ranks[p] = rank;
+		}
+	}
+	// ranks above, by filling voids
+	for (uint32_t rank = initial; rank < count; ++rank) {
+		const uint32_t p = vc.largest_void();
+		vc.set(p, true);
+		ranks[p] = rank;
+	}
+
+	std::vector<float> tile(count);
+	for (uint32_t p = 0; p < count; ++p) {
+		tile[p] = (float(ranks[p]) + 0.5f) / float(count);
+	}
+	return tile;
+}
+
+}
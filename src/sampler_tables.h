@@ -0,0 +1,23 @@
+#ifndef SAMPLER_TABLES_H
+#define SAMPLER_TABLES_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// tables of the low discrepancy samplers in random.glsl, generated once at startup
+namespace sampler_tables
+{
+	const uint32_t SOBOL_DIMENSIONS = 2;
+	const uint32_t SOBOL_BITS = 32;
+
+	// generator matrices of the first sobol dimensions, one 32 bit column per index bit.
+	// the shaders pair them with scrambles and shuffles to pad any number of dimensions
+	std::array<uint32_t, SOBOL_DIMENSIONS * SOBOL_BITS> sobol_matrices();
+
+	// size x size tileable blue noise from the void and cluster method, 
+	// the values are the ranks of the pixels mapped to [0, 1)
+	std::vector<float> blue_noise_tile(uint32_t size, uint32_t seed = 1);
+}
+
+#endif
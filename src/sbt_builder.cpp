@@ -0,0 +1,144 @@
+#include "sbt_builder.h"
+
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return ((value + alignment - 1) / alignment) * alignment;
+}
+
+ShaderBindingTableBuilder::ShaderBindingTableBuilder(const VkPhysicalDeviceRayTracingPipelinePropertiesKHR &props)
+	: m_handle_size(props.shaderGroupHandleSize)
+	, m_handle_alignment(props.shaderGroupHandleAlignment)
+	, m_base_alignment(props.shaderGroupBaseAlignment)
+	, m_max_stride(props.maxShaderGroupStride)
+{
+	if (m_handle_size == 0 || m_handle_alignment == 0 || m_base_alignment == 0) {
+		throw std::runtime_error("invalid shader group handle properties");
+	}
+}
+
+uint32_t ShaderBindingTableBuilder::add_record(Region region, uint32_t group_index, const void *data, size_t data_size)
+{
+	// a record that does not fit in the device limit fails here, not when the table is written
+	const size_t region_data_size = std::max(m_data_size[size_t(region)], data_size);
+	record_stride(region, region_data_size);
+
+	Record rec;
+	rec.group_index = group_index;
+	rec.data.resize(data_size);
+	if (data_size) std::memcpy(rec.data.data(), data, data_size);
+
+	auto &records = m_records[size_t(region)];
+	records.push_back(std::move(rec));
+	m_data_size[size_t(region)] = region_data_size;
+	return uint32_t(records.size() - 1);
+}
+
+void ShaderBindingTableBuilder::set_record_data(Region region, uint32_t record, const void *data, size_t data_size)
+{
+	auto &records = m_records[size_t(region)];
+	if (record >= records.size()) {
+		throw std::runtime_error("sbt record " + std::to_string(record) + " is out of range");
+	}
+	if (m_handle_size + data_size > stride(region)) {
+		throw std::runtime_error("sbt record data does not fit in the region stride");
+	}
+	records[record].data.assign((const uint8_t*)data, (const uint8_t*)data + data_size);
+}
+
+VkDeviceSize ShaderBindingTableBuilder::stride(Region region) const
+{
+	if (m_records[size_t(region)].empty()) return 0;
+	return record_stride(region, m_data_size[size_t(region)]);
+}
+
+VkDeviceSize ShaderBindingTableBuilder::record_stride(Region region, size_t data_size) const
+{
+	VkDeviceSize s = align_up(m_handle_size + data_size, m_handle_alignment);
+	// every raygen record can be the start of a region, so it has to be base aligned
+	if (region == Region::Raygen) {
+		s = align_up(s, m_base_alignment);
+	}
+	if (s > m_max_stride) {
+		throw std::runtime_error("sbt stride " + std::to_string(s) + " exceeds the device limit of " + std::to_string(m_max_stride));
+	}
+	return s;
+}
+
+VkDeviceSize ShaderBindingTableBuilder::region_size(Region region) const
+{
+	return stride(region) * record_count(region);
+}
+
+VkDeviceSize ShaderBindingTableBuilder::region_offset(Region region) const
+{
+	VkDeviceSize offset = 0;
+	for (uint32_t r = 0; r < uint32_t(region); ++r) {
+		offset += align_up(region_size(Region(r)), m_base_alignment);
+	}
+	return offset;
+}
+
+VkDeviceSize ShaderBindingTableBuilder::size() const
+{
+	return region_offset(Region::Callable) + region_size(Region::Callable);
+}
+
+VkDeviceSize ShaderBindingTableBuilder::record_offset(Region region, uint32_t record) const
+{
+	return region_offset(region) + stride(region) * record;
+}
+
+VkStridedDeviceAddressRegionKHR ShaderBindingTableBuilder::region(Region region, VkDeviceAddress sbt_address, uint32_t raygen_record) const
+{
+	VkStridedDeviceAddressRegionKHR r = { 0, 0, 0 };
+	if (record_count(region) == 0) return r;
+
+	if (region == Region::Raygen) {
+		// the size of the raygen region must be equal to its stride
+		r.deviceAddress = sbt_address + record_offset(region, raygen_record);
+		r.stride = stride(region);
+		r.size = r.stride;
+	} else {
+		r.deviceAddress = sbt_address + region_offset(region);
+		r.stride = stride(region);
+		r.size = region_size(region);
+	}
+	return r;
+}
+
+void ShaderBindingTableBuilder::write_record(uint8_t *dst, const std::vector<uint8_t> &handles, const Record &record, VkDeviceSize stride) const
+{
+	const size_t handle_offset = size_t(record.group_index) * m_handle_size;
+	if (handle_offset + m_handle_size > handles.size()) {
+		throw std::runtime_error("sbt record references shader group " + std::to_string(record.group_index) + " which has no handle");
+	}
+	std::memset(dst, 0, stride);
+	std::memcpy(dst, handles.data() + handle_offset, m_handle_size);
+	if (record.data.size()) {
+		std::memcpy(dst + m_handle_size, record.data.data(), record.data.size());
+	}
+}
+
+void ShaderBindingTableBuilder::write(uint8_t *dst, const std::vector<uint8_t> &handles) const
+{
+	for (uint32_t r = 0; r < uint32_t(Region::Count); ++r) {
+		write_records(dst, handles, Region(r), 0, record_count(Region(r)));
+	}
+}
+
+void ShaderBindingTableBuilder::write_records(uint8_t *dst, const std::vector<uint8_t> &handles, Region region, uint32_t first, uint32_t count) const
+{
+	const auto &records = m_records[size_t(region)];
+	if (size_t(first) + count > records.size()) {
+		throw std::runtime_error("sbt record range is out of range");
+	}
+	const VkDeviceSize s = stride(region);
+	for (uint32_t i = first; i < first + count; ++i) {
+		write_record(dst + record_offset(region, i), handles, records[i], s);
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef SBT_BUILDER_H
+#define SBT_BUILDER_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include <volk.h>
+
+// lays out a shader binding table from the ray tracing properties of the device,
+// it makes no vulkan calls so it can be checked against made up property sets.
+// records are [group handle | inline data], each region gets the stride of its largest record
+class ShaderBindingTableBuilder
+{
+public:
+	enum class Region : uint32_t { Raygen = 0, Miss, Hit, Callable, Count };
+
+private:
+	struct Record
+	{
+		uint32_t group_index;
+		std::vector<uint8_t> data;
+	};
+
+	uint32_t m_handle_size;
+	uint32_t m_handle_alignment;
+	uint32_t m_base_alignment;
+	uint32_t m_max_stride;
+	std::array<std::vector<Record>, size_t(Region::Count)> m_records;
+	// largest inline data added to each region, it sets the stride. set_record_data()
+	// does not change it, so the layout stays the one of the buffer on the device
+	std::array<size_t, size_t(Region::Count)> m_data_size{};
+
+public:
+	explicit ShaderBindingTableBuilder(const VkPhysicalDeviceRayTracingPipelinePropertiesKHR &props);
+
+	// appends a record for the shader group at group_index, data is stored after the handle.
+	// returns the index of the record in its region
+	uint32_t add_record(Region region, uint32_t group_index, const void *data = nullptr, size_t data_size = 0);
+	template<typename T>
+	uint32_t add_record(Region region, uint32_t group_index, const T &data)
+	{
+		return add_record(region, group_index, &data, sizeof(T));
+	}
+
+	// replaces the inline data of a record, it must fit in the stride of the region. the stride is
+	// fixed by the records added, so the record can be rewritten in place with write_records()
+	void set_record_data(Region region, uint32_t record, const void *data, size_t data_size);
+
+	uint32_t record_count(Region region) const { return uint32_t(m_records[size_t(region)].size()); }
+	VkDeviceSize stride(Region region) const;
+	VkDeviceSize region_offset(Region region) const;
+	VkDeviceSize region_size(Region region) const;
+	VkDeviceSize size() const;
+
+	// region to pass to vkCmdTraceRaysKHR, the raygen region only covers one record
+	VkStridedDeviceAddressRegionKHR region(Region region, VkDeviceAddress sbt_address, uint32_t raygen_record = 0) const;
+
+	// handles is the output of vkGetRayTracingShaderGroupHandlesKHR for all the groups of the pipeline,
+	// dst must point to the start of a buffer of at least size() bytes
+	void write(uint8_t *dst, const std::vector<uint8_t> &handles) const;
+	void write_records(uint8_t *dst, const std::vector<uint8_t> &handles, Region region, uint32_t first, uint32_t count) const;
+
+private:
+	VkDeviceSize record_stride(Region region, size_t data_size) const;
+	VkDeviceSize record_offset(Region region, uint32_t record) const;
+	void write_record(uint8_t *dst, const std::vector<uint8_t> &handles, const Record &record, VkDeviceSize stride) const;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SCENE_UNIFORMS_H
+#define SCENE_UNIFORMS_H
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// SceneUniforms of common.glsl, the std140 uniform buffer of all passes
+struct SceneUniforms
+{
+	glm::mat4 model;
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::mat4 iview;
+	glm::mat4 iproj;
+	glm::vec4 light_pos;
+	uint32_t samples_accum;
+	uint32_t samples_per_launch;
+	float exposure;
+	float target_error; // relative standard error at which a pixel counts as converged
+	uint32_t adaptive_sampling; // converged pixels stop tracing
+	uint32_t adaptive_min_samples; // samples before the error estimate is trusted
+	uint32_t russian_roulette; // terminate low throughput paths early
+	uint32_t next_event_estimation; // sample the lights at diffuse hits
+	uint32_t restir; // resampled direct light at the primary hits
+	uint32_t radiance_cache; // 0 off, 1 on, 2 shows the occupied cells
+	uint32_t sampler; // RTSampler
+	uint32_t reproject_history; // the camera or the render size changed, the first launch of the frame reprojects
+	glm::mat4 prev_view_proj; // camera of the previous frame
+	glm::vec4 prev_camera_pos;
+	uint32_t accumulation_layer; // layer written by the last launch of the frame
+	uint32_t denoise_iterations; // 0 shows the accumulation as it is
+	glm::uvec2 render_size; // traced part of the rt images
+	glm::uvec2 prev_render_size;
+	glm::uvec2 image_size; // extent of the rt images, the raster pass draws into their render size part
+	glm::vec2 primary_jitter; // subpixel position of the rasterized primary visibility
+	uint32_t raster_primary; // the first sample of a launch starts at the rasterized surfaces
+	uint32_t shadow_mask; // instance mask of the shadow rays, the instances that cast shadows
+	uint32_t frame; // counts the frames, it wraps
+	uint32_t sphere_stats; // count the sphere intersection tests in the frame stats
+};
+
+#endif
@@ -0,0 +1,38 @@
+
+#include "shader_watcher.h"
+
+void ShaderWatcher::watch(const std::set<std::string> &files)
+{
+	// files we already know keep the time of the last poll, so that 
+	// changes that happened while the pipeline was being rebuilt are not lost
+	for (const auto &f : files) {
+		m_files.try_emplace(f, last_write_time(f));
+	}
+	m_last_poll = std::chrono::steady_clock::now();
+}
+
+std::vector<std::string> ShaderWatcher::poll()
+{
+	std::vector<std::string> changed;
+	auto now = std::chrono::steady_clock::now();
+	if (now - m_last_poll < m_interval) return changed;
+	m_last_poll = now;
+
+	for (auto &[file, time] : m_files) {
+		auto t = last_write_time(file);
+		if (t != time) {
+			time = t;
+			changed.push_back(file);
+		}
+	}
+	return changed;
+}
+
+std::filesystem::file_time_type ShaderWatcher::last_write_time(const std::string &file)
+{
+	// editors may remove and recreate the file while saving, 
+	// in that case we get the minimum time and we will see the change on the next poll
+	std::error_code ec;
+	auto t = std::filesystem::last_write_time(file, ec);
+	return ec ? std::filesystem::file_time_type::min() : t;
+}
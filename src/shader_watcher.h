@@ -0,0 +1,31 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <set>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+
+// polls the modification times of a set of shader files,
+// the set should contain the stage sources and all their transitive includes
+class ShaderWatcher
+{
+private:
+	std::unordered_map<std::string, std::filesystem::file_time_type> m_files;
+	std::chrono::steady_clock::time_point m_last_poll;
+	std::chrono::milliseconds m_interval{ 250 };
+
+public:
+	void watch(const std::set<std::string> &files);
+
+	// returns the watched files that changed since the last call,
+	// the files are checked at most once per interval
+	std::vector<std::string> poll();
+
+private:
+	static std::filesystem::file_time_type last_write_time(const std::string &file);
+};
+
+#endif
@@ -0,0 +1,472 @@
+#include "compute_device.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <shaderc/shaderc.hpp>
+
+#include "shader_dir.h"
+
+static std::string read_text(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file: " + filename);
+	}
+	std::stringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+// includes are relative to the shader directory, like in the application
+class TestShaderIncluder : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+	shaderc_include_result* GetInclude(const char* requested_source, shaderc_include_type type,
+		const char* requesting_source, size_t include_depth) override
+	{
+		const std::string filename = SHADER_DIR + std::string(requested_source);
+		auto [it, inserted] = m_includes.insert({ filename, std::string() });
+		if (inserted) {
+			it->second = read_text(filename);
+		}
+		return new shaderc_include_result{
+			it->first.c_str(),
+			it->first.size(),
+			it->second.c_str(),
+			it->second.size(),
+			nullptr
+		};
+	}
+
+	void ReleaseInclude(shaderc_include_result* data) override
+	{
+		delete data;
+	}
+
+private:
+	std::unordered_map<std::string, std::string> m_includes;
+};
+
+static void check(VkResult res, const char *what)
+{
+	if (res != VK_SUCCESS) {
+		throw std::runtime_error(std::string("failed to ") + what);
+	}
+}
+
+static uint32_t format_size(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_R32_SFLOAT: return 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT: return 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+	default: throw std::runtime_error("unsupported image format");
+	}
+}
+
+ComputeDevice::~ComputeDevice()
+{
+	if (m_device) {
+		vkDeviceWaitIdle(m_device);
+		for (auto p : m_pipelines) vkDestroyPipeline(m_device, p, nullptr);
+		for (auto l : m_pipeline_layouts) vkDestroyPipelineLayout(m_device, l, nullptr);
+		for (auto l : m_set_layouts) vkDestroyDescriptorSetLayout(m_device, l, nullptr);
+		for (auto v : m_views) vkDestroyImageView(m_device, v, nullptr);
+		for (auto i : m_images) vkDestroyImage(m_device, i, nullptr);
+		for (auto b : m_buffers) vkDestroyBuffer(m_device, b, nullptr);
+		for (auto m : m_memory) vkFreeMemory(m_device, m, nullptr);
+		vkDestroyFence(m_device, m_fence, nullptr);
+		vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
+		vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+		vkDestroyDevice(m_device, nullptr);
+	}
+	if (m_instance) {
+		vkDestroyInstance(m_instance, nullptr);
+	}
+}
+
+bool ComputeDevice::init()
+{
+	if (volkInitialize() != VK_SUCCESS) {
+		fprintf(stdout, "no vulkan loader\n");
+		return false;
+	}
+
+	VkApplicationInfo ai = {};
+	ai.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	ai.pApplicationName = "VulkanExperimentsTests";
+	ai.apiVersion = VK_API_VERSION_1_2;
+	VkInstanceCreateInfo ici = {};
+	ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	ici.pApplicationInfo = &ai;
+	if (vkCreateInstance(&ici, nullptr, &m_instance) != VK_SUCCESS) {
+		fprintf(stdout, "no vulkan instance\n");
+		return false;
+	}
+	volkLoadInstance(m_instance);
+
+	uint32_t count = 0;
+	vkEnumeratePhysicalDevices(m_instance, &count, nullptr);
+	std::vector<VkPhysicalDevice> devices(count);
+	vkEnumeratePhysicalDevices(m_instance, &count, devices.data());
+
+	// a cpu device first, then the first one that can run the shaders
+	for (int pass = 0; pass < 2 && !m_physical_device; ++pass) {
+		for (auto d : devices) {
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(d, &props);
+			if (props.apiVersion < VK_API_VERSION_1_2) continue;
+			if (pass == 0 && props.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU) continue;
+
+			uint32_t family_count = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(d, &family_count, nullptr);
+			std::vector<VkQueueFamilyProperties> families(family_count);
+			vkGetPhysicalDeviceQueueFamilyProperties(d, &family_count, families.data());
+			for (uint32_t i = 0; i < family_count; ++i) {
+				if (families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+					m_physical_device = d;
+					m_props = props;
+					m_queue_family = i;
+					break;
+				}
+			}
+			if (m_physical_device) break;
+		}
+	}
+	if (!m_physical_device) {
+		fprintf(stdout, "no vulkan 1.2 device with a compute queue\n");
+		return false;
+	}
+
+	const float priority = 1.0f;
+	VkDeviceQueueCreateInfo qci = {};
+	qci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	qci.queueFamilyIndex = m_queue_family;
+	qci.queueCount = 1;
+	qci.pQueuePriorities = &priority;
+	VkDeviceCreateInfo dci = {};
+	dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	dci.queueCreateInfoCount = 1;
+	dci.pQueueCreateInfos = &qci;
+	check(vkCreateDevice(m_physical_device, &dci, nullptr, &m_device), "create device");
+	volkLoadDevice(m_device);
+	vkGetDeviceQueue(m_device, m_queue_family, 0, &m_queue);
+
+	VkCommandPoolCreateInfo cpci = {};
+	cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cpci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	cpci.queueFamilyIndex = m_queue_family;
+	check(vkCreateCommandPool(m_device, &cpci, nullptr, &m_command_pool), "create command pool");
+
+	const VkDescriptorPoolSize sizes[] = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 64 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 64 },
+	};
+	VkDescriptorPoolCreateInfo dpci = {};
+	dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	dpci.maxSets = 16;
+	dpci.poolSizeCount = 3;
+	dpci.pPoolSizes = sizes;
+	check(vkCreateDescriptorPool(m_device, &dpci, nullptr, &m_descriptor_pool), "create descriptor pool");
+
+	VkFenceCreateInfo fci = {};
+	fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	check(vkCreateFence(m_device, &fci, nullptr, &m_fence), "create fence");
+
+	fprintf(stdout, "device: %s\n", m_props.deviceName);
+	return true;
+}
+
+uint32_t ComputeDevice::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) const
+{
+	VkPhysicalDeviceMemoryProperties mem_props;
+	vkGetPhysicalDeviceMemoryProperties(m_physical_device, &mem_props);
+	for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i) {
+		if ((type_bits & (1u << i)) && (mem_props.memoryTypes[i].propertyFlags & flags) == flags) {
+			return i;
+		}
+	}
+	throw std::runtime_error("failed to find a memory type");
+}
+
+VkDeviceMemory ComputeDevice::allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags flags)
+{
+	VkMemoryAllocateInfo mai = {};
+	mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mai.allocationSize = reqs.size;
+	mai.memoryTypeIndex = find_memory_type(reqs.memoryTypeBits, flags);
+	VkDeviceMemory memory;
+	check(vkAllocateMemory(m_device, &mai, nullptr, &memory), "allocate memory");
+	m_memory.push_back(memory);
+	return memory;
+}
+
+ComputeDevice::Buffer ComputeDevice::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	Buffer b;
+	b.size = size;
+	VkBufferCreateInfo bci = {};
+	bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bci.size = size;
+	bci.usage = usage;
+	bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	check(vkCreateBuffer(m_device, &bci, nullptr, &b.buffer), "create buffer");
+	m_buffers.push_back(b.buffer);
+
+	VkMemoryRequirements reqs;
+	vkGetBufferMemoryRequirements(m_device, b.buffer, &reqs);
+	VkDeviceMemory memory = allocate(reqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	check(vkBindBufferMemory(m_device, b.buffer, memory, 0), "bind buffer memory");
+	check(vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &b.data), "map buffer memory");
+	std::memset(b.data, 0, size_t(size));
+	return b;
+}
+
+ComputeDevice::Image ComputeDevice::create_image(VkFormat format, uint32_t width, uint32_t height, uint32_t layers)
+{
+	Image img;
+	img.format = format;
+	img.width = width;
+	img.height = height;
+	img.layers = layers;
+
+	VkImageCreateInfo ici = {};
+	ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ici.imageType = VK_IMAGE_TYPE_2D;
+	ici.format = format;
+	ici.extent = { width, height, 1 };
+	ici.mipLevels = 1;
+	ici.arrayLayers = layers ? layers : 1;
+	ici.samples = VK_SAMPLE_COUNT_1_BIT;
+	ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ici.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	check(vkCreateImage(m_device, &ici, nullptr, &img.image), "create image");
+	m_images.push_back(img.image);
+
+	VkMemoryRequirements reqs;
+	vkGetImageMemoryRequirements(m_device, img.image, &reqs);
+	VkDeviceMemory memory = allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	check(vkBindImageMemory(m_device, img.image, memory, 0), "bind image memory");
+
+	VkImageViewCreateInfo vci = {};
+	vci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	vci.image = img.image;
+	vci.viewType = layers ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+	vci.format = format;
+	vci.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, ici.arrayLayers };
+	check(vkCreateImageView(m_device, &vci, nullptr, &img.view), "create image view");
+	m_views.push_back(img.view);
+
+	// the images stay in the general layout, the shaders and the copies use it
+	VkCommandBuffer cmd = begin_commands();
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = img.image;
+	barrier.subresourceRange = vci.subresourceRange;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	// storage images start undefined, clear them like the application does
+	VkClearColorValue clear = {};
+	vkCmdClearColorImage(cmd, img.image, VK_IMAGE_LAYOUT_GENERAL, &clear, 1, &vci.subresourceRange);
+	end_commands(cmd);
+	return img;
+}
+
+void ComputeDevice::copy_image(const Image &image, const Buffer &staging, bool to_image)
+{
+	VkCommandBuffer cmd = begin_commands();
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, image.layers ? image.layers : 1 };
+	region.imageExtent = { image.width, image.height, 1 };
+	if (to_image) {
+		vkCmdCopyBufferToImage(cmd, staging.buffer, image.image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+	} else {
+		vkCmdCopyImageToBuffer(cmd, image.image, VK_IMAGE_LAYOUT_GENERAL, staging.buffer, 1, &region);
+	}
+	end_commands(cmd);
+}
+
+void ComputeDevice::upload(const Image &image, const void *data, VkDeviceSize size)
+{
+	const VkDeviceSize expected = VkDeviceSize(image.width) * image.height * (image.layers ? image.layers : 1) * format_size(image.format);
+	if (size != expected) {
+		throw std::runtime_error("image upload size does not match the image");
+	}
+	Buffer staging = create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	std::memcpy(staging.data, data, size_t(size));
+	copy_image(image, staging, true);
+}
+
+void ComputeDevice::download(const Image &image, void *data, VkDeviceSize size)
+{
+	const VkDeviceSize expected = VkDeviceSize(image.width) * image.height * (image.layers ? image.layers : 1) * format_size(image.format);
+	if (size != expected) {
+		throw std::runtime_error("image download size does not match the image");
+	}
+	Buffer staging = create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	copy_image(image, staging, false);
+	std::memcpy(data, staging.data, size_t(size));
+}
+
+ComputeDevice::Pipeline ComputeDevice::create_pipeline(const std::string &file_name,
+	const std::vector<Binding> &bindings, uint32_t push_constant_size)
+{
+	// the options of BaseApplication::create_shader_module()
+	shaderc::Compiler compiler;
+	shaderc::CompileOptions opts;
+	opts.SetGenerateDebugInfo();
+	opts.SetOptimizationLevel(shaderc_optimization_level_zero);
+	opts.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	opts.SetIncluder(std::make_unique<TestShaderIncluder>());
+	const std::string source = read_text(SHADER_DIR + file_name);
+	auto result = compiler.CompileGlslToSpv(source, shaderc_compute_shader, file_name.c_str(), opts);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+		fprintf(stdout, "SHADERC COMPILE ERROR\n%s", result.GetErrorMessage().c_str());
+		throw std::runtime_error("failed to compile shader");
+	}
+
+	VkShaderModuleCreateInfo smci = {};
+	smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	smci.codeSize = (result.cend() - result.cbegin()) * sizeof(uint32_t);
+	smci.pCode = result.cbegin();
+	VkShaderModule module;
+	check(vkCreateShaderModule(m_device, &smci, nullptr, &module), "create shader module");
+
+	std::vector<VkDescriptorSetLayoutBinding> lbs;
+	for (const auto &b : bindings) {
+		VkDescriptorSetLayoutBinding lb = {};
+		lb.binding = b.binding;
+		lb.descriptorType = b.type;
+		lb.descriptorCount = 1;
+		lb.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		lbs.push_back(lb);
+	}
+	VkDescriptorSetLayoutCreateInfo dslci = {};
+	dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	dslci.bindingCount = uint32_t(lbs.size());
+	dslci.pBindings = lbs.data();
+	VkDescriptorSetLayout set_layout;
+	check(vkCreateDescriptorSetLayout(m_device, &dslci, nullptr, &set_layout), "create descriptor set layout");
+	m_set_layouts.push_back(set_layout);
+
+	Pipeline p;
+	p.push_constant_size = push_constant_size;
+	VkPushConstantRange range = {};
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	range.size = push_constant_size;
+	VkPipelineLayoutCreateInfo plci = {};
+	plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	plci.setLayoutCount = 1;
+	plci.pSetLayouts = &set_layout;
+	plci.pushConstantRangeCount = push_constant_size ? 1 : 0;
+	plci.pPushConstantRanges = &range;
+	check(vkCreatePipelineLayout(m_device, &plci, nullptr, &p.layout), "create pipeline layout");
+	m_pipeline_layouts.push_back(p.layout);
+
+	VkComputePipelineCreateInfo cpci = {};
+	cpci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	cpci.stage.module = module;
+	cpci.stage.pName = "main";
+	cpci.layout = p.layout;
+	const VkResult res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &cpci, nullptr, &p.pipeline);
+	vkDestroyShaderModule(m_device, module, nullptr);
+	check(res, "create compute pipeline");
+	m_pipelines.push_back(p.pipeline);
+
+	VkDescriptorSetAllocateInfo dsai = {};
+	dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsai.descriptorPool = m_descriptor_pool;
+	dsai.descriptorSetCount = 1;
+	dsai.pSetLayouts = &set_layout;
+	check(vkAllocateDescriptorSets(m_device, &dsai, &p.set), "allocate descriptor set");
+
+	std::vector<VkDescriptorBufferInfo> buffer_infos(bindings.size());
+	std::vector<VkDescriptorImageInfo> image_infos(bindings.size());
+	std::vector<VkWriteDescriptorSet> writes;
+	for (size_t i = 0; i < bindings.size(); ++i) {
+		const auto &b = bindings[i];
+		VkWriteDescriptorSet w = {};
+		w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w.dstSet = p.set;
+		w.dstBinding = b.binding;
+		w.descriptorCount = 1;
+		w.descriptorType = b.type;
+		if (b.image) {
+			image_infos[i] = { VK_NULL_HANDLE, b.image->view, VK_IMAGE_LAYOUT_GENERAL };
+			w.pImageInfo = &image_infos[i];
+		} else {
+			buffer_infos[i] = { b.buffer->buffer, 0, VK_WHOLE_SIZE };
+			w.pBufferInfo = &buffer_infos[i];
+		}
+		writes.push_back(w);
+	}
+	vkUpdateDescriptorSets(m_device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+	return p;
+}
+
+void ComputeDevice::dispatch(const Pipeline &pipeline, const void *push_constants, uint32_t groups_x, uint32_t groups_y)
+{
+	VkCommandBuffer cmd = begin_commands();
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1, &pipeline.set, 0, nullptr);
+	if (pipeline.push_constant_size) {
+		vkCmdPushConstants(cmd, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pipeline.push_constant_size, push_constants);
+	}
+	vkCmdDispatch(cmd, groups_x, groups_y, 1);
+	end_commands(cmd);
+}
+
+VkCommandBuffer ComputeDevice::begin_commands()
+{
+	VkCommandBufferAllocateInfo cbai = {};
+	cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cbai.commandPool = m_command_pool;
+	cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cbai.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	check(vkAllocateCommandBuffers(m_device, &cbai, &cmd), "allocate command buffer");
+
+	VkCommandBufferBeginInfo bi = {};
+	bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &bi);
+	return cmd;
+}
+
+void ComputeDevice::end_commands(VkCommandBuffer cmd)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+		VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+	check(vkEndCommandBuffer(cmd), "record command buffer");
+
+	VkSubmitInfo si = {};
+	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	si.commandBufferCount = 1;
+	si.pCommandBuffers = &cmd;
+	check(vkQueueSubmit(m_queue, 1, &si, m_fence), "submit");
+	check(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, UINT64_MAX), "wait for the queue");
+	vkResetFences(m_device, 1, &m_fence);
+	vkFreeCommandBuffers(m_device, m_command_pool, 1, &cmd);
+}
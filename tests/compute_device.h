@@ -0,0 +1,97 @@
+#ifndef COMPUTE_DEVICE_H
+#define COMPUTE_DEVICE_H
+
+#include <string>
+#include <vector>
+
+#include <volk.h>
+
+// a vulkan device for the tests that run the compute shaders of the application. it prefers a
+// cpu implementation like lavapipe, so the tests give the same results on machines without a gpu.
+// the resources live as long as the device, every dispatch is submitted and waited for on its own
+class ComputeDevice
+{
+public:
+	// host visible and coherent, mapped while it lives
+	struct Buffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void *data = nullptr;
+	};
+
+	// a storage image in the general layout, layers > 0 makes a 2d array view
+	struct Image
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t layers = 0;
+	};
+
+	// a resource at a binding of set 0, one of buffer or image is set
+	struct Binding
+	{
+		uint32_t binding;
+		VkDescriptorType type;
+		const Buffer *buffer;
+		const Image *image;
+	};
+
+	struct Pipeline
+	{
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		uint32_t push_constant_size = 0;
+	};
+
+	ComputeDevice() = default;
+	ComputeDevice(const ComputeDevice &) = delete;
+	ComputeDevice &operator=(const ComputeDevice &) = delete;
+	~ComputeDevice();
+
+	// false without a vulkan loader or a vulkan 1.2 device with a compute queue, the test is skipped then
+	bool init();
+	const char *name() const { return m_props.deviceName; }
+
+	Buffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage);
+	Image create_image(VkFormat format, uint32_t width, uint32_t height, uint32_t layers);
+	// texels of all layers, tightly packed
+	void upload(const Image &image, const void *data, VkDeviceSize size);
+	void download(const Image &image, void *data, VkDeviceSize size);
+
+	// compiles shaders/<file_name> and its includes with the options of the application
+	Pipeline create_pipeline(const std::string &file_name, const std::vector<Binding> &bindings, uint32_t push_constant_size);
+	void dispatch(const Pipeline &pipeline, const void *push_constants, uint32_t groups_x, uint32_t groups_y = 1);
+
+private:
+	uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) const;
+	VkDeviceMemory allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags flags);
+	VkCommandBuffer begin_commands();
+	// with a barrier that makes the writes visible to the next submission and the host
+	void end_commands(VkCommandBuffer cmd);
+	void copy_image(const Image &image, const Buffer &staging, bool to_image);
+
+	VkInstance m_instance = VK_NULL_HANDLE;
+	VkPhysicalDevice m_physical_device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_props = {};
+	VkDevice m_device = VK_NULL_HANDLE;
+	uint32_t m_queue_family = 0;
+	VkQueue m_queue = VK_NULL_HANDLE;
+	VkCommandPool m_command_pool = VK_NULL_HANDLE;
+	VkDescriptorPool m_descriptor_pool = VK_NULL_HANDLE;
+	VkFence m_fence = VK_NULL_HANDLE;
+
+	std::vector<VkDeviceMemory> m_memory;
+	std::vector<VkBuffer> m_buffers;
+	std::vector<VkImage> m_images;
+	std::vector<VkImageView> m_views;
+	std::vector<VkDescriptorSetLayout> m_set_layouts;
+	std::vector<VkPipelineLayout> m_pipeline_layouts;
+	std::vector<VkPipeline> m_pipelines;
+};
+
+#endif
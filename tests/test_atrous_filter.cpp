@@ -0,0 +1,134 @@
+#include "atrous_filter.h"
+#include "test_common.h"
+
+#include <cmath>
+
+static const uint32_t WIDTH = 48;
+static const uint32_t HEIGHT = 32;
+// samples per pixel and the standard deviation of the mean radiance
+static const float SAMPLES = 4.0f;
+static const float NOISE = 0.2f;
+
+static float luminance(const glm::vec3 &c)
+{
+	return glm::dot(c, glm::vec3(0.2125f, 0.7154f, 0.0721f));
+}
+
+// uniform in [-0.5, 0.5)
+static float noise(uint32_t p)
+{
+	uint32_t h = p * 747796405u + 2891336453u;
+	h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+	h = (h >> 22u) ^ h;
+	return float(h >> 8) / 16777216.0f - 0.5f;
+}
+
+// a plane facing the camera, the right part is 3 times brighter and 2.5 times farther,
+// the top rows are sky. the moments match the noise added to the mean
+static atrous_filter::Input make_input(bool noisy, std::vector<glm::vec3> &truth)
+{
+	atrous_filter::Input in;
+	in.width = WIDTH;
+	in.height = HEIGHT;
+	const size_t count = size_t(WIDTH) * HEIGHT;
+	in.accumulation.resize(count);
+	in.moments.resize(count);
+	in.surfaces.resize(count);
+	in.albedo.resize(count);
+	truth.resize(count);
+	for (uint32_t y = 0; y < HEIGHT; ++y) {
+		for (uint32_t x = 0; x < WIDTH; ++x) {
+			const size_t p = size_t(y) * WIDTH + x;
+			const bool sky = y < 4;
+			const bool far = x >= WIDTH / 2;
+			// checkered albedo, the filter works on the radiance divided by it
+			const glm::vec3 albedo = ((x / 4 + y / 4) % 2) ? glm::vec3(0.8f, 0.6f, 0.4f) : glm::vec3(0.3f, 0.5f, 0.7f);
+			truth[p] = sky ? glm::vec3(0.5f, 0.7f, 1.0f) : albedo * (far ? 3.0f : 1.0f);
+			const float n = noisy && !sky ? 2.0f * std::sqrt(3.0f) * NOISE * noise(uint32_t(p)) : 0.0f;
+			const glm::vec3 mean = truth[p] + glm::vec3(n);
+			const float lum = luminance(mean);
+			in.accumulation[p] = glm::vec4(mean, SAMPLES);
+			in.moments[p] = lum * lum + (noisy ? SAMPLES * NOISE * NOISE : 0.0f);
+			in.surfaces[p] = glm::vec4(0.0f, 0.0f, -1.0f, sky ? -1.0f : (far ? 5.0f : 2.0f));
+			in.albedo[p] = sky ? glm::vec3(0.0f) : albedo;
+		}
+	}
+	return in;
+}
+
+static double rmse(const std::vector<glm::vec3> &a, const std::vector<glm::vec3> &b, uint32_t x0, uint32_t x1)
+{
+	double sum = 0.0;
+	uint32_t n = 0;
+	for (uint32_t y = 4; y < HEIGHT; ++y) {
+		for (uint32_t x = x0; x < x1; ++x) {
+			const size_t p = size_t(y) * WIDTH + x;
+			const glm::vec3 d = a[p] - b[p];
+			sum += glm::dot(d, d) / 3.0;
+			++n;
+		}
+	}
+	return std::sqrt(sum / n);
+}
+
+// without noise the filter keeps the image, the weights are normalized and the albedo is put back
+static void test_noise_free()
+{
+	std::vector<glm::vec3> truth;
+	const auto in = make_input(false, truth);
+	for (uint32_t iterations : { 0u, 1u, 5u }) {
+		const auto out = atrous_filter::filter(in, iterations);
+		CHECK(rmse(out, truth, 0, WIDTH) < 1e-5);
+	}
+}
+
+// the noise goes down with every iteration, the sky and the depth edge are kept
+static void test_denoise()
+{
+	std::vector<glm::vec3> truth;
+	const auto in = make_input(true, truth);
+	double prev = rmse(atrous_filter::filter(in, 0), truth, 0, WIDTH);
+	fprintf(stdout, "rmse of the accumulation %.4f\n", prev);
+	for (uint32_t iterations = 1; iterations <= 5; ++iterations) {
+		const auto out = atrous_filter::filter(in, iterations);
+		const double near = rmse(out, truth, 0, WIDTH / 2);
+		const double far = rmse(out, truth, WIDTH / 2, WIDTH);
+		const double all = rmse(out, truth, 0, WIDTH);
+		fprintf(stdout, "%u iterations: rmse %.4f, near %.4f, far %.4f\n", iterations, all, near, far);
+		CHECK(all < prev);
+		prev = all;
+
+		for (uint32_t x = 0; x < WIDTH; ++x) {
+			const size_t p = size_t(x);
+			CHECK_NEAR(out[p].x, truth[p].x, 1e-6);
+			CHECK_NEAR(out[p].z, truth[p].z, 1e-6);
+		}
+		// the columns next to the edge do not mix the two depths, the noise averages out over a column
+		for (uint32_t x : { WIDTH / 2 - 1, WIDTH / 2 }) {
+			float out_sum = 0.0f, truth_sum = 0.0f;
+			for (uint32_t y = 4; y < HEIGHT; ++y) {
+				const size_t p = size_t(y) * WIDTH + x;
+				out_sum += luminance(out[p]);
+				truth_sum += luminance(truth[p]);
+			}
+			CHECK(std::fabs(out_sum - truth_sum) < 0.05f * truth_sum);
+		}
+	}
+	CHECK(prev < 0.5 * NOISE);
+}
+
+static void test_invalid_input()
+{
+	std::vector<glm::vec3> truth;
+	auto in = make_input(false, truth);
+	in.moments.pop_back();
+	CHECK_THROWS(atrous_filter::filter(in, 1));
+}
+
+int main()
+{
+	test_noise_free();
+	test_denoise();
+	test_invalid_input();
+	return test_result("test_atrous_filter");
+}
@@ -0,0 +1,236 @@
+#include "atrous_filter.h"
+#include "scene_uniforms.h"
+#include "compute_device.h"
+#include "test_common.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+// shaders/atrous.comp on a fixed input against the cpu reference, on a vulkan device
+
+// the render size is smaller than the images and not a multiple of the workgroup size
+static const uint32_t IMAGE_WIDTH = 72;
+static const uint32_t IMAGE_HEIGHT = 56;
+static const uint32_t RENDER_WIDTH = 67;
+static const uint32_t RENDER_HEIGHT = 53;
+// the layer the last launch wrote, the other one holds values the filter must not read
+static const uint32_t ACCUMULATION_LAYER = 1;
+static const uint32_t MAX_ITERATIONS = 5;
+
+static uint32_t hash(uint32_t v)
+{
+	uint32_t h = v * 747796405u + 2891336453u;
+	h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+	return (h >> 22u) ^ h;
+}
+
+// in [0, 1)
+static float random(uint32_t &seed)
+{
+	seed = hash(seed);
+	return float(seed >> 8) / 16777216.0f;
+}
+
+static uint16_t float_to_half(float f)
+{
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	const uint32_t sign = (x >> 16) & 0x8000u;
+	const int32_t exp = int32_t((x >> 23) & 0xffu) - 127 + 15;
+	const uint32_t mant = x & 0x7fffffu;
+	// the inputs are normal halfs, round to nearest even
+	if (exp <= 0) return uint16_t(sign);
+	if (exp >= 31) return uint16_t(sign | 0x7c00u);
+	uint32_t half = (uint32_t(exp) << 10) | (mant >> 13);
+	const uint32_t rest = mant & 0x1fffu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) ++half;
+	return uint16_t(sign | half);
+}
+
+static float half_to_float(uint16_t h)
+{
+	const uint32_t exp = (h >> 10) & 0x1fu;
+	const uint32_t mant = h & 0x3ffu;
+	const float v = exp ? std::ldexp(float(mant | 0x400u), int(exp) - 25) : std::ldexp(float(mant), -24);
+	return (h & 0x8000u) ? -v : v;
+}
+
+static float quantize(float f)
+{
+	return half_to_float(float_to_half(f));
+}
+
+// noisy radiance on a few surfaces: a floor whose distance grows towards the bottom, a wall
+// with another normal and a sphere in front of it, sky at the top. the albedo is textured
+static atrous_filter::Input make_input()
+{
+	atrous_filter::Input in;
+	in.width = RENDER_WIDTH;
+	in.height = RENDER_HEIGHT;
+	const size_t count = size_t(RENDER_WIDTH) * RENDER_HEIGHT;
+	in.accumulation.resize(count);
+	in.moments.resize(count);
+	in.surfaces.resize(count);
+	in.albedo.resize(count);
+	for (uint32_t y = 0; y < RENDER_HEIGHT; ++y) {
+		for (uint32_t x = 0; x < RENDER_WIDTH; ++x) {
+			const size_t p = size_t(y) * RENDER_WIDTH + x;
+			uint32_t seed = uint32_t(p) * 9781u + 1u;
+			glm::vec3 normal(0.0f, 1.0f, 0.0f);
+			float distance = 0.0f;
+			glm::vec3 light(0.0f);
+			const float sx = float(x) - 45.0f, sy = float(y) - 30.0f;
+			if (sx * sx + sy * sy < 100.0f) {
+				const float z = std::sqrt(100.0f - sx * sx - sy * sy);
+				normal = glm::normalize(glm::vec3(sx, -sy, z));
+				distance = 3.0f - 0.05f * z;
+				light = glm::vec3(2.0f, 1.8f, 1.5f) * std::max(normal.y + 0.5f, 0.1f);
+			} else if (y < 8) {
+				distance = -1.0f;
+				light = glm::vec3(0.4f, 0.6f, 1.0f);
+			} else if (y < 24) {
+				normal = glm::vec3(0.0f, 0.0f, 1.0f);
+				distance = 6.0f;
+				light = glm::vec3(0.8f, 0.8f, 0.9f) * (1.0f + 0.5f * std::sin(0.2f * float(x)));
+			} else {
+				distance = 6.0f - 0.1f * float(y - 24);
+				light = glm::vec3(1.5f, 1.4f, 1.2f);
+			}
+			const glm::vec3 albedo = ((x / 3 + y / 5) % 3) ? glm::vec3(0.7f, 0.5f, 0.3f) : glm::vec3(0.2f, 0.4f, 0.6f);
+			const float samples = float(1 + (hash(seed) & 15u));
+			const float n = (random(seed) - 0.5f) * (distance > 0.0f ? 1.0f : 0.0f);
+			const glm::vec3 mean = glm::max(albedo * light + glm::vec3(n), glm::vec3(0.0f));
+			const float lum = glm::dot(mean, glm::vec3(0.2125f, 0.7154f, 0.0721f));
+
+			// the surfaces and the albedo are stored as half floats, the reference sees the same values
+			in.accumulation[p] = glm::vec4(mean, samples);
+			in.moments[p] = lum * lum + random(seed) * 0.3f;
+			in.surfaces[p] = glm::vec4(quantize(normal.x), quantize(normal.y), quantize(normal.z), quantize(distance));
+			in.albedo[p] = distance > 0.0f ?
+				glm::vec3(quantize(albedo.x), quantize(albedo.y), quantize(albedo.z)) : glm::vec3(0.0f);
+		}
+	}
+	return in;
+}
+
+// texels of an image, the render size part of the accumulation layer comes from the input,
+// the other texels and layers are noise that the filter must not read
+static std::vector<float> make_texels(uint32_t layers, uint32_t components, const std::function<void(size_t, float *)> &fill)
+{
+	std::vector<float> texels(size_t(IMAGE_WIDTH) * IMAGE_HEIGHT * std::max(layers, 1u) * components);
+	uint32_t seed = layers * 31u + components;
+	for (auto &t : texels) {
+		t = 1.0f + 9.0f * random(seed);
+	}
+	const size_t layer_offset = layers > 1 ? size_t(IMAGE_WIDTH) * IMAGE_HEIGHT * ACCUMULATION_LAYER * components : 0;
+	for (uint32_t y = 0; y < RENDER_HEIGHT; ++y) {
+		for (uint32_t x = 0; x < RENDER_WIDTH; ++x) {
+			fill(size_t(y) * RENDER_WIDTH + x, &texels[layer_offset + (size_t(y) * IMAGE_WIDTH + x) * components]);
+		}
+	}
+	return texels;
+}
+
+static std::vector<uint16_t> to_half(const std::vector<float> &texels)
+{
+	std::vector<uint16_t> halfs(texels.size());
+	std::transform(texels.begin(), texels.end(), halfs.begin(), float_to_half);
+	return halfs;
+}
+
+int main()
+{
+	ComputeDevice device;
+	if (!device.init()) {
+		return TEST_SKIPPED;
+	}
+
+	const auto in = make_input();
+	const auto accumulation_texels = make_texels(2, 4, [&](size_t p, float *t) {
+		std::memcpy(t, &in.accumulation[p], 4 * sizeof(float));
+	});
+	const auto moments_texels = make_texels(2, 1, [&](size_t p, float *t) {
+		t[0] = in.moments[p];
+	});
+	const auto surfaces_texels = to_half(make_texels(2, 4, [&](size_t p, float *t) {
+		std::memcpy(t, &in.surfaces[p], 4 * sizeof(float));
+	}));
+	const auto albedo_texels = to_half(make_texels(0, 4, [&](size_t p, float *t) {
+		std::memcpy(t, &in.albedo[p], 3 * sizeof(float));
+		t[3] = 1.0f;
+	}));
+
+	// the formats of the rt images in main.cpp
+	const auto accumulation = device.create_image(VK_FORMAT_R32G32B32A32_SFLOAT, IMAGE_WIDTH, IMAGE_HEIGHT, 2);
+	const auto moments = device.create_image(VK_FORMAT_R32_SFLOAT, IMAGE_WIDTH, IMAGE_HEIGHT, 2);
+	const auto surfaces = device.create_image(VK_FORMAT_R16G16B16A16_SFLOAT, IMAGE_WIDTH, IMAGE_HEIGHT, 2);
+	const auto albedo = device.create_image(VK_FORMAT_R16G16B16A16_SFLOAT, IMAGE_WIDTH, IMAGE_HEIGHT, 0);
+	const auto filtered = device.create_image(VK_FORMAT_R32G32B32A32_SFLOAT, IMAGE_WIDTH, IMAGE_HEIGHT, 2);
+	device.upload(accumulation, accumulation_texels.data(), accumulation_texels.size() * sizeof(float));
+	device.upload(moments, moments_texels.data(), moments_texels.size() * sizeof(float));
+	device.upload(surfaces, surfaces_texels.data(), surfaces_texels.size() * sizeof(uint16_t));
+	device.upload(albedo, albedo_texels.data(), albedo_texels.size() * sizeof(uint16_t));
+
+	auto uniforms = device.create_buffer(sizeof(SceneUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	auto *ubo = static_cast<SceneUniforms *>(uniforms.data);
+	ubo->accumulation_layer = ACCUMULATION_LAYER;
+	ubo->render_size = glm::uvec2(RENDER_WIDTH, RENDER_HEIGHT);
+	ubo->image_size = glm::uvec2(IMAGE_WIDTH, IMAGE_HEIGHT);
+
+	const auto pipeline = device.create_pipeline("atrous.comp", {
+		{ 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &accumulation },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &moments },
+		{ 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &surfaces },
+		{ 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &albedo },
+		{ 4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &filtered },
+		{ 5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniforms, nullptr },
+	}, sizeof(uint32_t));
+	const uint32_t groups_x = (RENDER_WIDTH + 7) / 8;
+	const uint32_t groups_y = (RENDER_HEIGHT + 7) / 8;
+
+	std::vector<glm::vec4> result(size_t(IMAGE_WIDTH) * IMAGE_HEIGHT * 2);
+	for (uint32_t iterations = 1; iterations <= MAX_ITERATIONS; ++iterations) {
+		// the dispatches of the frame, like in the application
+		ubo->denoise_iterations = iterations;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			device.dispatch(pipeline, &i, groups_x, groups_y);
+		}
+		device.download(filtered, result.data(), result.size() * sizeof(glm::vec4));
+
+		const auto reference = atrous_filter::filter(in, iterations);
+		const size_t layer_offset = size_t(IMAGE_WIDTH) * IMAGE_HEIGHT * ((iterations - 1) & 1);
+		uint32_t mismatches = 0;
+		float max_error = 0.0f;
+		for (uint32_t y = 0; y < RENDER_HEIGHT; ++y) {
+			for (uint32_t x = 0; x < RENDER_WIDTH; ++x) {
+				const glm::vec4 &gpu = result[layer_offset + size_t(y) * IMAGE_WIDTH + x];
+				const glm::vec3 &cpu = reference[size_t(y) * RENDER_WIDTH + x];
+				for (int c = 0; c < 3; ++c) {
+					// relative above 1, the weights go through exp() and pow() which differ in the last bits
+					const float error = std::fabs(gpu[c] - cpu[c]) / std::max(std::fabs(cpu[c]), 1.0f);
+					if (!(error <= 2e-3f)) {
+						if (mismatches < 8) {
+							fprintf(stderr, "iterations %u pixel (%u, %u) channel %d: shader %g reference %g\n",
+								iterations, x, y, c, gpu[c], cpu[c]);
+						}
+						++mismatches;
+					}
+					max_error = std::max(max_error, error);
+				}
+			}
+		}
+		fprintf(stdout, "%u iterations: max error %g\n", iterations, max_error);
+		CHECK(mismatches == 0);
+	}
+
+	// the dispatches past denoise_iterations write nothing
+	std::vector<glm::vec4> before = result;
+	const uint32_t past = MAX_ITERATIONS;
+	device.dispatch(pipeline, &past, groups_x, groups_y);
+	device.download(filtered, result.data(), result.size() * sizeof(glm::vec4));
+	CHECK(std::memcmp(before.data(), result.data(), result.size() * sizeof(glm::vec4)) == 0);
+
+	return test_result("test_atrous_shader");
+}
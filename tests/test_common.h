@@ -0,0 +1,55 @@
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <cstdio>
+#include <cmath>
+
+// checks of the test executables. a failed check is printed and the test keeps going,
+// test_result() turns the failures into the exit code ctest looks at
+inline int &test_failures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++test_failures(); \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(a, b, eps) \
+	do { \
+		const double check_a = double(a), check_b = double(b); \
+		if (!(std::fabs(check_a - check_b) <= double(eps))) { \
+			fprintf(stderr, "%s:%d: check failed: %s == %s (%g != %g)\n", __FILE__, __LINE__, #a, #b, check_a, check_b); \
+			++test_failures(); \
+		} \
+	} while (0)
+
+#define CHECK_THROWS(expr) \
+	do { \
+		bool check_thrown = false; \
+		try { expr; } catch (...) { check_thrown = true; } \
+		if (!check_thrown) { \
+			fprintf(stderr, "%s:%d: check failed: %s did not throw\n", __FILE__, __LINE__, #expr); \
+			++test_failures(); \
+		} \
+	} while (0)
+
+// exit code of a test that needs a device and found none, see SKIP_RETURN_CODE in tests/CMakeLists.txt
+const int TEST_SKIPPED = 77;
+
+inline int test_result(const char *name)
+{
+	if (test_failures()) {
+		fprintf(stderr, "%s: %d checks failed\n", name, test_failures());
+		return 1;
+	}
+	fprintf(stdout, "%s: passed\n", name);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,278 @@
+#include "radiance_cache.h"
+#include "test_common.h"
+
+#include <map>
+#include <limits>
+
+using namespace radiance_cache;
+
+static const glm::vec3 UP(0.0f, 0.0f, 1.0f);
+static const glm::vec3 ORIGIN(0.0f);
+
+static bool same_key(const glm::vec3 &a, const glm::vec3 &na, const glm::vec3 &b, const glm::vec3 &nb, const glm::vec3 &camera_pos)
+{
+	uint32_t slot_a, checksum_a, slot_b, checksum_b;
+	key(a, na, camera_pos, slot_a, checksum_a);
+	key(b, nb, camera_pos, slot_b, checksum_b);
+	return slot_a == slot_b && checksum_a == checksum_b;
+}
+
+static void test_level()
+{
+	CHECK(level(0.0f) == 0);
+	CHECK(level(1.9f) == 0);
+	CHECK(level(4.0f) == 1);
+	CHECK(level(7.9f) == 1);
+	CHECK(level(8.0f) == 2);
+	CHECK(level(1e9f) == 15);
+}
+
+// the cells grow with the camera distance, the normal is quantized to 2 bits per component
+static void test_key()
+{
+	// 5 cm apart, in different cells of the finest level and in the same cell of level 5 (64 cm)
+	CHECK(!same_key(glm::vec3(1.1f, 0.01f, 0.01f), UP, glm::vec3(1.15f, 0.01f, 0.01f), UP, ORIGIN));
+	CHECK(same_key(glm::vec3(100.1f, 0.1f, 0.1f), UP, glm::vec3(100.15f, 0.1f, 0.1f), UP, ORIGIN));
+	// the same point seen from another level is another cell
+	const glm::vec3 p(0.5f, 0.5f, 0.01f);
+	uint32_t slot_near, checksum_near, slot_far, checksum_far;
+	key(p, UP, ORIGIN, slot_near, checksum_near);
+	key(p, UP, glm::vec3(30.0f, 0.0f, 0.0f), slot_far, checksum_far);
+	CHECK(slot_near != slot_far || checksum_near != checksum_far);
+
+	// opposite sides of a thin wall do not share a cell, small normal changes do
+	CHECK(!same_key(p, UP, p, -1.0f * UP, ORIGIN));
+	CHECK(same_key(p, UP, p, glm::normalize(glm::vec3(0.05f, 0.0f, 1.0f)), ORIGIN));
+
+	// negative coordinates wrap like in the shader and are cells of their own
+	CHECK(!same_key(glm::vec3(-0.01f, 0.01f, 0.01f), UP, glm::vec3(0.01f, 0.01f, 0.01f), UP, ORIGIN));
+	CHECK(same_key(glm::vec3(-0.011f, 0.01f, 0.01f), UP, glm::vec3(-0.019f, 0.01f, 0.01f), UP, ORIGIN));
+}
+
+// distinct keys of the finest level never share a checksum within a probe window of the full size cache
+static void test_collisions()
+{
+	const uint32_t mask = (1u << 20) - 1u;
+	std::map<uint32_t, std::vector<uint32_t>> slots_by_checksum;
+	uint32_t keys = 0;
+	for (int z = 0; z < 60; ++z) {
+		for (int y = 0; y < 60; ++y) {
+			for (int x = 0; x < 60; ++x) {
+				// cell centers within a meter of the camera
+				const glm::vec3 pos = (glm::vec3(float(x), float(y), float(z)) + 0.5f) * CELL_SIZE;
+				uint32_t slot_hash, checksum;
+				key(pos, UP, glm::vec3(0.6f), slot_hash, checksum);
+				CHECK(checksum != 0u);
+				slots_by_checksum[checksum].push_back(slot_hash & mask);
+				++keys;
+			}
+		}
+	}
+	uint32_t aliased = 0;
+	for (const auto &entry : slots_by_checksum) {
+		const auto &slots = entry.second;
+		for (size_t i = 0; i < slots.size(); ++i) {
+			for (size_t j = i + 1; j < slots.size(); ++j) {
+				const uint32_t d = (slots[i] - slots[j]) & mask;
+				if (d < PROBES || ((mask + 1u - d) & mask) < PROBES) ++aliased;
+			}
+		}
+	}
+	CHECK(keys == 216000u);
+	CHECK(aliased == 0u);
+
+	// a small table, each key that found a cell reads back its own radiance and the others find nothing
+	std::vector<Cell> cells(256, Cell{});
+	uint32_t stored = 0;
+	std::vector<bool> inserted(200, false);
+	for (uint32_t i = 0; i < 200; ++i) {
+		const glm::vec3 pos(float(i) * 0.1f + 0.005f, 0.005f, 0.005f);
+		const glm::vec3 radiance(float(i) * 0.25f);
+		for (uint32_t s = 0; s < MIN_SAMPLES; ++s) {
+			insert(cells, pos, UP, pos, radiance, 0);
+		}
+		uint32_t slot_hash, checksum;
+		key(pos, UP, pos, slot_hash, checksum);
+		inserted[i] = find(cells, slot_hash, checksum, false) >= 0;
+		stored += inserted[i] ? 1 : 0;
+	}
+	CHECK(stored > 150u);
+	for (uint32_t i = 0; i < 200; ++i) {
+		const glm::vec3 pos(float(i) * 0.1f + 0.005f, 0.005f, 0.005f);
+		glm::vec3 radiance;
+		const bool found = lookup(cells, pos, UP, pos, 0, radiance);
+		CHECK(found == inserted[i]);
+		if (found) {
+			CHECK_NEAR(radiance.x, float(i) * 0.25f, 0.5f / FIXED_POINT);
+		}
+	}
+}
+
+// a key gives up after PROBES occupied cells, also where the probes wrap around the table
+static void test_probe_exhaustion()
+{
+	const uint32_t size = 64;
+	const uint32_t checksum = 0x12345678u;
+	for (uint32_t start : { 5u, 60u }) {
+		std::vector<Cell> cells(size, Cell{});
+		for (uint32_t i = 0; i < PROBES; ++i) {
+			cells[(start + i) % size].checksum = 100u + i;
+		}
+		// the key sits right after the probe window, where it is never looked for
+		cells[(start + PROBES) % size].checksum = checksum;
+		CHECK(find(cells, start, checksum, false) == -1);
+		CHECK(find(cells, start, checksum, true) == -1);
+		for (uint32_t i = 0; i < size; ++i) {
+			if (i != (start + PROBES) % size) CHECK(cells[i].checksum != checksum);
+		}
+
+		// the last probe is freed, the key is claimed there and found again
+		const uint32_t last = (start + PROBES - 1) % size;
+		cells[last].checksum = 0u;
+		CHECK(find(cells, start, checksum, false) == -1);
+		CHECK(find(cells, start, checksum, true) == int(last));
+		CHECK(cells[last].checksum == checksum);
+		CHECK(find(cells, start, checksum, false) == int(last));
+	}
+
+	// a full table drops the samples of new keys, the existing cells are unchanged
+	std::vector<Cell> full(size, Cell{});
+	for (uint32_t i = 0; i < size; ++i) {
+		full[i].checksum = 1000u + i;
+	}
+	insert(full, glm::vec3(0.005f), UP, ORIGIN, glm::vec3(1.0f), 0);
+	glm::vec3 radiance;
+	CHECK(!lookup(full, glm::vec3(0.005f), UP, ORIGIN, 0, radiance));
+	for (uint32_t i = 0; i < size; ++i) {
+		CHECK(full[i].checksum == 1000u + i && full[i].sample_count == 0u);
+	}
+}
+
+// the sums are 8 bit fixed point, clamped so that MAX_SAMPLES of MAX_RADIANCE fit in 32 bits
+static void test_accumulation()
+{
+	const glm::vec3 pos(0.25f, 0.25f, 0.0f);
+	std::vector<Cell> cells(1024, Cell{});
+	glm::vec3 radiance;
+	for (uint32_t s = 0; s < MIN_SAMPLES; ++s) {
+		CHECK(!lookup(cells, pos, UP, ORIGIN, 0, radiance));
+		insert(cells, pos, UP, ORIGIN, s % 2 ? glm::vec3(0.1f, 1.7f, 10.123f) : glm::vec3(0.2f, 1.7f, 10.123f), 0);
+	}
+	CHECK(lookup(cells, pos, UP, ORIGIN, 0, radiance));
+	CHECK_NEAR(radiance.x, 0.15f, 0.5f / FIXED_POINT);
+	CHECK_NEAR(radiance.y, 1.7f, 0.5f / FIXED_POINT);
+	CHECK_NEAR(radiance.z, 10.123f, 0.5f / FIXED_POINT);
+
+	// invalid samples are dropped without counting
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const float inf = std::numeric_limits<float>::infinity();
+	const glm::vec3 other(0.75f, 0.25f, 0.0f);
+	insert(cells, other, UP, ORIGIN, glm::vec3(nan, 1.0f, 1.0f), 0);
+	insert(cells, other, UP, ORIGIN, glm::vec3(1.0f, inf, 1.0f), 0);
+	uint32_t slot_hash, checksum;
+	key(other, UP, ORIGIN, slot_hash, checksum);
+	CHECK(find(cells, slot_hash, checksum, false) == -1);
+
+	// out of range samples are clamped, the cell stops learning at MAX_SAMPLES without overflowing
+	for (uint32_t s = 0; s < MAX_SAMPLES + 100; ++s) {
+		insert(cells, other, UP, ORIGIN, glm::vec3(1e6f, -5.0f, MAX_RADIANCE), 0);
+	}
+	const int cell = find(cells, slot_hash, checksum, false);
+	CHECK(cell >= 0);
+	if (cell >= 0) {
+		CHECK(cells[cell].sample_count == MAX_SAMPLES);
+		CHECK(cells[cell].radiance[0] == uint32_t(MAX_SAMPLES * MAX_RADIANCE * FIXED_POINT));
+		CHECK(cells[cell].radiance[1] == 0u);
+	}
+	CHECK(lookup(cells, other, UP, ORIGIN, 0, radiance));
+	CHECK_NEAR(radiance.x, MAX_RADIANCE, 0.0f);
+	CHECK_NEAR(radiance.y, 0.0f, 0.0f);
+	CHECK_NEAR(radiance.z, MAX_RADIANCE, 0.0f);
+	CHECK(double(MAX_SAMPLES) * MAX_RADIANCE * FIXED_POINT < 4294967296.0);
+}
+
+// a cell is freed once no insert or lookup used it for more than MAX_AGE frames, also across a wrap of the frame counter
+static void test_age()
+{
+	const glm::vec3 pos(0.25f, 0.25f, 0.0f);
+	uint32_t slot_hash, checksum;
+	key(pos, UP, ORIGIN, slot_hash, checksum);
+	for (uint32_t first : { 10u, 0xfffffff0u }) {
+		std::vector<Cell> cells(64, Cell{});
+		insert(cells, pos, UP, ORIGIN, glm::vec3(1.0f), first);
+		const int cell = find(cells, slot_hash, checksum, false);
+		CHECK(cell >= 0);
+		if (cell < 0) continue;
+
+		// a lookup is a use, even before the cell has enough samples
+		glm::vec3 radiance;
+		CHECK(!lookup(cells, pos, UP, ORIGIN, first + MAX_AGE, radiance));
+		const uint32_t used = first + MAX_AGE;
+		age(cells, uint32_t(cell), used + MAX_AGE);
+		CHECK(cells[cell].checksum == checksum && cells[cell].sample_count == 1u);
+		age(cells, uint32_t(cell), used + MAX_AGE + 1);
+		CHECK(cells[cell].checksum == 0u && cells[cell].sample_count == 0u && cells[cell].radiance[0] == 0u);
+		CHECK(find(cells, slot_hash, checksum, false) == -1);
+	}
+
+	// free cells stay free, the slices of AGE_SLICES frames cover the table once
+	std::vector<Cell> cells(64, Cell{});
+	for (uint32_t i = 0; i < 64; ++i) {
+		cells[i].checksum = 100u + i;
+		cells[i].last_used = i % 2 ? 1000u : 0u;
+	}
+	for (uint32_t frame = 1000; frame < 1000 + AGE_SLICES; ++frame) {
+		age_slice(cells, frame);
+	}
+	for (uint32_t i = 0; i < 64; ++i) {
+		CHECK(cells[i].checksum == (i % 2 ? 100u + i : 0u));
+	}
+}
+
+// the camera moves along a row of surfaces and keeps creating cells. without the aging the table
+// fills up and the surfaces in view get none, with it the cells out of view make room
+static uint32_t keys_in_view_after_moving(bool aging)
+{
+	const uint32_t frames = 12000;
+	const uint32_t in_view = 64;
+	std::vector<Cell> cells(1024, Cell{});
+	uint32_t found = 0;
+	for (uint32_t frame = 1; frame <= frames; ++frame) {
+		// a new surface comes into view every 8 frames
+		const uint32_t first = frame / 8;
+		const glm::vec3 camera_pos(0.1f * float(first + in_view / 2), 0.0f, 0.5f);
+		if (aging) {
+			age_slice(cells, frame);
+		}
+		found = 0;
+		for (uint32_t i = first; i < first + in_view; ++i) {
+			const glm::vec3 pos(0.1f * float(i) + 0.005f, 0.005f, 0.005f);
+			insert(cells, pos, UP, camera_pos, glm::vec3(1.0f), frame);
+			uint32_t slot_hash, checksum;
+			key(pos, UP, camera_pos, slot_hash, checksum);
+			found += find(cells, slot_hash, checksum, false) >= 0 ? 1 : 0;
+		}
+	}
+	return found;
+}
+
+static void test_moving_camera()
+{
+	const uint32_t without_aging = keys_in_view_after_moving(false);
+	const uint32_t with_aging = keys_in_view_after_moving(true);
+	fprintf(stdout, "surfaces in view with a cell: %u without aging, %u with aging\n", without_aging, with_aging);
+	CHECK(without_aging < 32u);
+	CHECK(with_aging == 64u);
+}
+
+int main()
+{
+	test_level();
+	test_key();
+	test_collisions();
+	test_probe_exhaustion();
+	test_accumulation();
+	test_age();
+	test_moving_camera();
+	return test_result("test_radiance_cache");
+}
@@ -0,0 +1,114 @@
+#include "radix_sort.h"
+#include "test_common.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+// the sorts of a path queue, a key per path: the shading branch and the material like wf_sort_key()
+static std::vector<uint32_t> make_keys(uint32_t count, uint32_t distinct, std::mt19937 &rng)
+{
+	std::vector<uint32_t> keys(count);
+	for (auto &k : keys) {
+		const uint32_t v = rng() % distinct;
+		k = ((v % 7u) << 5u) | (v / 7u % 32u);
+	}
+	return keys;
+}
+
+// the counts of every block add up to the block size, each is the count of its digit
+static void test_histogram(const std::vector<uint32_t> &keys)
+{
+	const uint32_t count = uint32_t(keys.size());
+	const uint32_t blocks = radix_sort::block_count(count);
+	CHECK(blocks * radix_sort::BLOCK_SIZE >= count && (blocks == 0 || (blocks - 1) * radix_sort::BLOCK_SIZE < count));
+	for (uint32_t pass = 0; pass < radix_sort::PASSES; ++pass) {
+		const auto hist = radix_sort::histogram(keys, pass);
+		CHECK(hist.size() == radix_sort::RADIX * blocks);
+		for (uint32_t b = 0; b < blocks; ++b) {
+			const uint32_t begin = b * radix_sort::BLOCK_SIZE;
+			const uint32_t end = std::min(begin + radix_sort::BLOCK_SIZE, count);
+			uint32_t sum = 0;
+			for (uint32_t d = 0; d < radix_sort::RADIX; ++d) {
+				const uint32_t expected = uint32_t(std::count_if(keys.begin() + begin, keys.begin() + end,
+					[&](uint32_t k) { return ((k >> (pass * radix_sort::RADIX_BITS)) & (radix_sort::RADIX - 1)) == d; }));
+				CHECK(hist[d * blocks + b] == expected);
+				sum += hist[d * blocks + b];
+			}
+			CHECK(sum == end - begin);
+		}
+
+		// exclusive, the last offset plus the last count is the key count
+		auto offsets = hist;
+		radix_sort::scan(offsets);
+		uint32_t running = 0;
+		for (size_t i = 0; i < hist.size(); ++i) {
+			CHECK(offsets[i] == running);
+			running += hist[i];
+		}
+		CHECK(running == count);
+	}
+}
+
+// the keys come out ordered, the values of equal keys keep their order
+static void test_sort(const std::vector<uint32_t> &keys)
+{
+	const uint32_t count = uint32_t(keys.size());
+	std::vector<uint32_t> sorted_keys = keys;
+	// the values are the positions, so the stability shows
+	std::vector<uint32_t> values(count);
+	std::iota(values.begin(), values.end(), 0u);
+	radix_sort::sort(sorted_keys, values);
+	CHECK(sorted_keys.size() == count && values.size() == count);
+
+	std::vector<uint32_t> expected(count);
+	std::iota(expected.begin(), expected.end(), 0u);
+	std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+	CHECK(values == expected);
+	for (uint32_t i = 0; i < count; ++i) {
+		CHECK(sorted_keys[i] == keys[values[i]]);
+		if (i > 0) {
+			CHECK(sorted_keys[i - 1] <= sorted_keys[i]);
+			if (sorted_keys[i - 1] == sorted_keys[i]) CHECK(values[i - 1] < values[i]);
+		}
+	}
+
+	// one pass is stable on its digit only, the keys of the first pass are sorted by the low digit
+	std::vector<uint32_t> offsets = radix_sort::histogram(keys, 0);
+	radix_sort::scan(offsets);
+	std::vector<uint32_t> pass_keys, pass_values;
+	std::iota(values.begin(), values.end(), 0u);
+	radix_sort::scatter(keys, values, offsets, 0, pass_keys, pass_values);
+	for (uint32_t i = 1; i < count; ++i) {
+		const uint32_t a = pass_keys[i - 1] & (radix_sort::RADIX - 1), b = pass_keys[i] & (radix_sort::RADIX - 1);
+		CHECK(a <= b);
+		if (a == b) CHECK(pass_values[i - 1] < pass_values[i]);
+	}
+}
+
+static void test_invalid_input()
+{
+	const std::vector<uint32_t> keys(300, 1u);
+	const std::vector<uint32_t> values(299, 0u);
+	std::vector<uint32_t> offsets = radix_sort::histogram(keys, 0);
+	radix_sort::scan(offsets);
+	std::vector<uint32_t> keys_out, values_out;
+	CHECK_THROWS(radix_sort::scatter(keys, values, offsets, 0, keys_out, values_out));
+	offsets.pop_back();
+	CHECK_THROWS(radix_sort::scatter(keys, std::vector<uint32_t>(300, 0u), offsets, 0, keys_out, values_out));
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	// empty, partial, exact and several blocks, with all keys, a few and a single one
+	for (uint32_t count : { 0u, 1u, 255u, 256u, 257u, 1000u, 4099u }) {
+		for (uint32_t distinct : { 224u, 5u, 1u }) {
+			const auto keys = make_keys(count, distinct, rng);
+			test_histogram(keys);
+			test_sort(keys);
+		}
+	}
+	test_invalid_input();
+	return test_result("test_radix_sort");
+}
@@ -0,0 +1,154 @@
+#include "sampler.h"
+#include "sampler_tables.h"
+#include "test_common.h"
+
+#include <cmath>
+#include <functional>
+
+static const double PI = 3.14159265358979323846;
+
+// the elementary intervals of 2^-a x 2^-(m - a) hold exactly one of 2^m points, for every a
+static bool is_02_net(const std::vector<uint32_t> &xs, const std::vector<uint32_t> &ys, uint32_t m)
+{
+	const uint32_t count = 1u << m;
+	for (uint32_t a = 0; a <= m; ++a) {
+		std::vector<uint32_t> hits(count, 0);
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t cx = a ? xs[i] >> (32u - a) : 0u;
+			const uint32_t cy = (m - a) ? ys[i] >> (32u - (m - a)) : 0u;
+			hits[(cx << (m - a)) | cy]++;
+		}
+		for (uint32_t h : hits) {
+			if (h != 1) return false;
+		}
+	}
+	return true;
+}
+
+// every aligned block of 2^m consecutive points of the sobol matrices is a (0, m, 2) net
+static void test_sobol_stratification(const sampler::Tables &tables)
+{
+	for (uint32_t m = 1; m <= 10; ++m) {
+		for (uint32_t block = 0; block < 4; ++block) {
+			std::vector<uint32_t> xs(1u << m), ys(1u << m);
+			for (uint32_t i = 0; i < (1u << m); ++i) {
+				const uint32_t index = (block << m) + i;
+				xs[i] = sampler::sobol_sample(tables, index, 0);
+				ys[i] = sampler::sobol_sample(tables, index, 1);
+			}
+			CHECK(is_02_net(xs, ys, m));
+		}
+	}
+
+	// the owen scrambled pairs of the sobol sampler keep the stratification, for any pixel and pair of dimensions
+	for (uint32_t m = 1; m <= 10; ++m) {
+		for (uint32_t pair = 0; pair < 3; ++pair) {
+			std::vector<uint32_t> xs(1u << m), ys(1u << m);
+			for (uint32_t i = 0; i < (1u << m); ++i) {
+				uint32_t seed = sampler::init(sampler::SOBOL, 3, 7, 64, i) + 2 * pair;
+				// the shader keeps 24 bits
+				xs[i] = uint32_t(sampler::random_float(tables, seed, 3, 7) * 16777216.0f) << 8u;
+				ys[i] = uint32_t(sampler::random_float(tables, seed, 3, 7) * 16777216.0f) << 8u;
+			}
+			CHECK(is_02_net(xs, ys, m));
+		}
+	}
+
+	// the scrambles decorrelate the pixels
+	uint32_t seed_a = sampler::init(sampler::SOBOL, 0, 0, 64, 5);
+	uint32_t seed_b = sampler::init(sampler::SOBOL, 1, 0, 64, 5);
+	CHECK(sampler::random_float(tables, seed_a, 0, 0) != sampler::random_float(tables, seed_b, 1, 0));
+}
+
+struct Integrand
+{
+	const char *name;
+	std::function<double(double, double)> f;
+	double reference;
+};
+
+// rmse over the pixels of the estimate of the integral over [0, 1)^2 with spp samples per pixel
+static double rmse(const sampler::Tables &tables, sampler::Type type, const Integrand &integrand, uint32_t spp)
+{
+	const uint32_t size = 32;
+	double squared_error = 0.0;
+	for (uint32_t py = 0; py < size; ++py) {
+		for (uint32_t px = 0; px < size; ++px) {
+			double sum = 0.0;
+			for (uint32_t s = 0; s < spp; ++s) {
+				uint32_t seed = sampler::init(type, px, py, size, s);
+				const float x = sampler::random_float(tables, seed, px, py);
+				const float y = sampler::random_float(tables, seed, px, py);
+				CHECK(x >= 0.0f && x < 1.0f && y >= 0.0f && y < 1.0f);
+				sum += integrand.f(x, y);
+			}
+			const double error = sum / spp - integrand.reference;
+			squared_error += error * error;
+		}
+	}
+	return std::sqrt(squared_error / (size * size));
+}
+
+// the estimates converge at least as fast as independent samples, much faster for the smooth integrands
+static void test_convergence(const sampler::Tables &tables)
+{
+	const Integrand integrands[] = {
+		// smooth, standard deviation 0.217
+		{ "bilinear", [](double x, double y) { return x * y; }, 0.25 },
+		// smooth, standard deviation 0.309
+		{ "sines", [](double x, double y) { return std::sin(PI * x) * std::sin(PI * y); }, 4.0 / (PI * PI) },
+		// discontinuous, standard deviation 0.411
+		{ "disk", [](double x, double y) { return x * x + y * y < 1.0 ? 1.0 : 0.0; }, PI / 4.0 },
+	};
+	const double sigmas[] = {
+		std::sqrt(1.0 / 9.0 - 1.0 / 16.0),
+		std::sqrt(0.25 - 16.0 / (PI * PI * PI * PI)),
+		std::sqrt(PI / 4.0 * (1.0 - PI / 4.0)),
+	};
+
+	// the rate is the slope of the rmse between 16 and 256 spp on a log log plot
+	const uint32_t low_spp = 16;
+	const uint32_t high_spp = 256;
+	const double log_ratio = std::log(double(high_spp) / double(low_spp));
+	for (uint32_t i = 0; i < 3; ++i) {
+		const bool smooth = i < 2;
+		double random[2], sobol[2], blue_noise[2];
+		for (uint32_t k = 0; k < 2; ++k) {
+			const uint32_t spp = k ? high_spp : low_spp;
+			random[k] = rmse(tables, sampler::RANDOM, integrands[i], spp);
+			sobol[k] = rmse(tables, sampler::SOBOL, integrands[i], spp);
+			blue_noise[k] = rmse(tables, sampler::BLUE_NOISE, integrands[i], spp);
+			fprintf(stdout, "%-8s %3u spp: rmse random %.5f (expected %.5f) sobol %.5f blue noise %.5f\n",
+				integrands[i].name, spp, random[k], sigmas[i] / std::sqrt(double(spp)), sobol[k], blue_noise[k]);
+
+			// independent samples, over 1024 pixels the rmse is within a few percent of sigma / sqrt(spp)
+			const double expected_random = sigmas[i] / std::sqrt(double(spp));
+			CHECK(random[k] > 0.85 * expected_random && random[k] < 1.15 * expected_random);
+			CHECK(sobol[k] < (k ? 0.3 : 0.7) * random[k]);
+			CHECK(blue_noise[k] < (k ? 0.3 : 0.7) * random[k]);
+		}
+		const double random_rate = std::log(random[0] / random[1]) / log_ratio;
+		const double sobol_rate = std::log(sobol[0] / sobol[1]) / log_ratio;
+		const double blue_noise_rate = std::log(blue_noise[0] / blue_noise[1]) / log_ratio;
+		fprintf(stdout, "%-8s convergence rate: random %.2f sobol %.2f blue noise %.2f\n",
+			integrands[i].name, random_rate, sobol_rate, blue_noise_rate);
+
+		CHECK(random_rate > 0.4 && random_rate < 0.6);
+		// owen scrambled sobol converges close to n^-1.5 for smooth integrands and n^-0.75 at the disk edge
+		CHECK(sobol_rate > (smooth ? 1.2 : 0.65));
+		// the rotation of the blue noise mode breaks part of the stratification, it stays well ahead of n^-0.5
+		CHECK(blue_noise_rate > 0.7);
+	}
+}
+
+int main()
+{
+	sampler::Tables tables;
+	tables.sobol_matrices = sampler_tables::sobol_matrices();
+	tables.blue_noise_size = 64;
+	tables.blue_noise = sampler_tables::blue_noise_tile(tables.blue_noise_size);
+
+	test_sobol_stratification(tables);
+	test_convergence(tables);
+	return test_result("test_sampler");
+}
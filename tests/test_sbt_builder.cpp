@@ -0,0 +1,180 @@
+#include "sbt_builder.h"
+#include "test_common.h"
+
+#include <cstring>
+
+using Region = ShaderBindingTableBuilder::Region;
+
+static VkPhysicalDeviceRayTracingPipelinePropertiesKHR make_props(uint32_t handle_size, uint32_t handle_alignment,
+	uint32_t base_alignment, uint32_t max_stride = 4096)
+{
+	VkPhysicalDeviceRayTracingPipelinePropertiesKHR props = {};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+	props.shaderGroupHandleSize = handle_size;
+	props.shaderGroupHandleAlignment = handle_alignment;
+	props.shaderGroupBaseAlignment = base_alignment;
+	props.maxShaderGroupStride = max_stride;
+	return props;
+}
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return ((value + alignment - 1) / alignment) * alignment;
+}
+
+// handle i is filled with the byte i + 1, so the records show which group they point to
+static std::vector<uint8_t> make_handles(uint32_t handle_size, uint32_t group_count)
+{
+	std::vector<uint8_t> handles(size_t(handle_size) * group_count);
+	for (uint32_t g = 0; g < group_count; ++g) {
+		std::memset(handles.data() + size_t(g) * handle_size, int(g + 1), handle_size);
+	}
+	return handles;
+}
+
+// the layout of the table the application builds, for a set of device properties
+static void test_layout(uint32_t handle_size, uint32_t handle_alignment, uint32_t base_alignment)
+{
+	const auto props = make_props(handle_size, handle_alignment, base_alignment);
+	ShaderBindingTableBuilder sbt(props);
+
+	const uint64_t sphere_data[2] = { 0x1111, 0x2222 };
+	sbt.add_record(Region::Raygen, 0);
+	sbt.add_record(Region::Miss, 1);
+	sbt.add_record(Region::Miss, 2);
+	sbt.add_record(Region::Hit, 3);
+	sbt.add_record(Region::Hit, 4, sphere_data);
+	sbt.add_record(Region::Hit, 5);
+
+	// raygen records start a region each, so they are base aligned
+	CHECK(sbt.stride(Region::Raygen) == align_up(align_up(handle_size, handle_alignment), base_alignment));
+	CHECK(sbt.stride(Region::Miss) == align_up(handle_size, handle_alignment));
+	CHECK(sbt.stride(Region::Hit) == align_up(handle_size + sizeof(sphere_data), handle_alignment));
+	CHECK(sbt.stride(Region::Callable) == 0);
+
+	for (uint32_t r = 0; r < uint32_t(Region::Count); ++r) {
+		CHECK(sbt.region_offset(Region(r)) % base_alignment == 0);
+		CHECK(sbt.stride(Region(r)) % handle_alignment == 0);
+		CHECK(sbt.stride(Region(r)) <= props.maxShaderGroupStride);
+	}
+	CHECK(sbt.region_offset(Region::Miss) >= sbt.region_size(Region::Raygen));
+	CHECK(sbt.region_offset(Region::Hit) >= sbt.region_offset(Region::Miss) + sbt.region_size(Region::Miss));
+	// the empty callable region starts base aligned after the hit region
+	CHECK(sbt.size() == align_up(sbt.region_offset(Region::Hit) + sbt.region_size(Region::Hit), base_alignment));
+
+	const VkDeviceAddress address = 0x10000;
+	const auto raygen = sbt.region(Region::Raygen, address);
+	CHECK(raygen.deviceAddress == address);
+	CHECK(raygen.size == raygen.stride);
+	const auto hit = sbt.region(Region::Hit, address);
+	CHECK(hit.deviceAddress == address + sbt.region_offset(Region::Hit));
+	CHECK(hit.size == 3 * hit.stride);
+	const auto callable = sbt.region(Region::Callable, address);
+	CHECK(callable.deviceAddress == 0 && callable.stride == 0 && callable.size == 0);
+
+	// the handles and the inline data land at the record offsets, the padding is zero
+	const auto handles = make_handles(handle_size, 6);
+	std::vector<uint8_t> table(sbt.size(), 0xcd);
+	sbt.write(table.data(), handles);
+	const uint8_t *sphere = table.data() + sbt.region_offset(Region::Hit) + sbt.stride(Region::Hit);
+	CHECK(sphere[0] == 5 && sphere[handle_size - 1] == 5);
+	CHECK(std::memcmp(sphere + handle_size, sphere_data, sizeof(sphere_data)) == 0);
+	const uint8_t *miss = table.data() + sbt.region_offset(Region::Miss) + sbt.stride(Region::Miss);
+	CHECK(miss[0] == 3);
+	const uint8_t *raygen_record = table.data();
+	CHECK(raygen_record[0] == 1);
+	if (sbt.stride(Region::Raygen) > handle_size) {
+		CHECK(raygen_record[sbt.stride(Region::Raygen) - 1] == 0);
+	}
+
+	// a record of a group without handle is an error
+	ShaderBindingTableBuilder bad(props);
+	bad.add_record(Region::Miss, 7);
+	std::vector<uint8_t> bad_table(bad.size());
+	CHECK_THROWS(bad.write(bad_table.data(), handles));
+}
+
+static void test_invalid_properties()
+{
+	CHECK_THROWS(ShaderBindingTableBuilder(make_props(0, 32, 64)));
+	CHECK_THROWS(ShaderBindingTableBuilder(make_props(32, 0, 64)));
+	CHECK_THROWS(ShaderBindingTableBuilder(make_props(32, 32, 0)));
+}
+
+// a record larger than maxShaderGroupStride is rejected when it is added and leaves the table as it was
+static void test_stride_overflow()
+{
+	ShaderBindingTableBuilder sbt(make_props(32, 32, 64, 64));
+	const uint8_t fits[32] = {};
+	const uint8_t too_large[40] = {};
+	sbt.add_record(Region::Hit, 0, fits);
+	CHECK(sbt.stride(Region::Hit) == 64);
+	CHECK_THROWS(sbt.add_record(Region::Hit, 1, too_large));
+	CHECK(sbt.record_count(Region::Hit) == 1);
+	CHECK(sbt.stride(Region::Hit) == 64);
+
+	// the raygen stride is rounded up to the base alignment, which can exceed the limit on its own
+	ShaderBindingTableBuilder raygen(make_props(32, 32, 128, 64));
+	CHECK_THROWS(raygen.add_record(Region::Raygen, 0));
+	CHECK(raygen.record_count(Region::Raygen) == 0);
+}
+
+// set_record_data() keeps the layout, so a rewrite of one record matches a full write
+static void test_in_place_rewrite()
+{
+	const uint32_t handle_size = 32;
+	ShaderBindingTableBuilder sbt(make_props(handle_size, 32, 64));
+	// with the large record the stride is 96, without it 64
+	const uint64_t large[5] = { 1, 2, 3, 4, 5 };
+	const uint64_t small = 5;
+	sbt.add_record(Region::Raygen, 0);
+	sbt.add_record(Region::Miss, 1);
+	sbt.add_record(Region::Hit, 2, large);
+	sbt.add_record(Region::Hit, 3, small);
+	sbt.add_record(Region::Hit, 4);
+
+	const VkDeviceSize stride = sbt.stride(Region::Hit);
+	const VkDeviceSize hit_offset = sbt.region_offset(Region::Hit);
+	const VkDeviceSize size = sbt.size();
+	const auto handles = make_handles(handle_size, 5);
+	std::vector<uint8_t> table(size);
+	sbt.write(table.data(), handles);
+
+	// the largest record shrinks, the stride and the offsets stay
+	sbt.set_record_data(Region::Hit, 0, &small, sizeof(small));
+	CHECK(sbt.stride(Region::Hit) == stride);
+	CHECK(sbt.region_offset(Region::Hit) == hit_offset);
+	CHECK(sbt.size() == size);
+
+	std::vector<uint8_t> rewritten = table;
+	sbt.write_records(rewritten.data(), handles, Region::Hit, 0, 1);
+	std::vector<uint8_t> full(size);
+	sbt.write(full.data(), handles);
+	CHECK(rewritten == full);
+	CHECK(std::memcmp(rewritten.data() + hit_offset + handle_size, &small, sizeof(small)) == 0);
+	// the records after it are untouched
+	CHECK(std::memcmp(rewritten.data() + hit_offset + stride, table.data() + hit_offset + stride, size_t(2 * stride)) == 0);
+
+	// data up to the stride fits, more does not
+	const std::vector<uint8_t> padded(size_t(stride) - handle_size);
+	sbt.set_record_data(Region::Hit, 2, padded.data(), padded.size());
+	CHECK(sbt.stride(Region::Hit) == stride);
+	const std::vector<uint8_t> too_large(size_t(stride) - handle_size + 1);
+	CHECK_THROWS(sbt.set_record_data(Region::Hit, 2, too_large.data(), too_large.size()));
+	CHECK_THROWS(sbt.set_record_data(Region::Hit, 3, &small, sizeof(small)));
+	CHECK_THROWS(sbt.write_records(rewritten.data(), handles, Region::Hit, 2, 2));
+}
+
+int main()
+{
+	// handle size, handle alignment and base alignment of the common devices and some made up ones
+	test_layout(32, 32, 64);
+	test_layout(32, 32, 32);
+	test_layout(32, 8, 64);
+	test_layout(16, 16, 256);
+	test_layout(24, 8, 32);
+	test_invalid_properties();
+	test_stride_overflow();
+	test_in_place_rewrite();
+	return test_result("test_sbt_builder");
+}
@@ -0,0 +1,142 @@
+#include "radix_sort.h"
+#include "scene_uniforms.h"
+#include "compute_device.h"
+#include "test_common.h"
+
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <algorithm>
+
+// shaders/wf_sort_*.comp on random keys, the buffers after every kernel against the cpu reference
+
+// paths the buffers have room for, the queues hold fewer
+static const uint32_t CAPACITY = 3000;
+// the fields of a path in wf_state, WF_FIELDS in wavefront.glsl
+static const uint32_t WF_FIELDS = 8;
+
+// WavefrontQueues of wavefront.glsl, the three queues of CAPACITY entries follow
+struct QueuesHeader
+{
+	uint32_t path_count[2];
+	uint32_t shadow_count;
+	uint32_t pad0;
+	uint32_t path_args[3];
+	uint32_t pad1;
+	uint32_t sort_args[3];
+	uint32_t pad2;
+};
+
+// PushConstants of wavefront.glsl
+struct PushConstants
+{
+	uint32_t dispatch_index;
+	uint32_t bounce;
+	uint32_t sort_pass;
+	uint32_t depth;
+};
+
+// the wf_sort.glsl layout of sort_data
+static const uint32_t HISTOGRAM_OFFSET = 3 * CAPACITY;
+
+static bool equal(const uint32_t *gpu, const std::vector<uint32_t> &cpu, const char *what, uint32_t count, uint32_t pass)
+{
+	for (size_t i = 0; i < cpu.size(); ++i) {
+		if (gpu[i] != cpu[i]) {
+			fprintf(stderr, "%u keys, pass %u: %s differ at %zu, shader %u reference %u\n", count, pass, what, i, gpu[i], cpu[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	ComputeDevice device;
+	if (!device.init()) {
+		return TEST_SKIPPED;
+	}
+
+	auto uniforms = device.create_buffer(sizeof(SceneUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	// only its length is read, it sets the capacity
+	auto state = device.create_buffer(VkDeviceSize(CAPACITY) * WF_FIELDS * 4 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	auto queues = device.create_buffer(sizeof(QueuesHeader) + 3 * CAPACITY * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	// sized like in main.cpp
+	auto sort = device.create_buffer((HISTOGRAM_OFFSET + radix_sort::RADIX * radix_sort::block_count(CAPACITY)) * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	const std::vector<ComputeDevice::Binding> bindings = {
+		{ 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniforms, nullptr },
+		{ 14, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &state, nullptr },
+		{ 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &queues, nullptr },
+		{ 16, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &sort, nullptr },
+	};
+	const auto histogram = device.create_pipeline("wf_sort_histogram.comp", bindings, sizeof(PushConstants));
+	const auto scan = device.create_pipeline("wf_sort_scan.comp", bindings, sizeof(PushConstants));
+	const auto scatter = device.create_pipeline("wf_sort_scatter.comp", bindings, sizeof(PushConstants));
+
+	auto *header = static_cast<QueuesHeader *>(queues.data);
+	uint32_t *queue_data = reinterpret_cast<uint32_t *>(header + 1);
+	uint32_t *sort_data = static_cast<uint32_t *>(sort.data);
+
+	std::mt19937 rng(11);
+	// a partial block, a full one, many and the whole capacity, on both path queues
+	const uint32_t counts[] = { 1, 256, 2777, CAPACITY };
+	for (uint32_t count : counts) {
+		for (uint32_t bounce : { 0u, 1u }) {
+			const uint32_t queue = bounce & 1u;
+			const uint32_t blocks = radix_sort::block_count(count);
+
+			// the keys wf_extend.comp writes, branch and material, and the paths in the queue
+			std::vector<uint32_t> keys(count), values(CAPACITY);
+			for (auto &k : keys) {
+				k = ((rng() % 7u) << 5u) | (rng() % 32u);
+			}
+			std::iota(values.begin(), values.end(), 0u);
+			std::shuffle(values.begin(), values.end(), rng);
+			values.resize(count);
+
+			std::memset(queues.data, 0, size_t(queues.size));
+			std::fill(sort_data, sort_data + sort.size / sizeof(uint32_t), 0xdeadbeefu);
+			// the other queues are not touched
+			std::fill(queue_data, queue_data + 3 * CAPACITY, 0xcafeu);
+			header->path_count[queue] = count;
+			header->path_count[queue ^ 1u] = CAPACITY - count;
+			// wf_args.comp sorts queues of WF_SORT_MIN_PATHS and more, the kernels sort any count
+			header->sort_args[0] = blocks;
+			std::copy(keys.begin(), keys.end(), sort_data);
+			std::copy(values.begin(), values.end(), queue_data + queue * CAPACITY);
+
+			for (uint32_t pass = 0; pass < radix_sort::PASSES; ++pass) {
+				// the passes read buffer pass & 1 and write the other one, the queue is buffer 0
+				const PushConstants pc = { 0, bounce, pass, 32 };
+				const uint32_t dst = (pass & 1u) ^ 1u;
+
+				device.dispatch(histogram, &pc, blocks);
+				auto offsets = radix_sort::histogram(keys, pass);
+				CHECK(equal(sort_data + HISTOGRAM_OFFSET, offsets, "histograms", count, pass));
+
+				device.dispatch(scan, &pc, 1);
+				radix_sort::scan(offsets);
+				CHECK(equal(sort_data + HISTOGRAM_OFFSET, offsets, "offsets", count, pass));
+
+				device.dispatch(scatter, &pc, blocks);
+				std::vector<uint32_t> keys_out, values_out;
+				radix_sort::scatter(keys, values, offsets, pass, keys_out, values_out);
+				CHECK(equal(sort_data + dst * CAPACITY, keys_out, "keys", count, pass));
+				CHECK(equal(dst ? sort_data + 2 * CAPACITY : queue_data + queue * CAPACITY, values_out, "paths", count, pass));
+				keys = keys_out;
+				values = values_out;
+			}
+
+			// the sorted keys and paths end up in buffer 0 and the queue, the rest is as it was
+			CHECK(std::is_sorted(keys.begin(), keys.end()));
+			CHECK(std::all_of(queue_data + (queue ^ 1u) * CAPACITY, queue_data + (queue ^ 1u) * CAPACITY + CAPACITY,
+				[](uint32_t v) { return v == 0xcafeu; }));
+			CHECK(std::all_of(queue_data + queue * CAPACITY + count, queue_data + (queue + 1) * CAPACITY,
+				[](uint32_t v) { return v == 0xcafeu; }));
+			CHECK(std::all_of(sort_data + count, sort_data + CAPACITY, [](uint32_t v) { return v == 0xdeadbeefu; }));
+			CHECK(header->path_count[queue] == count);
+		}
+	}
+	return test_result("test_wf_sort_shaders");
+}